@@ -107,6 +107,77 @@
     #define LUAINTF_AUTO_DOWNCAST 1
 #endif
 
+/**
+ * Set LUAINTF_BULK_PROPERTY_ACCESS to 1 if you want the exported classes to have obj:toTable(fields)
+ * and obj:assign(table) member functions, to read or write many properties in one call.
+ *
+ * The functions are added to the base class, the properties or member functions with the same
+ * name take precedence.
+ */
+#ifndef LUAINTF_BULK_PROPERTY_ACCESS
+    #define LUAINTF_BULK_PROPERTY_ACCESS 0
+#endif
+
+/**
+ * Set LUAINTF_UNIFIED_CONST_METATABLE to 1 if you want const and non-const objects to share
+ * the same class metatable. The constness is stored in the object userdata instead, and checked
+ * only by non-const member functions and setters. This saves one metatable per class, but
+ * non-const member functions are visible (and raise error when called) for const objects.
+ */
+#ifndef LUAINTF_UNIFIED_CONST_METATABLE
+    #define LUAINTF_UNIFIED_CONST_METATABLE 0
+#endif
+
+/**
+ * Set LUAINTF_ARG_ARENA to 1 if you want to decode arguments of bound C++ function with
+ * per-thread bump arena. The std::pmr strings and containers decoded for the call are
+ * allocated from the arena, and released all at once when the call returns.
+ * This requires C++17 <memory_resource>.
+ *
+ * Note the argument must not be moved into storage that outlives the call, copy it instead.
+ */
+#ifndef LUAINTF_ARG_ARENA
+    #define LUAINTF_ARG_ARENA 0
+#endif
+
+/**
+ * Set LUAINTF_CALL_RECORDER to 1 if you want to record the calls across Lua/C++ boundary
+ * with LuaCallRecorder, and replay them with LuaCallReplay. If disabled, the hooks in the
+ * bound functions and LuaRef calls are compiled out.
+ */
+#ifndef LUAINTF_CALL_RECORDER
+    #define LUAINTF_CALL_RECORDER 0
+#endif
+
+/**
+ * Set LUAINTF_DEFERRED_UNREF to 1 if you want to destroy LuaRef on threads other than the one
+ * owning the Lua state. The reference is queued and released later by the owner thread,
+ * see LuaReleaseQueue.
+ */
+#ifndef LUAINTF_DEFERRED_UNREF
+    #define LUAINTF_DEFERRED_UNREF 0
+#endif
+
+/**
+ * Set LUAINTF_METRICS to 1 if you want to collect runtime metrics of Lua state with LuaMetrics,
+ * such as memory, GC cycles, live references, bound objects, calls and errors. If disabled,
+ * the counting hooks are compiled out.
+ */
+#ifndef LUAINTF_METRICS
+    #define LUAINTF_METRICS 0
+#endif
+
+/**
+ * Set LUAINTF_EXTERNAL_STRING_MIN_SIZE to the minimal size of std::string (rvalue) or LuaSharedString
+ * that is handed over to Lua without copying. The smaller string is copied, which is faster than
+ * allocating the buffer owner.
+ *
+ * This option applies to lua 5.5 or later version only, which supports external string.
+ */
+#ifndef LUAINTF_EXTERNAL_STRING_MIN_SIZE
+    #define LUAINTF_EXTERNAL_STRING_MIN_SIZE 1024
+#endif
+
 //---------------------------------------------------------------------------
 
 #if LUAINTF_HEADERS_ONLY
@@ -224,6 +295,28 @@ int luaL_fileresult(lua_State* L, int stat, const char* fname);
 
 //---------------------------------------------------------------------------
 
+#if LUA_VERSION_NUM <= 504
+
+#if !LUAINTF_LINK_LUA_COMPILED_IN_CXX
+extern "C"
+{
+#endif
+
+/**
+ * Lua 5.5 creates string that refers to external buffer without copying, the buffer is released
+ * by calling falloc(ud, s, len + 1, 0) when the string is collected. For older version the string
+ * is copied, and the buffer is released right away.
+ */
+const char* lua_pushexternalstring(lua_State* L, const char* s, size_t len, lua_Alloc falloc, void* ud);
+
+#if !LUAINTF_LINK_LUA_COMPILED_IN_CXX
+}
+#endif
+
+#endif
+
+//---------------------------------------------------------------------------
+
 #if LUAINTF_HEADERS_ONLY
 #include "src/LuaCompat.cpp"
 #endif
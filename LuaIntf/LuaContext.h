@@ -30,6 +30,7 @@
 //---------------------------------------------------------------------------
 
 #include "LuaRef.h"
+#include <memory>
 
 namespace LuaIntf
 {
@@ -54,15 +55,23 @@ public:
         , m_own(true)
     {
         L = luaL_newstate();
-        if (!L) throw LuaException("can not allocate new lua state");
-
-#if LUAINTF_LINK_LUA_COMPILED_IN_CXX
-        lua_atpanic(L, panic);
-#endif
+        init(needImportLibs);
+    }
 
-        if (needImportLibs) {
-            importLibs();
-        }
+    /**
+     * Create a new Lua state with memory quota, limit of 0 means unlimited
+     *
+     * @param hard_limit - the allocation past this limit raises memory error, thrown as LuaMemoryException.
+     * @param soft_limit - the allocation past this limit triggers emergency full GC.
+     * @param needImportLibs - true if need to import the standard libraries.
+     */
+    LuaContext(size_t hard_limit, size_t soft_limit, bool needImportLibs = true)
+        : L(nullptr)
+        , m_own(true)
+        , m_quota(new LuaMemoryQuota(hard_limit, soft_limit))
+    {
+        L = LuaState::newState(*m_quota);
+        init(needImportLibs);
     }
 
     /**
@@ -84,6 +93,12 @@ public:
     ~LuaContext()
     {
         if (m_own) {
+#if LUAINTF_METRICS
+            LuaMetrics::detach(L);
+#endif
+#if LUAINTF_DEFERRED_UNREF
+            LuaReleaseQueue::detach(L);
+#endif
             lua_close(L);
         }
     }
@@ -132,8 +147,9 @@ public:
      */
     void doString(const char* code)
     {
-        int err = luaL_dostring(L, code);
-        if (err) throw LuaException(L);
+        int err = luaL_loadstring(L, code);
+        if (err == LUA_OK) err = lua_pcall(L, 0, LUA_MULTRET, 0);
+        if (err) LuaException::raise(L, err);
     }
 
     /**
@@ -144,8 +160,9 @@ public:
      */
     void doFile(const char* path)
     {
-        int err = luaL_dofile(L, path);
-        if (err) throw LuaException(L);
+        int err = luaL_loadfile(L, path);
+        if (err == LUA_OK) err = lua_pcall(L, 0, LUA_MULTRET, 0);
+        if (err) LuaException::raise(L, err);
     }
 
     /**
@@ -188,11 +205,63 @@ public:
      */
     int gc(int what = LUA_GCCOLLECT, int data = 0)
     {
-        return lua_gc(L, what, data);
+        return LuaMemoryQuota::gc(L, what, data);
     }
 
-#if LUAINTF_LINK_LUA_COMPILED_IN_CXX
+    /**
+     * Get the number of bytes allocated by the state
+     */
+    size_t memoryUsed() const
+    {
+        if (m_quota) {
+            return m_quota->used();
+        } else {
+            return size_t(lua_gc(L, LUA_GCCOUNT, 0)) * 1024 + size_t(lua_gc(L, LUA_GCCOUNTB, 0));
+        }
+    }
+
+    /**
+     * Get the memory quota, or nullptr if the state is not created with quota
+     */
+    LuaMemoryQuota* memoryQuota() const
+    {
+        return m_quota.get();
+    }
+
+#if LUAINTF_METRICS
+    /**
+     * Get the runtime metrics attached to the state, or nullptr if not attached
+     */
+    LuaMetrics* metrics() const
+    {
+        return LuaMetrics::find(L);
+    }
+#endif
+
 private:
+    void init(bool needImportLibs)
+    {
+        if (!L) throw LuaException("can not allocate new lua state");
+
+#if LUAINTF_LINK_LUA_COMPILED_IN_CXX
+        lua_atpanic(L, panic);
+#endif
+
+#if LUAINTF_DEFERRED_UNREF
+        LuaReleaseQueue::attach(L);
+#endif
+
+#if LUAINTF_METRICS
+        // attach after release queue, so the metrics wraps the queue allocator
+        LuaMetrics::attach(L);
+#endif
+
+        if (needImportLibs) {
+            importLibs();
+        }
+    }
+
+#if LUAINTF_LINK_LUA_COMPILED_IN_CXX
     static int panic(lua_State* L)
     {
         throw LuaException(L);
@@ -202,6 +271,7 @@ private:
 private:
     lua_State* L;
     bool m_own;
+    std::unique_ptr<LuaMemoryQuota> m_quota;
 };
 
 //---------------------------------------------------------------------------
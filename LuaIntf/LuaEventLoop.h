@@ -0,0 +1,293 @@
+//
+// https://github.com/SteveKChiu/lua-intf
+//
+// Copyright 2014, Steve K. Chiu <steve.k.chiu@gmail.com>
+//
+// The MIT License (http://www.opensource.org/licenses/mit-license.php)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+//
+
+#ifndef LUAEVENTLOOP_H
+#define LUAEVENTLOOP_H
+
+//---------------------------------------------------------------------------
+
+#include "LuaIntf.h"
+
+#ifndef __linux__
+    #error "LuaEventLoop requires Linux (epoll, timerfd and signalfd)"
+#endif
+
+#include <algorithm>
+#include <cerrno>
+#include <csignal>
+#include <cstdint>
+#include <cstring>
+#include <ctime>
+#include <unordered_map>
+#include <vector>
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include <sys/timerfd.h>
+
+namespace LuaIntf
+{
+
+//---------------------------------------------------------------------------
+
+/**
+ * Event loop for Lua coroutines, based on Linux epoll, timerfd and signalfd.
+ *
+ * The loop runs coroutines spawned by loop.spawn (or LuaEventLoop::spawn), the I/O functions
+ * yield the calling coroutine until the file descriptor is ready, and the loop resumes it
+ * with the result. All the coroutines that become ready in one iteration are resumed in a batch.
+ *
+ * LuaContext lua;
+ * LuaEventLoop loop(lua);
+ * loop.bind("loop");
+ * lua.doString("loop.spawn(function() loop.sleep(1.5) print('done') end)");
+ * loop.run();
+ *
+ * The module functions for Lua, the I/O functions must be called in coroutine spawned by the loop:
+ *
+ * loop.spawn(fn, ...)              -- run fn(...) in new coroutine, return the coroutine
+ * loop.sleep(seconds)              -- yield until the time elapsed
+ * loop.read(fd [, max_size])       -- yield until readable, return data, or nil at end of file,
+ *                                  -- or nil, message, errno on error, max_size is capped at 1MB
+ * loop.write(fd, data)             -- yield until writable, return number of bytes written,
+ *                                  -- or nil, message, errno on error
+ * loop.wait(fd, "r"|"w"|"rw" [, timeout])
+ *                                  -- yield until ready, return "r", "w" or "rw", or nil on timeout
+ * loop.signal(signo)               -- yield until the signal is received, return signo
+ * loop.nonblock(fd)                -- set fd to non-blocking mode, required by read and write
+ * loop.now()                       -- monotonic time in seconds
+ * loop.stop()                      -- stop the loop after current iteration
+ *
+ * Plain coroutine.yield() in the spawned coroutine is resumed in the next iteration.
+ * The read data is received in a buffer owned by the loop and reused for every read,
+ * so the only copy is into the returned Lua string. For loop.signal, the signal is blocked
+ * on the calling thread, it should be blocked in other threads as well.
+ *
+ * The loop must be used by the thread running the Lua state, and destroyed before the state
+ * is closed.
+ */
+class LuaEventLoop
+{
+public:
+    using ErrorHandler = std::function<void(const std::string& message)>;
+
+    /**
+     * Create event loop for the Lua state.
+     * This will throw LuaException if the epoll or timerfd can not be created.
+     */
+    explicit LuaEventLoop(lua_State* L);
+    ~LuaEventLoop();
+
+    LuaEventLoop(const LuaEventLoop&) = delete;
+    LuaEventLoop& operator = (const LuaEventLoop&) = delete;
+
+    /**
+     * Export the module functions to Lua, the name can be in "a.b.c" form
+     */
+    void bind(const char* name = "loop");
+
+    /**
+     * Spawn coroutine to run the function with arguments
+     */
+    template <typename... P>
+    void spawn(const LuaRef& fn, P&&... args)
+    {
+        lua_State* thread = lua_newthread(L);
+        fn.pushToStack();
+        int n = pushArg(L, std::forward<P>(args)...);
+        lua_xmove(L, thread, n + 1);
+        addTask(L, thread, n);
+    }
+
+    /**
+     * Set the handler for the error raised by coroutine. If not set, the error is thrown
+     * as LuaException from run() or runOnce().
+     */
+    void setErrorHandler(const ErrorHandler& handler)
+    {
+        m_error_handler = handler;
+    }
+
+    /**
+     * Run the loop until there is no coroutine or stop() is called
+     */
+    void run();
+
+    /**
+     * Run one iteration of loop
+     *
+     * @param block true to wait for the I/O, timer or signal if no coroutine is ready
+     * @return false if there is no coroutine left
+     */
+    bool runOnce(bool block = true);
+
+    /**
+     * Stop the loop after current iteration
+     */
+    void stop()
+    {
+        m_stop = true;
+    }
+
+    /**
+     * Get the number of coroutines (running or waiting) in the loop
+     */
+    size_t size() const
+    {
+        return m_threads.size();
+    }
+
+    /**
+     * Get monotonic time in seconds
+     */
+    static double now();
+
+private:
+    enum class WaitKind
+    {
+        NONE,
+        SLEEP,
+        READ,
+        WRITE,
+        POLL,
+        SIGNAL
+    };
+
+    struct Task
+    {
+        lua_State* thread;
+        int ref;
+        int nargs;
+        uint32_t generation;
+        WaitKind wait;
+        int fd;
+        int signo;
+        int events;
+        size_t size;
+        int data_ref;
+    };
+
+    struct Timer
+    {
+        int64_t deadline;
+        size_t task;
+        uint32_t generation;
+
+        bool operator < (const Timer& that) const
+        {
+            return deadline > that.deadline;
+        }
+    };
+
+    struct FdEntry
+    {
+        size_t reader;
+        size_t writer;
+        uint32_t events;
+    };
+
+    static const size_t NO_TASK = size_t(-1);
+    static const size_t MAX_READ_SIZE = 1 << 20;
+
+    template <typename P0, typename... P>
+    static int pushArg(lua_State* L, P0&& p0, P&&... p)
+    {
+        Lua::push(L, std::forward<P0>(p0));
+        return 1 + pushArg(L, std::forward<P>(p)...);
+    }
+
+    static int pushArg(lua_State*)
+    {
+        return 0;
+    }
+
+    static int64_t clock();
+    static LuaEventLoop* get(lua_State* L);
+    static size_t current(lua_State* L, LuaEventLoop* loop);
+
+    static int spawnFunc(lua_State* L);
+    static int sleepFunc(lua_State* L);
+    static int readFunc(lua_State* L);
+    static int writeFunc(lua_State* L);
+    static int waitFunc(lua_State* L);
+    static int signalFunc(lua_State* L);
+    static int nonblockFunc(lua_State* L);
+    static int nowFunc(lua_State* L);
+    static int stopFunc(lua_State* L);
+
+    static int pushError(lua_State* L, int err);
+    static int wait(lua_State* L, LuaEventLoop* loop, size_t id, int fd, int events);
+
+    void addTask(lua_State* from, lua_State* thread, int nargs);
+    void removeTask(size_t id);
+    void ready(size_t id, int nargs);
+    void addTimer(size_t id, int64_t deadline);
+    bool watch(size_t id, int fd, int events);
+    void unwatch(size_t id);
+    bool updateFd(int fd, FdEntry& entry);
+    void armTimer();
+    void fireTimers();
+    void fireSignals();
+    void fireFd(int fd, uint32_t events);
+    void complete(size_t id, bool readable, bool writable);
+    int doRead(lua_State* target, int fd, size_t size);
+    int doWrite(lua_State* target, int fd, const char* data, size_t len);
+    void resumeReady();
+
+private:
+    lua_State* L;
+    int m_epoll;
+    int m_timer;
+    int m_signal;
+    sigset_t m_sigset;
+    bool m_stop;
+    int64_t m_armed;
+    std::vector<Task> m_tasks;
+    std::vector<size_t> m_free;
+    std::vector<size_t> m_ready;
+    std::vector<size_t> m_resuming;
+    std::vector<Timer> m_timers;
+    std::unordered_map<lua_State*, size_t> m_threads;
+    std::unordered_map<int, FdEntry> m_fds;
+    std::unordered_map<int, std::vector<size_t>> m_signals;
+    std::vector<char> m_buffer;
+    ErrorHandler m_error_handler;
+};
+
+//---------------------------------------------------------------------------
+
+#if LUAINTF_HEADERS_ONLY
+#include "src/LuaEventLoop.cpp"
+#endif
+
+//---------------------------------------------------------------------------
+
+}
+
+#endif
@@ -30,6 +30,12 @@
 //---------------------------------------------------------------------------
 
 #include "LuaContext.h"
+#include <iterator>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
 
 namespace LuaIntf
 {
@@ -39,6 +45,8 @@ namespace LuaIntf
 #include "impl/CppArg.h"
 #include "impl/CppInvoke.h"
 #include "impl/CppObject.h"
+#include "impl/CppIntrusivePtr.h"
+#include "impl/CppThreadPool.h"
 #include "impl/CppBindModule.h"
 #include "impl/CppBindClass.h"
 #include "impl/CppFunction.h"
@@ -48,6 +56,7 @@ namespace LuaIntf
 #include "src/CppBindClass.cpp"
 #include "src/CppObject.cpp"
 #include "src/CppFunction.cpp"
+#include "src/CppThreadPool.cpp"
 #endif
 
 //---------------------------------------------------------------------------
@@ -0,0 +1,136 @@
+//
+// https://github.com/SteveKChiu/lua-intf
+//
+// Copyright 2014, Steve K. Chiu <steve.k.chiu@gmail.com>
+//
+// The MIT License (http://www.opensource.org/licenses/mit-license.php)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+//
+
+#ifndef LUAJSON_H
+#define LUAJSON_H
+
+//---------------------------------------------------------------------------
+
+#include "LuaIntf.h"
+#include <clocale>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+    #define LUAINTF_JSON_SSE2 1
+    #include <emmintrin.h>
+    #ifdef _MSC_VER
+        #include <intrin.h>
+    #endif
+#else
+    #define LUAINTF_JSON_SSE2 0
+#endif
+
+namespace LuaIntf
+{
+
+//---------------------------------------------------------------------------
+
+/**
+ * JSON decoder and encoder that work on Lua values directly, without intermediate document.
+ *
+ * LuaJson::bind(L, "json");
+ * lua.doString("local t = json.decode('{\"a\": [1, 2, null]}') print(json.encode(t))");
+ *
+ * The module functions for Lua:
+ *
+ * json.decode(text)                -- return the decoded value, raise error if text is invalid
+ * json.encode(value)               -- return the JSON text, raise error if value can not be encoded
+ * json.null                        -- the value of JSON null (light userdata NULL)
+ *
+ * The decoder parses the text straight into Lua values. The elements of array or object are
+ * collected on the Lua stack, and moved into the table created with exact size when the array
+ * or object is closed. Strings are scanned 16 bytes at a time with SSE2 (if available), and
+ * object keys repeated in the text (such as array of records) are pushed from a key cache.
+ *
+ * The encoder writes Lua values into one output buffer. The table with keys 1..n is encoded
+ * as array, other table is encoded as object with string (or number) keys, and empty table
+ * is encoded as empty object. Integer numbers are written without decimal point.
+ */
+class LuaJson
+{
+public:
+    /**
+     * Export the module functions to Lua, the name can be in "a.b.c" form
+     */
+    static void bind(lua_State* L, const char* name = "json");
+
+    /**
+     * Decode the JSON text and push the value onto the stack.
+     * This will throw LuaException if the text is invalid.
+     */
+    static void decode(lua_State* L, const char* data, size_t len);
+
+    /**
+     * Decode the JSON text and return the value.
+     * This will throw LuaException if the text is invalid.
+     */
+    static LuaRef decode(lua_State* L, const std::string& text)
+    {
+        decode(L, text.data(), text.size());
+        return LuaRef::popFromStack(L);
+    }
+
+    /**
+     * Encode the value on the stack, and append the JSON text to output.
+     * This will throw LuaException if the value can not be encoded.
+     */
+    static void encode(lua_State* L, int index, std::string& out);
+
+    /**
+     * Encode the value and return the JSON text.
+     * This will throw LuaException if the value can not be encoded.
+     */
+    static std::string encode(const LuaRef& value);
+
+private:
+    class Decoder;
+    class Encoder;
+
+    static const int MAX_DEPTH = 512;
+    static const int CHUNK_SIZE = 512;
+
+    static const char* scanString(const char* p, const char* end);
+
+    static int decodeFunc(lua_State* L);
+    static int encodeFunc(lua_State* L);
+};
+
+//---------------------------------------------------------------------------
+
+#if LUAINTF_HEADERS_ONLY
+#include "src/LuaJson.cpp"
+#endif
+
+//---------------------------------------------------------------------------
+
+}
+
+#endif
@@ -91,7 +91,7 @@ public:
      */
     ~LuaTableRef()
     {
-        luaL_unref(L, LUA_REGISTRYINDEX, m_key);
+        LuaReleaseQueue::unref(L, m_key);
     }
 
     /**
@@ -267,6 +267,8 @@ private:
  */
 class LuaRef
 {
+    friend class LuaDispatcher;
+
 public:
     /**
      * Create new userdata with requested size.
@@ -438,6 +440,7 @@ public:
         assert(L);
         lua_pushvalue(L, index);
         m_ref = luaL_ref(L, LUA_REGISTRYINDEX);
+        LuaMetrics::addRef(L, m_ref, 1);
     }
 
     /**
@@ -452,6 +455,7 @@ public:
         assert(L);
         Lua::pushGlobal(L, name);
         m_ref = luaL_ref(L, LUA_REGISTRYINDEX);
+        LuaMetrics::addRef(L, m_ref, 1);
     }
 
     /**
@@ -482,7 +486,8 @@ public:
     ~LuaRef()
     {
         if (L) {
-            luaL_unref(L, LUA_REGISTRYINDEX, m_ref);
+            LuaMetrics::addRef(L, m_ref, -1);
+            LuaReleaseQueue::unref(L, m_ref);
         }
     }
 
@@ -507,7 +512,8 @@ public:
     LuaRef& operator = (std::nullptr_t)
     {
         if (L) {
-            luaL_unref(L, LUA_REGISTRYINDEX, m_ref);
+            LuaMetrics::addRef(L, m_ref, -1);
+            LuaReleaseQueue::unref(L, m_ref);
             m_ref = LUA_REFNIL;
         }
         return *this;
@@ -811,6 +817,56 @@ public:
         return Call<R, P...>::invoke(L, get(func), std::forward<P>(args)...);
     }
 
+    /**
+     * Call this function with the number of arguments and results known only at runtime,
+     * for example to forward RPC call without packing the arguments into table.
+     * This may raise Lua error or throw LuaException if result or arguments are not convertible.
+     *
+     * The push function is called as push(L, i) for i in [0, nargs), and must push exactly
+     * one value onto the stack. The sink function is called as sink(L, index) for each result
+     * in order, with the stack index of the result:
+     *
+     * ref.callWith(args.size(),
+     *     [&] (lua_State* L, int i) { Lua::push(L, args[i]); },
+     *     [&] (lua_State* L, int index) { results.push_back(Lua::get<Value>(L, index)); });
+     *
+     * @param nargs the number of arguments
+     * @param push the function to push argument
+     * @param sink the function to receive result
+     * @param nresults the number of results, or LUA_MULTRET for all results
+     * @return the number of results
+     */
+    template <typename PUSH, typename SINK>
+    int callWith(int nargs, PUSH&& push, SINK&& sink, int nresults = LUA_MULTRET) const
+    {
+        assert(L);
+        lua_pushcfunction(L, &LuaException::traceback);
+        pushToStack();
+        return invokeWith(L, 0, nargs, push, sink, nresults);
+    }
+
+    /**
+     * Call the member function with the number of arguments and results known only at runtime,
+     * the same as callWith, but the object itself is passed as first argument, much like calling
+     * function using ':' syntax in Lua. The nargs does not include the object.
+     *
+     * @param func the name of member function
+     * @param nargs the number of arguments
+     * @param push the function to push argument
+     * @param sink the function to receive result
+     * @param nresults the number of results, or LUA_MULTRET for all results
+     * @return the number of results
+     */
+    template <typename PUSH, typename SINK>
+    int dispatchWith(const char* func, int nargs, PUSH&& push, SINK&& sink, int nresults = LUA_MULTRET) const
+    {
+        assert(L);
+        lua_pushcfunction(L, &LuaException::traceback);
+        get(func).pushToStack();
+        pushToStack();
+        return invokeWith(L, 1, nargs, push, sink, nresults);
+    }
+
     /**
      * Get this table's metatable.
      *
@@ -1189,6 +1245,7 @@ private:
     {
         assert(L);
         m_ref = luaL_ref(state, LUA_REGISTRYINDEX);
+        LuaMetrics::addRef(L, m_ref, 1);
     }
 
     template <typename T>
@@ -1230,10 +1287,19 @@ private:
         {
             lua_pushcfunction(L, &LuaException::traceback);
             f.pushToStack();
+            return invokeOnStack(L, std::forward<P>(args)...);
+        }
+
+        static R invokeOnStack(lua_State* L, P&&... args)
+        {
+            LuaReleaseQueue::poll(L);
+            LuaMetrics::addCall(L, LuaMetrics::CPP_TO_LUA);
             pushArg(L, std::forward<P>(args)...);
-            if (lua_pcall(L, sizeof...(P), 1, -int(sizeof...(P) + 2)) != LUA_OK) {
+            LuaCallRecorderScope record(L, int(sizeof...(P)));
+            int err = lua_pcall(L, sizeof...(P), 1, -int(sizeof...(P) + 2));
+            if (err != LUA_OK) {
                 lua_remove(L, -2);
-                throw LuaException(L);
+                LuaException::raise(L, err);
             }
             R v = Lua::get<R>(L, -1);
             lua_pop(L, 2);
@@ -1248,10 +1314,19 @@ private:
         {
             lua_pushcfunction(L, &LuaException::traceback);
             f.pushToStack();
+            invokeOnStack(L, std::forward<P>(args)...);
+        }
+
+        static void invokeOnStack(lua_State* L, P&&... args)
+        {
+            LuaReleaseQueue::poll(L);
+            LuaMetrics::addCall(L, LuaMetrics::CPP_TO_LUA);
             pushArg(L, std::forward<P>(args)...);
-            if (lua_pcall(L, sizeof...(P), 0, -int(sizeof...(P) + 2)) != LUA_OK) {
+            LuaCallRecorderScope record(L, int(sizeof...(P)));
+            int err = lua_pcall(L, sizeof...(P), 0, -int(sizeof...(P) + 2));
+            if (err != LUA_OK) {
                 lua_remove(L, -2);
-                throw LuaException(L);
+                LuaException::raise(L, err);
             }
             lua_pop(L, 1);
         }
@@ -1264,10 +1339,19 @@ private:
         {
             lua_pushcfunction(L, &LuaException::traceback);
             f.pushToStack();
+            return invokeOnStack(L, std::forward<P>(args)...);
+        }
+
+        static std::tuple<R...> invokeOnStack(lua_State* L, P&&... args)
+        {
+            LuaReleaseQueue::poll(L);
+            LuaMetrics::addCall(L, LuaMetrics::CPP_TO_LUA);
             pushArg(L, std::forward<P>(args)...);
-            if (lua_pcall(L, sizeof...(P), sizeof...(R), -int(sizeof...(P) + 2)) != LUA_OK) {
+            LuaCallRecorderScope record(L, int(sizeof...(P)));
+            int err = lua_pcall(L, sizeof...(P), sizeof...(R), -int(sizeof...(P) + 2));
+            if (err != LUA_OK) {
                 lua_remove(L, -2);
-                throw LuaException(L);
+                LuaException::raise(L, err);
             }
             std::tuple<R...> ret;
             TupleResult<sizeof...(R), R...>::fill(L, ret);
@@ -1276,6 +1360,35 @@ private:
         }
     };
 
+    template <typename PUSH, typename SINK>
+    static int invokeWith(lua_State* L, int nself, int nargs, PUSH& push, SINK& sink, int nresults)
+    {
+        // stack: traceback func [self]
+        int base = lua_gettop(L) - nself - 1;
+        LuaReleaseQueue::poll(L);
+        LuaMetrics::addCall(L, LuaMetrics::CPP_TO_LUA);
+        if (!lua_checkstack(L, nargs + LUA_MINSTACK)) {
+            lua_settop(L, base - 1);
+            throw LuaException("stack overflow: too many arguments");
+        }
+        for (int i = 0; i < nargs; i++) {
+            push(L, i);
+            assert(lua_gettop(L) == base + nself + i + 2);
+        }
+        LuaCallRecorderScope record(L, nself + nargs);
+        int err = lua_pcall(L, nself + nargs, nresults, base);
+        if (err != LUA_OK) {
+            lua_remove(L, -2);
+            LuaException::raise(L, err);
+        }
+        int n = lua_gettop(L) - base;
+        for (int i = 1; i <= n; i++) {
+            sink(L, base + i);
+        }
+        lua_settop(L, base - 1);
+        return n;
+    }
+
     template <size_t N, typename... P>
     struct TupleResult
     {
@@ -1315,6 +1428,117 @@ private:
 
 //---------------------------------------------------------------------------
 
+/**
+ * Prepared dispatch handle for calling the same member function on many Lua objects.
+ *
+ * LuaRef::dispatch looks up the member function by name on every call, which walks
+ * the __index chain of the object each time. LuaDispatcher caches the resolved function
+ * per metatable, so repeated dispatch to objects of the same class only costs a few
+ * raw lookups:
+ *
+ * LuaDispatcher update(L, "update");
+ * for (auto& entity : entities) {
+ *     update.dispatch(entity, dt);
+ * }
+ *
+ * The cached function is validated on each call against the table that provides it,
+ * so replacing or removing the function in the class table is picked up automatically.
+ * The cache only covers __index chains made of tables, objects with __index function are
+ * looked up as usual. Field of the object itself (if it is table) still takes precedence.
+ * If the class hierarchy is changed in other way (such as changing __index or adding
+ * override to base class in the middle), call invalidate() to clear the cache.
+ */
+class LuaDispatcher
+{
+public:
+    /**
+     * Create dispatch handle for the named member function.
+     *
+     * @param L Lua state
+     * @param name the name of member function
+     */
+    LuaDispatcher(lua_State* L, const char* name);
+
+    /**
+     * Get the underlying Lua state.
+     */
+    lua_State* state() const
+    {
+        return m_name.state();
+    }
+
+    /**
+     * Clear all the cached functions.
+     */
+    void invalidate();
+
+    /**
+     * Call the member function of the object and get return value(s), the same as
+     * LuaRef::dispatch, much like calling function using ':' syntax in Lua.
+     * This may raise Lua error or throw LuaException if result or arguments are not convertible.
+     *
+     * @param obj the object (table or userdata) to dispatch
+     * @param args arguments to pass to function
+     * @return values of function
+     */
+    template <typename R = void, typename... P>
+    R dispatch(const LuaRef& obj, P&&... args) const
+    {
+        lua_State* L = state();
+        lua_pushcfunction(L, &LuaException::traceback);
+        pushMethod(obj);
+        return LuaRef::Call<R, const LuaRef&, P...>::invokeOnStack(L, obj, std::forward<P>(args)...);
+    }
+
+    /**
+     * Call the member function of the object and get return value(s), the same as
+     * LuaRef::dispatchStatic, much like calling function using '.' syntax in Lua.
+     * This may raise Lua error or throw LuaException if result or arguments are not convertible.
+     *
+     * @param obj the object (table or userdata) to dispatch
+     * @param args arguments to pass to function
+     * @return values of function
+     */
+    template <typename R = void, typename... P>
+    R dispatchStatic(const LuaRef& obj, P&&... args) const
+    {
+        lua_State* L = state();
+        lua_pushcfunction(L, &LuaException::traceback);
+        pushMethod(obj);
+        return LuaRef::Call<R, P...>::invokeOnStack(L, std::forward<P>(args)...);
+    }
+
+    /**
+     * Call the member function of the object with the number of arguments and results known
+     * only at runtime, the same as LuaRef::dispatchWith.
+     *
+     * @param obj the object (table or userdata) to dispatch
+     * @param nargs the number of arguments, not including the object
+     * @param push the function to push argument, called as push(L, i)
+     * @param sink the function to receive result, called as sink(L, index)
+     * @param nresults the number of results, or LUA_MULTRET for all results
+     * @return the number of results
+     */
+    template <typename PUSH, typename SINK>
+    int dispatchWith(const LuaRef& obj, int nargs, PUSH&& push, SINK&& sink, int nresults = LUA_MULTRET) const
+    {
+        lua_State* L = state();
+        lua_pushcfunction(L, &LuaException::traceback);
+        pushMethod(obj);
+        obj.pushToStack();
+        return LuaRef::invokeWith(L, 1, nargs, push, sink, nresults);
+    }
+
+private:
+    void pushMethod(const LuaRef& obj) const;
+
+private:
+    LuaRef m_name;
+    LuaRef m_cache;
+};
+
+//---------------------------------------------------------------------------
+
 template <>
 struct LuaTypeMapping <LuaRef>
 {
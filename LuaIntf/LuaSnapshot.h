@@ -0,0 +1,290 @@
+//
+// https://github.com/SteveKChiu/lua-intf
+//
+// Copyright 2014, Steve K. Chiu <steve.k.chiu@gmail.com>
+//
+// The MIT License (http://www.opensource.org/licenses/mit-license.php)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+//
+
+#ifndef LUASNAPSHOT_H
+#define LUASNAPSHOT_H
+
+//---------------------------------------------------------------------------
+
+#include "LuaIntf.h"
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#ifdef _WIN32
+    #include <fstream>
+    #include <iterator>
+#else
+    #include <fcntl.h>
+    #include <unistd.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+#endif
+
+namespace LuaIntf
+{
+
+//---------------------------------------------------------------------------
+
+/**
+ * Serialized graph of Lua heap, to clone fully initialized state.
+ *
+ * The snapshot contains everything reachable from the registry (except the integer references held
+ * by C++), the globals and the string metatable: tables with metatables, strings, Lua closures
+ * (as bytecode) and C closures with their upvalues, and userdata without metatable (as bytes).
+ * Shared objects, cycles and shared upvalues (Lua 5.2 or later) are preserved. So a template state
+ * can be initialized once, and new states are restored from it without running the init scripts:
+ *
+ * LuaContext tmpl;
+ * LuaBinding(tmpl)...;
+ * tmpl.doFile("init.lua");
+ * LuaSnapshot snapshot = LuaSnapshot::capture(tmpl);
+ *
+ * LuaContext worker;
+ * snapshot.restore(worker);
+ *
+ * C functions and light userdata are kept as pointers, so the snapshot is only valid in the same
+ * process. Userdata with metatable (such as io files or the C++ objects held by the bindings) and
+ * the main thread are not copied, they are looked up in the restored state by the same path from
+ * the registry or globals (through table fields and function upvalues), so the state must be
+ * created the same way as the template was, before the scripts are run. Coroutines can not be cloned.
+ *
+ * The restored state should be fresh, the objects in the snapshot overwrite the existing ones,
+ * and the other existing globals and registry fields are kept.
+ *
+ * To keep the state across process restart, save it to file and load it into a fresh state
+ * with the same bindings:
+ *
+ * LuaSnapshot::Hooks hooks;
+ * hooks.add<Point>("Point",
+ *     [](const Point& p) { return encode(p); },
+ *     [](const std::string& data) { return decode(data); });
+ *
+ * LuaSnapshot::save(lua, "state.snap", hooks);
+ * ...
+ * LuaSnapshot::load(lua, "state.snap", hooks);
+ *
+ * The saved file does not contain any pointer: C functions are looked up by path like userdata
+ * with metatable, and the tables found at the same path in the fresh state (such as the library
+ * and binding tables) are updated instead of replaced. The bound C++ objects are saved by the
+ * hooks of their class, and restored as new objects held by value. The fields with light userdata
+ * (except the handles of hooked class) are not saved. The file is written as one stream without
+ * holding the data in memory, and mapped into memory for loading.
+ */
+class LuaSnapshot
+{
+private:
+    class Writer;
+    class Reader;
+
+public:
+    /**
+     * Hooks to save and restore the bound C++ objects by class
+     */
+    class Hooks
+    {
+    public:
+        /**
+         * Add hooks for the bound class, the name identifies the class in the saved file,
+         * the load function returns the object to be pushed as value.
+         */
+        template <typename T>
+        Hooks& add(const std::string& name,
+            const std::function<std::string(const T&)>& save,
+            const std::function<T(const std::string&)>& load)
+        {
+            Hook hook;
+            hook.name = name;
+            hook.class_id = CppObject::getClassID<T>(false);
+            hook.const_id = CppObject::getClassID<T>(true);
+            hook.save = [save] (lua_State* L, int index) {
+                return save(*CppObject::get<T>(L, index, true));
+            };
+            hook.load = [load] (lua_State* L, const std::string& data) {
+                Lua::push(L, load(data));
+            };
+            m_hooks.push_back(std::move(hook));
+            return *this;
+        }
+
+    private:
+        friend class Writer;
+        friend class Reader;
+
+        struct Hook
+        {
+            std::string name;
+            void* class_id;
+            void* const_id;
+            std::function<std::string(lua_State*, int)> save;
+            std::function<void(lua_State*, const std::string&)> load;
+        };
+
+        std::vector<Hook> m_hooks;
+    };
+
+public:
+    /**
+     * Create empty snapshot
+     */
+    LuaSnapshot() = default;
+
+    /**
+     * Create snapshot from the data returned by data()
+     */
+    explicit LuaSnapshot(std::string data)
+        : m_data(std::move(data))
+        {}
+
+    /**
+     * Capture the heap of the state.
+     * This will throw LuaException if the heap contains object that can not be cloned.
+     *
+     * Each Lua function carries the source name of its chunk, and for the chunk loaded from
+     * string the name is the whole code; load the code with short chunk name, or set strip
+     * to true to drop the debug information (Lua 5.3 or later).
+     *
+     * @param L the state to capture
+     * @param strip true to strip debug information of Lua functions
+     */
+    static LuaSnapshot capture(lua_State* L, bool strip = false);
+
+    /**
+     * Restore the heap into the state.
+     * This will throw LuaException if the snapshot is invalid or the path of object can not be resolved.
+     */
+    void restore(lua_State* L) const;
+
+    /**
+     * Save the heap of the state to file, to be loaded by another process.
+     * This will throw LuaException if the heap contains object that can not be saved,
+     * or the file can not be written. The file is replaced only if it is written completely.
+     *
+     * @param L the state to save
+     * @param path the file path
+     * @param hooks the hooks of bound classes
+     * @param strip true to strip debug information of Lua functions
+     */
+    static void save(lua_State* L, const std::string& path,
+        const Hooks& hooks = Hooks(), bool strip = false);
+
+    /**
+     * Load the heap saved by save() into the state, the file is mapped into memory.
+     * This will throw LuaException if the file is invalid, or the path of object can not be resolved.
+     *
+     * @param L the state to load into
+     * @param path the file path
+     * @param hooks the hooks of bound classes
+     */
+    static void load(lua_State* L, const std::string& path, const Hooks& hooks = Hooks());
+
+    /**
+     * Get the serialized data
+     */
+    const std::string& data() const
+    {
+        return m_data;
+    }
+
+    /**
+     * Get the size of serialized data in bytes
+     */
+    size_t size() const
+    {
+        return m_data.size();
+    }
+
+private:
+    static void read(lua_State* L, const char* data, size_t size, const Hooks* hooks);
+
+    static const unsigned VERSION = 2;
+
+    enum Flag
+    {
+        FLAG_PORTABLE = 1
+    };
+
+    enum Root
+    {
+        ROOT_REGISTRY = 1,
+        ROOT_GLOBALS = 2,
+        ROOT_STRING_META = 3
+    };
+
+    enum ObjectTag : char
+    {
+        OBJECT_ROOT = 'R',
+        OBJECT_TABLE = 'T',
+        OBJECT_LUA_FUNCTION = 'L',
+        OBJECT_C_FUNCTION = 'C',
+        OBJECT_USERDATA = 'U',
+        OBJECT_ANCHOR = 'A',
+        OBJECT_HOOKED = 'K',
+        OBJECT_MAIN_THREAD = 'H'
+    };
+
+    enum ValueTag : char
+    {
+        VALUE_END,
+        VALUE_NIL,
+        VALUE_FALSE,
+        VALUE_TRUE,
+        VALUE_INTEGER,
+        VALUE_NUMBER,
+        VALUE_STRING,
+        VALUE_STRING_REF,
+        VALUE_LIGHTUSERDATA,
+        VALUE_OBJECT,
+        VALUE_JOIN,
+        VALUE_HOOKED
+    };
+
+    enum StepTag : char
+    {
+        STEP_KEY,
+        STEP_UPVALUE,
+        STEP_METATABLE
+    };
+
+private:
+    std::string m_data;
+};
+
+//---------------------------------------------------------------------------
+
+#if LUAINTF_HEADERS_ONLY
+#include "src/LuaSnapshot.cpp"
+#endif
+
+//---------------------------------------------------------------------------
+
+}
+
+#endif
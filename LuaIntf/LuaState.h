@@ -31,20 +31,52 @@
 
 #include "LuaCompat.h"
 #include <cassert>
+#include <cstdlib>
 #include <cstring>
 #include <string>
+#include <vector>
+#include <algorithm>
+#include <atomic>
 #include <exception>
+#include <memory>
 
 #if LUAINTF_STD_WIDE_STRING
 #include <locale>
 #include <codecvt>
 #endif
 
+#if LUAINTF_ARG_ARENA
+#include <cstddef>
+#include <memory_resource>
+#endif
+
+#if LUAINTF_CALL_RECORDER
+#include <cstdio>
+#include <cstdint>
+#include <chrono>
+#include <functional>
+#endif
+
+#if LUAINTF_DEFERRED_UNREF
+#include <thread>
+#endif
+
+#if LUAINTF_METRICS
+#include <chrono>
+#include <functional>
+#include <mutex>
+#endif
+
 namespace LuaIntf
 {
 
+#include "impl/LuaMetrics.h"
 #include "impl/LuaException.h"
+#include "impl/LuaMemoryQuota.h"
+#include "impl/CppArgArena.h"
 #include "impl/LuaType.h"
+#include "impl/LuaCallRecorder.h"
+#include "impl/LuaReleaseQueue.h"
 
 class LuaRef;
 
@@ -69,6 +101,15 @@ namespace Lua
         lua_pushlstring(L, v, len);
     }
 
+    /**
+     * Push string value onto Lua stack, the buffer of large string is moved to Lua without copying
+     * (with Lua 5.5 or later)
+     */
+    inline void push(lua_State* L, std::string&& v)
+    {
+        LuaType<std::string>::push(L, std::move(v));
+    }
+
     /**
      * Push nil onto Lua stack
      */
@@ -129,7 +170,7 @@ namespace Lua
     inline LIST getList(lua_State* L, int index)
     {
         luaL_checktype(L, index, LUA_TTABLE);
-        LIST list;
+        LIST list = CppArgFactory<LIST>::create();
         int n = int(luaL_len(L, index));
         for (int i = 1; i <= n; i++) {
             lua_rawgeti(L, index, i);
@@ -160,7 +201,7 @@ namespace Lua
     {
         index = lua_absindex(L, index);
         luaL_checktype(L, index, LUA_TTABLE);
-        MAP map;
+        MAP map = CppArgFactory<MAP>::create();
         lua_pushnil(L);
         while (lua_next(L, index)) {
             typename MAP::key_type key = get<typename MAP::key_type>(L, -2);
@@ -282,8 +323,16 @@ public:
     static LuaState newState()
         { return luaL_newstate(); }
 
+#if LUA_VERSION_NUM <= 504
     static LuaState newState(lua_Alloc func, void* userdata = nullptr)
         { return lua_newstate(func, userdata); }
+#else
+    static LuaState newState(lua_Alloc func, void* userdata = nullptr)
+        { return lua_newstate(func, userdata, luaL_makeseed(nullptr)); }
+#endif
+
+    static LuaState newState(LuaMemoryQuota& quota)
+        { return newState(&LuaMemoryQuota::allocate, &quota); }
 
     void close()
         { if (L) { lua_close(L); L = nullptr; } }
@@ -304,7 +353,7 @@ public:
     const lua_Number* version() const
         { return lua_version(L); }
 #else
-    const lua_Number version() const
+    lua_Number version() const
         { return lua_version(L); }
 #endif
 
@@ -511,6 +560,9 @@ public:
     void push(const char* s) const
         { lua_pushstring(L, s); }
 
+    const char* pushExternal(const char* s, size_t len, lua_Alloc release, void* ud) const
+        { return lua_pushexternalstring(L, s, len, release, ud); }
+
     const char* pushvf(const char* fmt, va_list argp) const
         { return lua_pushvfstring(L, fmt, argp); }
 
@@ -729,8 +781,8 @@ public:
     int resume(int num_args) const
         { return lua_resume(L, num_args); }
 #elif LUA_VERSION_NUM <= 503
-    int resume(int num_args) const
-        { return lua_resume(L, num_args); }
+    int resume(int num_args, lua_State* from = nullptr) const
+        { return lua_resume(L, from, num_args); }
 #else
     int resume(int num_args, int* num_results, lua_State* from = nullptr) const
         { return lua_resume(L, from, num_args, num_results); }
@@ -740,7 +792,7 @@ public:
         { return lua_status(L); }
 
     int gc(int what = LUA_GCCOLLECT, int data = 0) const
-        { return lua_gc(L, what, data); }
+        { return LuaMemoryQuota::gc(L, what, data); }
 
 // miscellaneous functions
 
@@ -861,7 +913,13 @@ private:
 //---------------------------------------------------------------------------
 
 #if LUAINTF_HEADERS_ONLY
+#include "src/LuaMemoryQuota.cpp"
+#include "src/CppArgArena.cpp"
+#include "src/LuaType.cpp"
 #include "src/LuaState.cpp"
+#include "src/LuaCallRecorder.cpp"
+#include "src/LuaReleaseQueue.cpp"
+#include "src/LuaMetrics.cpp"
 #endif
 
 //---------------------------------------------------------------------------
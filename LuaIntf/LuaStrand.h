@@ -0,0 +1,317 @@
+//
+// https://github.com/SteveKChiu/lua-intf
+//
+// Copyright 2014, Steve K. Chiu <steve.k.chiu@gmail.com>
+//
+// The MIT License (http://www.opensource.org/licenses/mit-license.php)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+//
+
+#ifndef LUASTRAND_H
+#define LUASTRAND_H
+
+//---------------------------------------------------------------------------
+
+#include "LuaState.h"
+#include <atomic>
+#include <thread>
+#include <future>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+
+namespace LuaIntf
+{
+
+//---------------------------------------------------------------------------
+
+/**
+ * Serial executor for Lua state, so it can be used by many threads without locking.
+ *
+ * Work is posted as closure taking lua_State*, the closures run one at a time in posted order,
+ * either on a dedicated thread or on the given executor (such as thread pool), and the result
+ * (or exception) comes back as std::future:
+ *
+ * LuaContext lua;
+ * LuaStrand strand(lua);
+ * std::future<int> n = strand.post([](lua_State* L) {
+ *     return LuaRef(L, "count").call<int>();
+ * });
+ *
+ * Posting is lock-free. Only one runner is active at a time, it drains multiple queued closures
+ * per wakeup; with executor, it yields the thread back after running batch_size closures.
+ * If LUAINTF_DEFERRED_UNREF is enabled, the running thread is set as the owner of state,
+ * so LuaRef can be dropped on any thread.
+ *
+ * Do not wait for the future inside the strand, it will never be ready. The destructor waits
+ * for all the posted closures to complete, the state must outlive the strand.
+ */
+class LuaStrand
+{
+public:
+    /**
+     * The executor to run the given function on some thread
+     */
+    using Executor = std::function<void(std::function<void()>)>;
+
+    /**
+     * Create strand with dedicated thread
+     *
+     * @param state the Lua state, it must not be used outside the strand
+     * @param batch_size the max number of closures to run per wakeup
+     */
+    explicit LuaStrand(lua_State* state, size_t batch_size = 64)
+        : LuaStrand(state, Executor(), batch_size)
+    {
+        m_thread = std::thread(&LuaStrand::loop, this);
+    }
+
+    /**
+     * Create strand running on the given executor
+     *
+     * @param state the Lua state, it must not be used outside the strand
+     * @param executor the executor to run the strand
+     * @param batch_size the max number of closures to run per wakeup
+     */
+    LuaStrand(lua_State* state, const Executor& executor, size_t batch_size = 64)
+        : L(state)
+        , m_executor(executor)
+        , m_batch_size(batch_size ? batch_size : 1)
+        , m_head(nullptr)
+        , m_local(nullptr)
+        , m_scheduled(false)
+        , m_running(0)
+        , m_wake(false)
+        , m_stop(false)
+    {
+#if LUAINTF_DEFERRED_UNREF
+        LuaReleaseQueue::setOwner(L, std::thread::id());
+#endif
+    }
+
+    /**
+     * Wait for all the posted closures to complete
+     */
+    ~LuaStrand()
+    {
+        post([](lua_State*) {}).wait();
+
+        if (m_thread.joinable()) {
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_stop = true;
+            }
+            m_wake_cond.notify_one();
+            m_thread.join();
+        } else {
+            // the last runner may still be leaving
+            while (m_running.load(std::memory_order_acquire)) {
+                std::this_thread::yield();
+            }
+        }
+
+#if LUAINTF_DEFERRED_UNREF
+        LuaReleaseQueue::setOwner(L);
+#endif
+    }
+
+    LuaStrand(const LuaStrand&) = delete;
+    LuaStrand& operator = (const LuaStrand&) = delete;
+
+    /**
+     * Get the underlying Lua state, it must be used inside the strand only
+     */
+    lua_State* state() const
+    {
+        return L;
+    }
+
+    /**
+     * Check whether the calling thread is running inside this strand
+     */
+    bool isRunningInThisThread() const
+    {
+        return current() == this;
+    }
+
+    /**
+     * Post closure to run in the strand
+     *
+     * @param fn closure taking lua_State* as argument
+     * @return future of the closure result
+     */
+    template <typename FN>
+    auto post(FN&& fn) -> std::future<decltype(fn(std::declval<lua_State*>()))>
+    {
+        using R = decltype(fn(std::declval<lua_State*>()));
+        TaskFunction<R>* task = new TaskFunction<R>(std::forward<FN>(fn));
+        std::future<R> result = task->task.get_future();
+        push(task);
+        return result;
+    }
+
+private:
+    struct Task
+    {
+        Task* next;
+
+        Task()
+            : next(nullptr)
+            {}
+
+        virtual ~Task() {}
+        virtual void run(lua_State* L) = 0;
+    };
+
+    template <typename R>
+    struct TaskFunction : Task
+    {
+        std::packaged_task<R(lua_State*)> task;
+
+        template <typename FN>
+        explicit TaskFunction(FN&& fn)
+            : task(std::forward<FN>(fn))
+            {}
+
+        virtual void run(lua_State* L) override
+        {
+            task(L);
+        }
+    };
+
+    static const LuaStrand*& current()
+    {
+        static thread_local const LuaStrand* strand = nullptr;
+        return strand;
+    }
+
+    void push(Task* task)
+    {
+        task->next = m_head.load(std::memory_order_relaxed);
+        while (!m_head.compare_exchange_weak(task->next, task,
+            std::memory_order_release, std::memory_order_relaxed)) {}
+
+        if (!m_scheduled.exchange(true)) {
+            schedule();
+        }
+    }
+
+    void schedule()
+    {
+        if (m_executor) {
+            m_executor([this] { run(); });
+        } else {
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_wake = true;
+            }
+            m_wake_cond.notify_one();
+        }
+    }
+
+    void loop()
+    {
+        for (;;) {
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                m_wake_cond.wait(lock, [this] { return m_wake || m_stop; });
+                if (!m_wake) break;
+                m_wake = false;
+            }
+            run();
+        }
+    }
+
+    void run()
+    {
+        m_running.fetch_add(1, std::memory_order_relaxed);
+        const LuaStrand* outer = current();
+        current() = this;
+
+#if LUAINTF_DEFERRED_UNREF
+        LuaReleaseQueue::setOwner(L);
+        LuaReleaseQueue::poll(L);
+#endif
+
+        bool more = false;
+        for (size_t n = 0; ; ) {
+            if (!m_local) {
+                // take all the posted closures, and reverse them into posted order
+                Task* task = m_head.exchange(nullptr, std::memory_order_acquire);
+                while (task) {
+                    Task* next = task->next;
+                    task->next = m_local;
+                    m_local = task;
+                    task = next;
+                }
+            }
+
+            if (!m_local) {
+                // nothing to run, unless something is posted before the flag is cleared
+                m_scheduled.store(false);
+                if (!m_head.load() || m_scheduled.exchange(true)) break;
+                continue;
+            }
+
+            if (n == m_batch_size) {
+                // yield the thread, and keep the flag so no other runner is scheduled
+                more = true;
+                break;
+            }
+
+            Task* task = m_local;
+            m_local = task->next;
+            task->run(L);
+            delete task;
+            n++;
+        }
+
+#if LUAINTF_DEFERRED_UNREF
+        LuaReleaseQueue::setOwner(L, std::thread::id());
+#endif
+
+        current() = outer;
+        m_running.fetch_sub(1, std::memory_order_release);
+
+        if (more) {
+            schedule();
+        }
+    }
+
+private:
+    lua_State* L;
+    Executor m_executor;
+    size_t m_batch_size;
+    std::atomic<Task*> m_head;
+    Task* m_local;
+    std::atomic<bool> m_scheduled;
+    std::atomic<int> m_running;
+    std::thread m_thread;
+    std::mutex m_mutex;
+    std::condition_variable m_wake_cond;
+    bool m_wake;
+    bool m_stop;
+};
+
+//---------------------------------------------------------------------------
+
+}
+
+#endif
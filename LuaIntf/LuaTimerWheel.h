@@ -0,0 +1,202 @@
+//
+// https://github.com/SteveKChiu/lua-intf
+//
+// Copyright 2014, Steve K. Chiu <steve.k.chiu@gmail.com>
+//
+// The MIT License (http://www.opensource.org/licenses/mit-license.php)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+//
+
+#ifndef LUATIMERWHEEL_H
+#define LUATIMERWHEEL_H
+
+//---------------------------------------------------------------------------
+
+#include "LuaIntf.h"
+
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+namespace LuaIntf
+{
+
+//---------------------------------------------------------------------------
+
+/**
+ * Hierarchical timing wheel for callbacks scheduled by Lua script, 4 levels of 256 slots each.
+ *
+ * Schedule and cancel are O(1), the timers are kept in pooled nodes linked into the slots,
+ * and the handlers are stored in one Lua table owned by the wheel, indexed by node,
+ * so there is no registry reference per timer. The handle is node index with generation
+ * packed into number, cancel with stale handle is ignored. All the callbacks expired
+ * in one tick are dispatched in one protected call.
+ *
+ * LuaContext lua;
+ * LuaTimerWheel timers(lua);           // 1ms resolution
+ * timers.bind("timer");
+ * lua.doString("h = timer.every(0.5, function() print('tick') end)");
+ * ...
+ * timers.tick();                       // call periodically, e.g. from main loop
+ *
+ * The module functions for Lua:
+ *
+ * timer.after(seconds, fn)             -- call fn(handle) once, return handle
+ * timer.every(seconds, fn)             -- call fn(handle) periodically, return handle
+ * timer.cancel(handle)                 -- return true if the timer is cancelled
+ *
+ * The wheel must be destroyed before the Lua state is closed.
+ */
+class LuaTimerWheel
+{
+public:
+    using Handle = uint64_t;
+    using ErrorHandler = std::function<void(const std::string& message)>;
+
+    /**
+     * Create timer wheel for the Lua state
+     *
+     * @param resolution the length of one tick in seconds
+     */
+    explicit LuaTimerWheel(lua_State* L, double resolution = 0.001);
+    ~LuaTimerWheel();
+
+    LuaTimerWheel(const LuaTimerWheel&) = delete;
+    LuaTimerWheel& operator = (const LuaTimerWheel&) = delete;
+
+    /**
+     * Export the module functions to Lua, the name can be in "a.b.c" form
+     */
+    void bind(const char* name = "timer");
+
+    /**
+     * Schedule the function to be called after delay (in seconds), and then every interval
+     * if interval is positive. The delay is rounded up to at least one tick.
+     */
+    Handle schedule(double delay, const LuaRef& fn, double interval = 0);
+
+    /**
+     * Cancel the timer, return false if the timer is already fired or cancelled
+     */
+    bool cancel(Handle handle);
+
+    /**
+     * Advance the wheel to current time and dispatch the expired callbacks
+     */
+    void tick();
+
+    /**
+     * Advance the wheel by number of ticks and dispatch the expired callbacks
+     */
+    void advance(uint64_t ticks);
+
+    /**
+     * Set the handler for the error raised by callback. If not set, the first error is thrown
+     * as LuaException from tick() or advance(), after the rest of the callbacks are dispatched.
+     */
+    void setErrorHandler(const ErrorHandler& handler)
+    {
+        m_error_handler = handler;
+    }
+
+    /**
+     * Get the number of scheduled timers
+     */
+    size_t size() const
+    {
+        return m_count;
+    }
+
+private:
+    static const int SLOT_BITS = 8;
+    static const int LEVELS = 4;
+    static const uint32_t SLOTS = 1 << SLOT_BITS;
+    static const uint32_t SLOT_MASK = SLOTS - 1;
+    static const uint32_t NIL = uint32_t(-1);
+    static const uint32_t PENDING = uint32_t(-2);
+
+    // the handle must be exact in lua_Number, 32 bits index + 21 bits generation
+    static const uint32_t GENERATION_MASK = (1u << 21) - 1;
+
+    struct Node
+    {
+        uint64_t expire;
+        uint64_t interval;
+        uint32_t prev;
+        uint32_t next;
+        uint32_t slot;
+        uint32_t generation;
+    };
+
+    struct Expired
+    {
+        uint32_t node;
+        uint32_t generation;
+    };
+
+    static Handle handleOf(uint32_t index, uint32_t generation)
+    {
+        return (Handle(generation) << 32) | index;
+    }
+
+    static void pushHandle(lua_State* L, Handle handle);
+    static Handle checkHandle(lua_State* L, int index);
+
+    static int afterFunc(lua_State* L);
+    static int everyFunc(lua_State* L);
+    static int cancelFunc(lua_State* L);
+    static int dispatchFunc(lua_State* L);
+
+    uint64_t toTicks(double seconds) const;
+    Handle add(lua_State* L, int fn_index, uint64_t delay, uint64_t interval);
+    void release(uint32_t index);
+    void link(uint32_t index);
+    void unlink(uint32_t index);
+    void step();
+    void dispatch();
+
+private:
+    lua_State* L;
+    int m_handlers;
+    double m_resolution;
+    std::chrono::steady_clock::time_point m_origin;
+    uint64_t m_now;
+    size_t m_count;
+    bool m_dispatching;
+    size_t m_dispatched;
+    uint32_t m_slots[LEVELS * SLOTS];
+    std::vector<Node> m_nodes;
+    std::vector<uint32_t> m_free;
+    std::vector<Expired> m_expired;
+    ErrorHandler m_error_handler;
+};
+
+//---------------------------------------------------------------------------
+
+#if LUAINTF_HEADERS_ONLY
+#include "src/LuaTimerWheel.cpp"
+#endif
+
+//---------------------------------------------------------------------------
+
+}
+
+#endif
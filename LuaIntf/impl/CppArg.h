@@ -70,7 +70,16 @@ struct CppArgHolder
         holder = v;
     }
 
+    void hold(T&& v)
+    {
+        holder = std::move(v);
+    }
+
+#if LUAINTF_ARG_ARENA
+    T holder = CppArgFactory<T>::create();
+#else
     T holder;
+#endif
 };
 
 template <typename T>
@@ -0,0 +1,205 @@
+//
+// https://github.com/SteveKChiu/lua-intf
+//
+// Copyright 2014, Steve K. Chiu <steve.k.chiu@gmail.com>
+//
+// The MIT License (http://www.opensource.org/licenses/mit-license.php)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+//
+
+#if LUAINTF_ARG_ARENA
+
+/**
+ * Per-thread bump arena for decoding arguments of bound C++ function.
+ *
+ * The arena is active only when the binding thunk is decoding arguments (see CppArgArenaScope),
+ * the memory allocated is released all at once when the call returns. The chunks are kept for
+ * next call, so high rate calls do not need malloc or free.
+ *
+ * Lua state is used by one thread at a time, and the bound calls are nested in stack order,
+ * so one arena per thread serves all the states running on the thread.
+ */
+class CppArgArena
+{
+public:
+    /**
+     * The position of arena, used to release memory allocated after it
+     */
+    struct Mark
+    {
+        size_t chunk;
+        size_t offset;
+    };
+
+    CppArgArena();
+    ~CppArgArena();
+
+    CppArgArena(const CppArgArena&) = delete;
+    CppArgArena& operator = (const CppArgArena&) = delete;
+
+    /**
+     * Get the arena of current thread
+     */
+    static CppArgArena& current();
+
+    /**
+     * Get the memory resource for decoding argument, this is the arena of current thread if the
+     * bound call is decoding arguments, otherwise it is std::pmr::get_default_resource().
+     */
+    static std::pmr::memory_resource* resource();
+
+    /**
+     * Allocate memory from arena, the memory is not released until the arena is rewound.
+     */
+    void* allocate(size_t size, size_t align);
+
+    Mark mark() const
+    {
+        return Mark { m_chunk, m_offset };
+    }
+
+    void rewind(const Mark& mark)
+    {
+        m_chunk = mark.chunk;
+        m_offset = mark.offset;
+    }
+
+private:
+    friend class CppArgArenaScope;
+
+    class Resource : public std::pmr::memory_resource
+    {
+    public:
+        explicit Resource(CppArgArena* arena)
+            : m_arena(arena)
+            {}
+
+    protected:
+        virtual void* do_allocate(size_t size, size_t align) override
+        {
+            return m_arena->allocate(size, align);
+        }
+
+        virtual void do_deallocate(void*, size_t, size_t) override
+        {
+            // released when the arena is rewound
+        }
+
+        virtual bool do_is_equal(const std::pmr::memory_resource& that) const noexcept override
+        {
+            return this == &that;
+        }
+
+    private:
+        CppArgArena* m_arena;
+    };
+
+    struct Chunk
+    {
+        unsigned char* data;
+        size_t size;
+    };
+
+    static constexpr size_t CHUNK_SIZE = 16 * 1024;
+
+    std::vector<Chunk> m_chunks;
+    size_t m_chunk;
+    size_t m_offset;
+    bool m_active;
+    Resource m_resource;
+};
+
+/**
+ * Scope of bound call, the arena is active from the start of scope until finishInput is called,
+ * so the function body does not allocate from arena. The arena memory is released on exit.
+ * The scope must be declared before the argument tuple, so the arguments are destroyed first.
+ */
+class CppArgArenaScope
+{
+public:
+    CppArgArenaScope()
+        : m_arena(CppArgArena::current())
+        , m_mark(m_arena.mark())
+        , m_active(m_arena.m_active)
+    {
+        m_arena.m_active = true;
+    }
+
+    ~CppArgArenaScope()
+    {
+        m_arena.m_active = m_active;
+        m_arena.rewind(m_mark);
+    }
+
+    void finishInput()
+    {
+        m_arena.m_active = m_active;
+    }
+
+    CppArgArenaScope(const CppArgArenaScope&) = delete;
+    CppArgArenaScope& operator = (const CppArgArenaScope&) = delete;
+
+private:
+    CppArgArena& m_arena;
+    CppArgArena::Mark m_mark;
+    bool m_active;
+};
+
+#else
+
+class CppArgArenaScope
+{
+public:
+    CppArgArenaScope() {}
+    void finishInput() {}
+};
+
+#endif
+
+//---------------------------------------------------------------------------
+
+/**
+ * Create empty value for decoding argument or container element.
+ *
+ * If LUAINTF_ARG_ARENA is enabled, the type with polymorphic allocator (std::pmr containers and strings)
+ * is created with the arena of bound call, so it can be filled without malloc.
+ */
+template <typename T, typename ENABLED = void>
+struct CppArgFactory
+{
+    static T create()
+    {
+        return T();
+    }
+};
+
+#if LUAINTF_ARG_ARENA
+
+template <typename T>
+struct CppArgFactory <T,
+    typename std::enable_if<std::uses_allocator<T, std::pmr::polymorphic_allocator<std::byte>>::value>::type>
+{
+    static T create()
+    {
+        return T(typename T::allocator_type(CppArgArena::resource()));
+    }
+};
+
+#endif
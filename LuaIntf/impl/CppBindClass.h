@@ -36,11 +36,16 @@ struct CppBindClassConstructor <T, T, _arg(*)(P...)>
     static int call(lua_State* L)
     {
         try {
+            LuaCallRecorderScope record(L);
+            LuaMetrics::addCall(L, LuaMetrics::LUA_TO_CPP);
+            CppArgArenaScope arena;
             CppArgTuple<P...> args;
             CppArgTupleInput<P...>::get(L, 2, args);
+            arena.finishInput();
             CppObjectValue<T>::pushToStack(L, args, false);
             return 1;
         } catch (std::exception& e) {
+            LuaMetrics::addException(L);
             return luaL_error(L, "%s", e.what());
         }
     }
@@ -55,12 +60,17 @@ struct CppBindClassConstructor <SP, T, _arg(*)(P...)>
     static int call(lua_State* L)
     {
         try {
+            LuaCallRecorderScope record(L);
+            LuaMetrics::addCall(L, LuaMetrics::LUA_TO_CPP);
+            CppArgArenaScope arena;
             CppArgTuple<P...> args;
             CppArgTupleInput<P...>::get(L, 2, args);
+            arena.finishInput();
             T* obj = CppInvokeClassConstructor<T>::call(args);
             CppObjectSharedPtr<SP, T>::pushToStack(L, obj, false);
             return 1;
         } catch (std::exception& e) {
+            LuaMetrics::addException(L);
             return luaL_error(L, "%s", e.what());
         }
     }
@@ -77,8 +87,8 @@ struct CppBindClassDestructor
     static int call(lua_State* L)
     {
         try {
-            CppObject* obj = CppObject::getExactObject<T>(L, 1, IS_CONST);
-            obj->~CppObject();
+            CppObject::getExactObject<T>(L, 1, IS_CONST);
+            CppObject::destroy<T>(L, 1);
             return 0;
         } catch (std::exception& e) {
             return luaL_error(L, "%s", e.what());
@@ -140,6 +150,453 @@ struct CppBindClassVariableSetter
 
 //----------------------------------------------------------------------------
 
+struct CppBindRangeKeyExists
+{
+    template <typename C, typename = typename C::key_type>
+    static std::true_type test(int);
+
+    template <typename>
+    static std::false_type test(...);
+};
+
+struct CppBindRangeMappedExists
+{
+    template <typename C, typename = typename C::mapped_type>
+    static std::true_type test(int);
+
+    template <typename>
+    static std::false_type test(...);
+};
+
+struct CppBindRangeUniqueKey
+{
+    // the key is the control variable, so the key must be unique, or the iteration never ends
+    template <typename C>
+    static auto test(int) -> std::is_same<
+        decltype(std::declval<C&>().insert(std::declval<const typename C::value_type&>())),
+        std::pair<typename C::iterator, bool>>;
+
+    template <typename>
+    static std::true_type test(...);
+};
+
+enum CppBindRangeKind
+{
+    RANGE_INDEXED,
+    RANGE_SET,
+    RANGE_MAP
+};
+
+template <typename C>
+struct CppBindRangeKindOf
+{
+    static_assert(!decltype(CppBindRangeKeyExists::test<C>(0))::value
+            || decltype(CppBindRangeUniqueKey::test<C>(0))::value,
+        "the container must have unique keys, multiset or multimap is not supported");
+
+    static constexpr int value =
+        !decltype(CppBindRangeKeyExists::test<C>(0))::value ? RANGE_INDEXED
+        : !decltype(CppBindRangeMappedExists::test<C>(0))::value ? RANGE_SET
+        : RANGE_MAP;
+};
+
+template <typename C, int KIND = CppBindRangeKindOf<C>::value>
+struct CppBindRange;
+
+template <typename C>
+struct CppBindRange <C, RANGE_INDEXED>
+{
+    static_assert(std::is_base_of<std::random_access_iterator_tag,
+            typename std::iterator_traits<typename C::const_iterator>::iterator_category>::value,
+        "the container must support random access or lookup by key");
+
+    /**
+     * Push the initial control variable: the position is the control variable itself.
+     */
+    static void pushStart(lua_State* L)
+    {
+        lua_pushinteger(L, 0);
+    }
+
+    /**
+     * Push the element after the control variable (index 2), return (index, value).
+     */
+    static int next(lua_State* L, const C& c)
+    {
+        lua_Integer i = lua_tointeger(L, 2);
+        if (i < 0 || static_cast<size_t>(i) >= c.size()) return 0;
+        lua_pushinteger(L, i + 1);
+        LuaType<typename C::value_type>::push(L, *(c.begin() + i));
+        return 2;
+    }
+};
+
+template <typename C>
+struct CppBindRange <C, RANGE_SET>
+{
+    /**
+     * Push the initial control variable: the key is the control variable itself.
+     */
+    static void pushStart(lua_State* L)
+    {
+        lua_pushnil(L);
+    }
+
+    /**
+     * Push the key after the control variable (index 2), return (key).
+     */
+    static int next(lua_State* L, const C& c)
+    {
+        auto it = seek(L, c);
+        if (it == c.end()) return 0;
+        LuaType<typename C::key_type>::push(L, *it);
+        return 1;
+    }
+
+    static typename C::const_iterator seek(lua_State* L, const C& c)
+    {
+        if (lua_isnoneornil(L, 2)) return c.begin();
+        auto it = c.find(LuaType<typename C::key_type>::get(L, 2));
+        if (it == c.end()) {
+            luaL_error(L, "container is modified during iteration");
+        }
+        return ++it;
+    }
+};
+
+template <typename C>
+struct CppBindRange <C, RANGE_MAP>
+{
+    /**
+     * Push the initial control variable: the key is the control variable itself.
+     */
+    static void pushStart(lua_State* L)
+    {
+        lua_pushnil(L);
+    }
+
+    /**
+     * Push the entry after the control variable (index 2), return (key, value).
+     */
+    static int next(lua_State* L, const C& c)
+    {
+        auto it = CppBindRange<C, RANGE_SET>::seek(L, c);
+        if (it == c.end()) return 0;
+        LuaType<typename C::key_type>::push(L, it->first);
+        LuaType<typename C::mapped_type>::push(L, it->second);
+        return 2;
+    }
+};
+
+template <typename T, typename C>
+struct CppBindClassRangeAccess
+{
+    static const C& get(const T* obj, C T::* mp)
+    {
+        return obj->*mp;
+    }
+
+    static const C& get(const T* obj, const C T::* mp)
+    {
+        return obj->*mp;
+    }
+
+    static const C& get(const T* obj, const C& (T::*fn)() const)
+    {
+        return (obj->*fn)();
+    }
+};
+
+template <typename T, typename C, typename ACCESS>
+struct CppBindClassRange
+{
+    /**
+     * lua_CFunction to start the generic for-loop: return (iterator, object, initial control)
+     *
+     * The shared iterator function is in the first upvalue.
+     * The class userdata object is at the top of the Lua stack.
+     */
+    static int each(lua_State* L)
+    {
+        try {
+            CppObject::get<T>(L, 1, true);
+            lua_pushvalue(L, lua_upvalueindex(1));
+            lua_pushvalue(L, 1);
+            CppBindRange<C>::pushStart(L);
+            return 3;
+        } catch (std::exception& e) {
+            return luaL_error(L, "%s", e.what());
+        }
+    }
+
+    /**
+     * lua_CFunction as stateless iterator, the position is derived from the control variable.
+     *
+     * The pointer-to-member is in the first upvalue.
+     * The class userdata object and the control variable are at the top of the Lua stack.
+     */
+    static int next(lua_State* L)
+    {
+        try {
+            assert(lua_isuserdata(L, lua_upvalueindex(1)));
+            const ACCESS& access = *static_cast<const ACCESS*>(lua_touserdata(L, lua_upvalueindex(1)));
+
+            const T* obj = CppObject::get<T>(L, 1, true);
+            return CppBindRange<C>::next(L, CppBindClassRangeAccess<T, C>::get(obj, access));
+        } catch (std::exception& e) {
+            return luaL_error(L, "%s", e.what());
+        }
+    }
+};
+
+template <typename T>
+struct CppBindClassRange <T, T, void>
+{
+    /**
+     * lua_CFunction to start the generic for-loop: return (iterator, object, initial control)
+     *
+     * The shared iterator function is in the first upvalue.
+     * The class userdata object is at the top of the Lua stack.
+     */
+    static int each(lua_State* L)
+    {
+        try {
+            CppObject::get<T>(L, 1, true);
+            lua_pushvalue(L, lua_upvalueindex(1));
+            lua_pushvalue(L, 1);
+            CppBindRange<T>::pushStart(L);
+            return 3;
+        } catch (std::exception& e) {
+            return luaL_error(L, "%s", e.what());
+        }
+    }
+
+    /**
+     * lua_CFunction as stateless iterator, the position is derived from the control variable.
+     *
+     * The class userdata object and the control variable are at the top of the Lua stack.
+     */
+    static int next(lua_State* L)
+    {
+        try {
+            const T* obj = CppObject::get<T>(L, 1, true);
+            return CppBindRange<T>::next(L, *obj);
+        } catch (std::exception& e) {
+            return luaL_error(L, "%s", e.what());
+        }
+    }
+};
+
+//----------------------------------------------------------------------------
+
+/**
+ * View of associative container (std::map or std::unordered_map) for Lua, the view is
+ * userdata that refers to the live C++ container, no copy is made:
+ *
+ * view[key]                        -- lookup the key in C++ container, or nil if not found
+ * view[key] = value                -- insert or replace the value, or erase if value is nil
+ * #view                            -- the number of entries
+ * for k, v in pairs(view) do       -- iterate the entries (Lua 5.2 or later)
+ *
+ * The view keeps the owner object alive (as user value), but the container must not be destroyed
+ * while the view is in use. The key and value are converted with LuaType<K> and LuaType<V>.
+ * Like the C++ iterator, the entries must not be erased during pairs loop. Containers with
+ * duplicate keys (such as std::multimap) are not supported.
+ */
+template <typename MAP>
+struct CppMapView
+{
+    static_assert(decltype(CppBindRangeUniqueKey::test<MAP>(0))::value,
+        "the container must have unique keys, multimap is not supported");
+
+    using K = typename MAP::key_type;
+    using V = typename MAP::mapped_type;
+
+    MAP* map;
+    bool readonly;
+
+    /**
+     * Push the view of container onto the stack.
+     *
+     * @param map the container
+     * @param readonly true if the view can not modify the container
+     * @param owner the stack index of owner object to keep alive, or 0 if none
+     */
+    static void push(lua_State* L, MAP* map, bool readonly, int owner = 0)
+    {
+        owner = owner ? lua_absindex(L, owner) : 0;
+        auto view = static_cast<CppMapView<MAP>*>(lua_newuserdata(L, sizeof(CppMapView<MAP>)));
+        view->map = map;
+        view->readonly = readonly;
+        pushMetaTable(L);
+        lua_setmetatable(L, -2);
+
+        if (owner) {
+#if LUA_VERSION_NUM >= 503
+            lua_pushvalue(L, owner);
+#else
+            // user value must be table
+            lua_createtable(L, 1, 0);
+            lua_pushvalue(L, owner);
+            lua_rawseti(L, -2, 1);
+#endif
+            lua_setuservalue(L, -2);
+        }
+    }
+
+private:
+    static void pushMetaTable(lua_State* L)
+    {
+        lua_rawgetp(L, LUA_REGISTRYINDEX, CppSignature<CppMapView<MAP>>::value());
+        if (!lua_isnil(L, -1)) return;
+        lua_pop(L, 1);
+
+        static const luaL_Reg funcs[] = {
+            { "__index", &index },
+            { "__newindex", &newIndex },
+            { "__len", &len },
+            { "__pairs", &pairs },
+            { nullptr, nullptr }
+        };
+        lua_createtable(L, 0, 6);
+        luaL_setfuncs(L, funcs, 0);
+        lua_pushliteral(L, "map_view");
+        lua_setfield(L, -2, "__name");
+        lua_pushboolean(L, 0);
+        lua_setfield(L, -2, "__metatable");
+        lua_pushvalue(L, -1);
+        lua_rawsetp(L, LUA_REGISTRYINDEX, CppSignature<CppMapView<MAP>>::value());
+    }
+
+    static CppMapView<MAP>* check(lua_State* L)
+    {
+        auto view = static_cast<CppMapView<MAP>*>(lua_touserdata(L, 1));
+        if (view && lua_getmetatable(L, 1)) {
+            lua_rawgetp(L, LUA_REGISTRYINDEX, CppSignature<CppMapView<MAP>>::value());
+            bool ok = lua_rawequal(L, -1, -2) != 0;
+            lua_pop(L, 2);
+            if (ok) return view;
+        }
+        luaL_argerror(L, 1, "map view expected");
+        return nullptr;
+    }
+
+    static int index(lua_State* L)
+    {
+        try {
+            CppMapView<MAP>* view = check(L);
+            auto it = view->map->find(LuaType<K>::get(L, 2));
+            if (it == view->map->end()) {
+                lua_pushnil(L);
+            } else {
+                LuaType<V>::push(L, it->second);
+            }
+            return 1;
+        } catch (std::exception& e) {
+            return luaL_error(L, "%s", e.what());
+        }
+    }
+
+    static int newIndex(lua_State* L)
+    {
+        try {
+            CppMapView<MAP>* view = check(L);
+            if (view->readonly) {
+                return luaL_error(L, "map view is read-only");
+            }
+
+            K key = LuaType<K>::get(L, 2);
+            if (lua_isnil(L, 3)) {
+                view->map->erase(key);
+            } else {
+                auto it = view->map->find(key);
+                if (it != view->map->end()) {
+                    it->second = LuaType<V>::get(L, 3);
+                } else {
+                    view->map->emplace(std::move(key), LuaType<V>::get(L, 3));
+                }
+            }
+            return 0;
+        } catch (std::exception& e) {
+            return luaL_error(L, "%s", e.what());
+        }
+    }
+
+    static int len(lua_State* L)
+    {
+        CppMapView<MAP>* view = check(L);
+        lua_pushinteger(L, lua_Integer(view->map->size()));
+        return 1;
+    }
+
+    static int pairs(lua_State* L)
+    {
+        check(L);
+        lua_pushcfunction(L, &next);
+        lua_pushvalue(L, 1);
+        CppBindRange<MAP>::pushStart(L);
+        return 3;
+    }
+
+    static int next(lua_State* L)
+    {
+        try {
+            return CppBindRange<MAP>::next(L, *check(L)->map);
+        } catch (std::exception& e) {
+            return luaL_error(L, "%s", e.what());
+        }
+    }
+};
+
+template <typename T, typename MAP, bool READONLY>
+struct CppBindClassMapView
+{
+    /**
+     * lua_CFunction to get the view of container data member.
+     *
+     * The pointer-to-member is in the first upvalue.
+     * The class userdata object is at the top of the Lua stack.
+     */
+    static int getVariable(lua_State* L)
+    {
+        try {
+            assert(lua_isuserdata(L, lua_upvalueindex(1)));
+            auto mp = static_cast<MAP T::**>(lua_touserdata(L, lua_upvalueindex(1)));
+            assert(mp);
+
+            T* obj = CppObject::get<T>(L, 1, READONLY);
+            CppMapView<MAP>::push(L, &(obj->**mp), READONLY, 1);
+            return 1;
+        } catch (std::exception& e) {
+            return luaL_error(L, "%s", e.what());
+        }
+    }
+
+    /**
+     * lua_CFunction to get the view of container returned by member function.
+     *
+     * The pointer-to-member-function is in the first upvalue.
+     * The class userdata object is at the top of the Lua stack.
+     */
+    template <typename FN>
+    static int getFunction(lua_State* L)
+    {
+        try {
+            assert(lua_isuserdata(L, lua_upvalueindex(1)));
+            auto fn = static_cast<FN*>(lua_touserdata(L, lua_upvalueindex(1)));
+            assert(fn);
+
+            T* obj = CppObject::get<T>(L, 1, READONLY);
+            CppMapView<MAP>::push(L, const_cast<MAP*>(&(obj->**fn)()), READONLY, 1);
+            return 1;
+        } catch (std::exception& e) {
+            return luaL_error(L, "%s", e.what());
+        }
+    }
+};
+
+//----------------------------------------------------------------------------
+
 template <int CHK, typename T, bool IS_PROXY, bool IS_CONST, typename FN, typename R, typename... P>
 struct CppBindClassMethodBase
 {
@@ -170,13 +627,18 @@ struct CppBindClassMethodBase
             const FN& fn = *reinterpret_cast<const FN*>(lua_touserdata(L, lua_upvalueindex(1)));
             assert(fn);
 
+            LuaCallRecorderScope record(L);
+            LuaMetrics::addCall(L, LuaMetrics::LUA_TO_CPP);
+            CppArgArenaScope arena;
             CppArgTuple<P...> args;
             T* obj = CppObject::get<T>(L, 1, IS_CONST);
             CppArgTupleInput<P...>::get(L, 2, args);
+            arena.finishInput();
 
             int n = CppInvokeClassMethod<T, IS_PROXY, FN, R, typename CppArg<P>::HolderType...>::push(L, obj, fn, args);
             return n + CppArgTupleOutput<P...>::push(L, args);
         } catch (std::exception& e) {
+            LuaMetrics::addException(L);
             return luaL_error(L, "%s", e.what());
         }
     }
@@ -350,6 +812,35 @@ struct CppBindClassMetaMethod
      * The name of the function is in the first upvalue.
      */
     static int errorConstMismatch(lua_State* L);
+
+#if LUAINTF_UNIFIED_CONST_METATABLE
+    /**
+     * lua_CFunction to call the member getter that matches the constness of object.
+     *
+     * The getter for non-const object is in the first upvalue, and for const object in the second upvalue.
+     */
+    static int getByConst(lua_State* L);
+#endif
+
+#if LUAINTF_BULK_PROPERTY_ACCESS
+    /**
+     * lua_CFunction to read the properties into new table, obj:toTable([fields]).
+     *
+     * If the array of property names is not given, all the properties of the class and its
+     * super classes are read.
+     */
+    static int toTable(lua_State* L);
+
+    /**
+     * lua_CFunction to write the properties from table, obj:assign(table).
+     */
+    static int assign(lua_State* L);
+
+private:
+    static void checkMetaTable(lua_State* L, const char* op);
+    static bool pushAccessor(lua_State* L, int mt, int key, const char* field);
+    static void pushFields(lua_State* L, int mt);
+#endif
 };
 
 //--------------------------------------------------------------------------
@@ -440,7 +931,12 @@ private:
             CppSignature<T>::value(), CppClassSignature<T>::value(), CppConstSignature<T>::value()))
         {
             meta.rawget("___class").rawset("__gc", &CppBindClassDestructor<T, false>::call);
+#if !LUAINTF_UNIFIED_CONST_METATABLE
             meta.rawget("___const").rawset("__gc", &CppBindClassDestructor<T, true>::call);
+#endif
+            if (CppObjectHandleTraits<T>::isHandle) {
+                CppObjectHandle::registerMetaTable(meta.state());
+            }
         }
         return CppBindClass<T, PARENT>(meta);
     }
@@ -461,7 +957,12 @@ private:
             CppSignature<T>::value(), CppClassSignature<T>::value(), CppConstSignature<T>::value(), CppSignature<SUPER>::value()))
         {
             meta.rawget("___class").rawset("__gc", &CppBindClassDestructor<T, false>::call);
+#if !LUAINTF_UNIFIED_CONST_METATABLE
             meta.rawget("___const").rawset("__gc", &CppBindClassDestructor<T, true>::call);
+#endif
+            if (CppObjectHandleTraits<T>::isHandle) {
+                CppObjectHandle::registerMetaTable(meta.state());
+            }
 
 #if LUAINTF_AUTO_DOWNCAST
             CppAutoDowncast::add<T, SUPER>(meta.state());
@@ -645,6 +1146,20 @@ public:
         return *this;
     }
 
+    /**
+     * Add or replace a static bulk function, see CppBindModule::addBulkFunction
+     */
+    template <typename FN>
+    CppBindClass<T, PARENT>& addStaticBulkFunction(const char* name, const FN& proc)
+    {
+        using CppProc = CppBindMethod<FN, FN, 2>;
+        using CppBulk = CppBindBulkMethod<FN>;
+        m_meta.rawset(name, CppBindBulk::create(state(),
+            LuaRef::createFunction(state(), &CppProc::call, CppProc::function(proc)),
+            LuaRef::createFunction(state(), &CppBulk::map, CppBulk::function(proc))));
+        return *this;
+    }
+
     /**
      * Add or replace a constructor function. Argument spec is needed to match the constructor:
      *
@@ -832,6 +1347,62 @@ public:
         return *this;
     }
 
+    /**
+     * Add or replace a view of associative container data member (std::map or std::unordered_map).
+     * The value return to lua is a view that refers to the container, and allow lookup without copy,
+     * see CppMapView. The view of const object is read-only.
+     */
+    template <typename MAP>
+    CppBindClass<T, PARENT>& addMapView(const char* name, MAP T::* v, bool writable = true)
+    {
+        setMemberGetter(name,
+            LuaRef::createFunction(state(), writable
+                ? &CppBindClassMapView<T, MAP, false>::getVariable
+                : &CppBindClassMapView<T, MAP, true>::getVariable, v),
+            LuaRef::createFunction(state(), &CppBindClassMapView<T, MAP, true>::getVariable, v));
+        setMemberReadOnly(name);
+        return *this;
+    }
+
+    /**
+     * Add or replace a read-only view of const associative container data member.
+     */
+    template <typename MAP>
+    CppBindClass<T, PARENT>& addMapView(const char* name, const MAP T::* v)
+    {
+        setMemberGetter(name, LuaRef::createFunction(state(),
+            &CppBindClassMapView<T, MAP, true>::getVariable, const_cast<MAP T::*>(v)));
+        setMemberReadOnly(name);
+        return *this;
+    }
+
+    /**
+     * Add or replace a view of associative container returned by reference from member function.
+     */
+    template <typename MAP>
+    CppBindClass<T, PARENT>& addMapView(const char* name, MAP& (T::*get)())
+    {
+        using FN = MAP& (T::*)();
+        setMemberGetter(name, LuaRef::createFunction(state(),
+            &CppBindClassMapView<T, MAP, false>::template getFunction<FN>, get));
+        setMemberReadOnly(name);
+        return *this;
+    }
+
+    /**
+     * Add or replace a read-only view of associative container returned by const reference from
+     * const member function.
+     */
+    template <typename MAP>
+    CppBindClass<T, PARENT>& addMapView(const char* name, const MAP& (T::*get)() const)
+    {
+        using FN = const MAP& (T::*)() const;
+        setMemberGetter(name, LuaRef::createFunction(state(),
+            &CppBindClassMapView<T, MAP, true>::template getFunction<FN>, get));
+        setMemberReadOnly(name);
+        return *this;
+    }
+
     /**
      * Add or replace a property member.
      */
@@ -921,6 +1492,52 @@ public:
         return *this;
     }
 
+    /**
+     * Add or replace a member function that returns a generic for-loop iterator for the given container data member:
+     *
+     * for i, v in obj:items() do ... end        -- random access container (std::vector, std::deque...)
+     * for k in obj:items() do ... end           -- set container (std::set, std::unordered_set...)
+     * for k, v in obj:items() do ... end        -- map container (std::map, std::unordered_map...)
+     *
+     * The iterator function is stateless and shared by all the loops, the position is derived from
+     * the control variable (index or key), so no closure or iterator object is allocated per loop.
+     * Containers with duplicate keys (such as std::multimap) are not supported.
+     * The value return to lua is pass-by-value, the same as addVariable.
+     */
+    template <typename C>
+    CppBindClass<T, PARENT>& addIterator(const char* name, C T::* range)
+    {
+        using CppRange = CppBindClassRange<T, typename std::remove_const<C>::type, C T::*>;
+        LuaRef iter = LuaRef::createFunction(state(), &CppRange::next, range);
+        setMemberFunction(name, LuaRef::createFunctionWith(state(), &CppRange::each, iter), true);
+        return *this;
+    }
+
+    /**
+     * Add or replace a member function that returns a generic for-loop iterator for the container
+     * returned by the given const member function, please see above for detail.
+     */
+    template <typename C>
+    CppBindClass<T, PARENT>& addIterator(const char* name, const C& (T::*range)() const)
+    {
+        using CppRange = CppBindClassRange<T, C, const C& (T::*)() const>;
+        LuaRef iter = LuaRef::createFunction(state(), &CppRange::next, range);
+        setMemberFunction(name, LuaRef::createFunctionWith(state(), &CppRange::each, iter), true);
+        return *this;
+    }
+
+    /**
+     * Add or replace a member function that returns a generic for-loop iterator for the
+     * object itself, if the class is container type, please see above for detail.
+     */
+    CppBindClass<T, PARENT>& addIterator(const char* name)
+    {
+        using CppRange = CppBindClassRange<T, T, void>;
+        LuaRef iter = LuaRef::createFunctionWith(state(), &CppRange::next);
+        setMemberFunction(name, LuaRef::createFunctionWith(state(), &CppRange::each, iter), true);
+        return *this;
+    }
+
     /**
     * Add or replace a operator [] for accessing by index.
     */
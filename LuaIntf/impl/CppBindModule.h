@@ -120,12 +120,17 @@ struct CppBindMethodBase
             const FN& fn = *reinterpret_cast<const FN*>(lua_touserdata(L, lua_upvalueindex(1)));
             assert(fn);
 
+            LuaCallRecorderScope record(L);
+            LuaMetrics::addCall(L, LuaMetrics::LUA_TO_CPP);
+            CppArgArenaScope arena;
             CppArgTuple<P...> args;
             CppArgTupleInput<P...>::get(L, IARG, args);
+            arena.finishInput();
 
             int n = CppInvokeMethod<FN, R, typename CppArg<P>::HolderType...>::push(L, fn, args);
             return n + CppArgTupleOutput<P...>::push(L, args);
         } catch (std::exception& e) {
+            LuaMetrics::addException(L);
             return luaL_error(L, "%s", e.what());
         }
     }
@@ -186,6 +191,135 @@ struct CppBindMethod <FN, _arg(*)(P...), IARG, CHK,
 
 //----------------------------------------------------------------------------
 
+struct CppBindBulk
+{
+    /**
+     * Create the callable object for bulk function, the object calls the function with the arguments,
+     * and has method map(array) to apply the function to every element of array.
+     */
+    static LuaRef create(lua_State* L, const LuaRef& call, const LuaRef& map);
+
+    /**
+     * Pop the error of decoding element on top of stack, and return the error message with element index.
+     */
+    static std::string elementError(lua_State* L, size_t index);
+};
+
+template <typename FN, typename R, typename A>
+struct CppBindBulkMethodBase
+{
+    static_assert(!std::is_same<R, void>::value,
+        "the bulk function must return value");
+
+    using ArgType = typename std::decay<A>::type;
+    using ResultType = typename std::decay<R>::type;
+
+    // std::vector<bool> can not be written by multiple threads
+    using ResultStorage = typename std::conditional<std::is_same<ResultType, bool>::value,
+        char, ResultType>::type;
+
+    /**
+     * lua_CFunction to apply the function to every element of array, and return the result array.
+     *
+     * The elements are decoded before the function is called, and the function is called in parallel
+     * by the shared thread pool, so the function must be thread-safe and must not access Lua state.
+     *
+     * The pointer to function object is in the first upvalue.
+     */
+    static int map(lua_State* L)
+    {
+        try {
+            assert(lua_isuserdata(L, lua_upvalueindex(1)));
+            const FN& fn = *reinterpret_cast<const FN*>(lua_touserdata(L, lua_upvalueindex(1)));
+            assert(fn);
+
+            luaL_checktype(L, 2, LUA_TTABLE);
+            size_t n = lua_rawlen(L, 2);
+
+            // decode in protected call, so the error can tell which element is bad
+            Decoder decoder;
+            decoder.index = 0;
+            decoder.args.reserve(n);
+            lua_pushcfunction(L, &decode);
+            lua_pushlightuserdata(L, &decoder);
+            lua_pushvalue(L, 2);
+            if (lua_pcall(L, 2, 0, 0) != LUA_OK) {
+                throw LuaException(CppBindBulk::elementError(L, decoder.index + 1));
+            }
+
+            const std::vector<ArgType>& args = decoder.args;
+
+            std::vector<ResultStorage> results(n);
+            CppThreadPool::shared().parallelFor(n, 0, [&fn, &args, &results] (size_t begin, size_t end) {
+                for (size_t i = begin; i < end; i++) {
+                    results[i] = fn(args[i]);
+                }
+            });
+
+            lua_createtable(L, int(n), 0);
+            for (size_t i = 0; i < n; i++) {
+                LuaType<ResultType>::push(L, ResultType(results[i]));
+                lua_rawseti(L, -2, lua_Integer(i + 1));
+            }
+            return 1;
+        } catch (std::exception& e) {
+            return luaL_error(L, "%s", e.what());
+        }
+    }
+
+private:
+    struct Decoder
+    {
+        std::vector<ArgType> args;
+        size_t index;
+    };
+
+    static int decode(lua_State* L)
+    {
+        try {
+            Decoder& decoder = *static_cast<Decoder*>(lua_touserdata(L, 1));
+            for (size_t n = lua_rawlen(L, 2); decoder.index < n; decoder.index++) {
+                lua_rawgeti(L, 2, lua_Integer(decoder.index + 1));
+                decoder.args.push_back(LuaType<ArgType>::get(L, -1));
+                lua_pop(L, 1);
+            }
+            return 0;
+        } catch (std::exception& e) {
+            return luaL_error(L, "%s", e.what());
+        }
+    }
+
+public:
+    template <typename PROC>
+    static FN function(const PROC& fn)
+    {
+        return static_cast<FN>(fn);
+    }
+};
+
+template <typename FN, typename ENABLED = void>
+struct CppBindBulkMethod;
+
+template <typename R, typename A>
+struct CppBindBulkMethod <R(*)(A)>
+    : CppBindBulkMethodBase <R(*)(A), R, A> {};
+
+template <typename R, typename A>
+struct CppBindBulkMethod <std::function<R(A)>>
+    : CppBindBulkMethodBase <std::function<R(A)>, R, A> {};
+
+template <typename FN>
+struct CppBindBulkMethod <FN,
+        typename std::enable_if<CppCouldBeLambda<FN>::value>::type>
+    : CppBindBulkMethod <typename CppLambdaTraits<FN>::FunctionType> {};
+
+template <typename FN>
+struct CppBindBulkMethod <FN,
+        typename std::enable_if<std::is_function<FN>::value>::type>
+    : CppBindBulkMethod <FN*> {};
+
+//----------------------------------------------------------------------------
+
 struct CppBindModuleMetaMethod
 {
     /**
@@ -494,6 +628,26 @@ public:
         return *this;
     }
 
+    /**
+     * Add or replace a bulk function, the function takes one argument and returns a value.
+     * It can be called as normal function, or applied to every element of array by map,
+     * which calls the function in parallel and returns the result array:
+     *
+     * local ys = module.fn:map(xs)
+     *
+     * The function must be thread-safe and must not access Lua state.
+     */
+    template <typename FN>
+    CppBindModule<PARENT>& addBulkFunction(const char* name, const FN& proc)
+    {
+        using CppProc = CppBindMethod<FN, FN, 2>;
+        using CppBulk = CppBindBulkMethod<FN>;
+        m_meta.rawset(name, CppBindBulk::create(state(),
+            LuaRef::createFunction(state(), &CppProc::call, CppProc::function(proc)),
+            LuaRef::createFunction(state(), &CppBulk::map, CppBulk::function(proc))));
+        return *this;
+    }
+
     /**
      * Add or replace a factory function.
      */
@@ -75,6 +75,96 @@ private:
 
 //---------------------------------------------------------------------------
 
+#if LUA_VERSION_NUM >= 502
+
+/**
+ * A template for C++ function that can call back into Lua and still be suspended
+ * when the Lua function yields, the function is resumed by Lua continuation (lua_callk
+ * and lua_pcallk) when the coroutine is resumed.
+ *
+ * To use this, user need to inherit CppYieldable, and override run method and optional destructor.
+ * A new object is created for each call, so it can keep the state in its member variables.
+ * The object itself is at index 1 of the stack, and the arguments start from index 2.
+ * Please note the C++ stack is unwound on yield, run method is called again when resumed,
+ * with status LUA_YIELD (or error status if pcall is used) and the results on top of stack.
+ *
+ * To register the function:
+ *
+ * LuaBinding(L).beginModule("utils")
+ *     .addFunction("each", &CppYieldable::function<MyEach>)
+ * .endModule();
+ *
+ * This requires Lua 5.2 or later.
+ */
+class CppYieldable
+{
+public:
+    /**
+     * Override destructor if you need to perform any cleanup action
+     */
+    virtual ~CppYieldable() {}
+
+    /**
+     * Override this method to perform lua function
+     *
+     * @param status LUA_OK if this is the first run, LUA_YIELD if resumed after call or pcall
+     * @return the number of results on top of stack
+     */
+    virtual int run(lua_State* L, int status) = 0;
+
+    /**
+     * The lua_CFunction that create FUNCTOR (default constructed) and run it
+     */
+    template <typename FUNCTOR>
+    static int function(lua_State* L)
+    {
+        static_assert(std::is_base_of<CppYieldable, FUNCTOR>::value, "FUNCTOR must inherit CppYieldable");
+
+        // the base pointer is kept in front of the object, so CppYieldable does not need to be
+        // the first base class of FUNCTOR
+        const size_t offset = (sizeof(CppYieldable*) + alignof(FUNCTOR) - 1) / alignof(FUNCTOR) * alignof(FUNCTOR);
+        void* mem = lua_newuserdata(L, offset + sizeof(FUNCTOR));
+        try {
+            *static_cast<CppYieldable**>(mem) = ::new (static_cast<char*>(mem) + offset) FUNCTOR();
+        } catch (std::exception& e) {
+            return luaL_error(L, "%s", e.what());
+        }
+        return start(L);
+    }
+
+protected:
+    /**
+     * Call the Lua function on stack (the same as lua_call), if the function yields,
+     * the C++ stack is unwound, and run method is called again when resumed.
+     */
+    void call(lua_State* L, int nargs, int nresults);
+
+    /**
+     * Call the Lua function on stack in protected mode (the same as lua_pcall), if the function yields,
+     * the C++ stack is unwound, and run method is called again when resumed.
+     */
+    int pcall(lua_State* L, int nargs, int nresults, int errfunc = 0);
+
+private:
+    static CppYieldable* self(lua_State* L)
+    {
+        return *static_cast<CppYieldable**>(lua_touserdata(L, 1));
+    }
+
+    static int start(lua_State* L);
+    static int gc(lua_State* L);
+
+#if LUA_VERSION_NUM == 502
+    static int resume(lua_State* L);
+#else
+    static int resume(lua_State* L, int status, lua_KContext ctx);
+#endif
+};
+
+#endif
+
+//---------------------------------------------------------------------------
+
 template <>
 struct LuaTypeMapping <lua_CFunction>
 {
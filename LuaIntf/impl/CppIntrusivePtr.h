@@ -0,0 +1,207 @@
+//
+// https://github.com/SteveKChiu/lua-intf
+//
+// Copyright 2014, Steve K. Chiu <steve.k.chiu@gmail.com>
+//
+// The MIT License (http://www.opensource.org/licenses/mit-license.php)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+//
+
+/**
+ * Base class for intrusive reference counted object, the reference count is stored in the object,
+ * so there is no separated control block as std::shared_ptr.
+ *
+ * The template argument COUNT is the counter type, the default int is not thread-safe but
+ * avoids atomic operations, use std::atomic<int> if the object is shared between threads.
+ *
+ * The object is deleted as T when the count drops to zero, so T needs virtual destructor if the
+ * subclass is also used. The intrusive_ptr_add_ref and intrusive_ptr_release are compatible with
+ * boost::intrusive_ptr.
+ */
+template <typename T, typename COUNT = int>
+class CppIntrusiveObject
+{
+protected:
+    CppIntrusiveObject()
+        : m_ref_count(0)
+        {}
+
+    CppIntrusiveObject(const CppIntrusiveObject&)
+        : m_ref_count(0)
+        {}
+
+    CppIntrusiveObject& operator = (const CppIntrusiveObject&)
+    {
+        return *this;
+    }
+
+    ~CppIntrusiveObject() {}
+
+public:
+    /**
+     * Get the current reference count
+     */
+    int refCount() const
+    {
+        return m_ref_count;
+    }
+
+    friend void intrusive_ptr_add_ref(const CppIntrusiveObject* p)
+    {
+        ++p->m_ref_count;
+    }
+
+    friend void intrusive_ptr_release(const CppIntrusiveObject* p)
+    {
+        if (--p->m_ref_count == 0) {
+            delete static_cast<const T*>(p);
+        }
+    }
+
+private:
+    mutable COUNT m_ref_count;
+};
+
+//---------------------------------------------------------------------------
+
+/**
+ * Smart pointer to intrusive reference counted object, the object type must provide
+ * intrusive_ptr_add_ref and intrusive_ptr_release (for example, inherit CppIntrusiveObject).
+ *
+ * It is registered with LUA_USING_SHARED_PTR_TYPE already, pushing or copying the pointer
+ * only modifies the counter inside the object.
+ */
+template <typename T>
+class CppIntrusivePtr
+{
+public:
+    using element_type = T;
+
+    CppIntrusivePtr()
+        : m_ptr(nullptr)
+        {}
+
+    CppIntrusivePtr(T* p, bool add_ref = true)
+        : m_ptr(p)
+    {
+        if (m_ptr && add_ref) intrusive_ptr_add_ref(m_ptr);
+    }
+
+    CppIntrusivePtr(const CppIntrusivePtr& that)
+        : m_ptr(that.m_ptr)
+    {
+        if (m_ptr) intrusive_ptr_add_ref(m_ptr);
+    }
+
+    CppIntrusivePtr(CppIntrusivePtr&& that)
+        : m_ptr(that.m_ptr)
+    {
+        that.m_ptr = nullptr;
+    }
+
+    template <typename U, typename = typename std::enable_if<std::is_convertible<U*, T*>::value>::type>
+    CppIntrusivePtr(const CppIntrusivePtr<U>& that)
+        : m_ptr(that.get())
+    {
+        if (m_ptr) intrusive_ptr_add_ref(m_ptr);
+    }
+
+    ~CppIntrusivePtr()
+    {
+        if (m_ptr) intrusive_ptr_release(m_ptr);
+    }
+
+    CppIntrusivePtr& operator = (const CppIntrusivePtr& that)
+    {
+        CppIntrusivePtr(that).swap(*this);
+        return *this;
+    }
+
+    CppIntrusivePtr& operator = (CppIntrusivePtr&& that)
+    {
+        CppIntrusivePtr(std::move(that)).swap(*this);
+        return *this;
+    }
+
+    CppIntrusivePtr& operator = (T* p)
+    {
+        CppIntrusivePtr(p).swap(*this);
+        return *this;
+    }
+
+    void reset(T* p = nullptr)
+    {
+        CppIntrusivePtr(p).swap(*this);
+    }
+
+    void swap(CppIntrusivePtr& that)
+    {
+        std::swap(m_ptr, that.m_ptr);
+    }
+
+    /**
+     * Release the ownership without decreasing the reference count
+     */
+    T* detach()
+    {
+        T* p = m_ptr;
+        m_ptr = nullptr;
+        return p;
+    }
+
+    T* get() const
+    {
+        return m_ptr;
+    }
+
+    T& operator * () const
+    {
+        assert(m_ptr);
+        return *m_ptr;
+    }
+
+    T* operator -> () const
+    {
+        assert(m_ptr);
+        return m_ptr;
+    }
+
+    explicit operator bool () const
+    {
+        return m_ptr != nullptr;
+    }
+
+    template <typename U>
+    bool operator == (const CppIntrusivePtr<U>& that) const
+    {
+        return m_ptr == that.get();
+    }
+
+    template <typename U>
+    bool operator != (const CppIntrusivePtr<U>& that) const
+    {
+        return m_ptr != that.get();
+    }
+
+private:
+    T* m_ptr;
+};
+
+LUA_USING_SHARED_PTR_TYPE(CppIntrusivePtr)
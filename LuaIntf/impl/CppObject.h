@@ -57,40 +57,104 @@ using CppConstSignature = CppSignature<T, 2>;
  *     2. CppObject's metatable has been tagged by typeid
  *     3. CppObject's typeid is a unique pointer in the process.
  *     4. Access to CppObject class method will check for typeid, and raise error if not matched
+ *
+ * The userdata layout is compact and has no vtable, the object pointer is always at offset 0,
+ * so the object can be resolved without virtual dispatch:
+ *
+ *     pointer:    <ptr>
+ *     value:      <ptr> [padding] <object> <kind>
+ *     shared ptr: <ptr> <release> <sp> <kind>
+ *
+ * The storage kind is a tag byte at the end of userdata, a pointer has no tag and is
+ * identified by the userdata size (unless it is const and LUAINTF_UNIFIED_CONST_METATABLE
+ * is enabled, the const flag is also stored in the tag).
+ *
+ * The class destructor (__gc) in the metatable uses the kind to decide how to destroy
+ * the object.
  */
 class CppObject
 {
+    friend class CppObjectHandle;
+
+public:
+    /**
+     * The storage kind of object userdata
+     */
+    enum Kind : unsigned char
+    {
+        EMPTY,
+        POINTER,
+        VALUE,
+        SHARED_PTR,
+        CONST = 0x80
+    };
+
 protected:
-    CppObject() {}
+    explicit CppObject(void* obj)
+        : m_ptr(obj)
+        {}
 
-    template <typename OBJ>
-    static void* allocate(lua_State* L, void* class_id)
+    static void* allocate(lua_State* L, void* class_id, size_t size)
     {
-        void* mem = lua_newuserdata(L, sizeof(OBJ));
+        void* mem = lua_newuserdata(L, size);
+        ::new (mem) CppObject(nullptr);
+        if (size > sizeof(CppObject)) {
+            static_cast<unsigned char*>(mem)[size - 1] = EMPTY;
+        }
         lua_rawgetp(L, LUA_REGISTRYINDEX, class_id);
         luaL_checktype(L, -1, LUA_TTABLE);
         lua_setmetatable(L, -2);
         return mem;
     }
 
-public:
-    virtual ~CppObject() {}
+    static void attach(lua_State* L, void* obj, Kind kind, bool is_const)
+    {
+        // the object userdata is at the top of the Lua stack
+        CppObject* object = static_cast<CppObject*>(lua_touserdata(L, -1));
+        object->m_ptr = obj;
+        if (obj) {
+            LuaMetrics::addObject(L, 1);
+        }
+        size_t len = lua_rawlen(L, -1);
+        if (len > sizeof(CppObject)) {
+            reinterpret_cast<unsigned char*>(object)[len - 1] = is_const ? kind | CONST : kind;
+        }
+    }
 
+public:
     CppObject(const CppObject&) = delete;
     CppObject& operator = (const CppObject&) = delete;
 
     /**
-     * Whether the object is shared pointer
+     * The object pointer
      */
-    virtual bool isSharedPtr() const
+    void* objectPtr() const
     {
-        return false;
+        return m_ptr;
     }
 
     /**
-     * The object pointer
+     * Get the storage kind of the object userdata at the index
+     */
+    static Kind kindOf(lua_State* L, int index);
+
+    /**
+     * Whether the object userdata at the index is const object.
+     * The const flag of pointer is stored only if LUAINTF_UNIFIED_CONST_METATABLE is enabled.
+     */
+    static bool isConst(lua_State* L, int index);
+
+    /**
+     * Get the CppObject* of the userdata (or handle) at the index, and push its class metatable.
+     * Returns nullptr and push nothing if there is no metatable, or the handle is stale.
      */
-    virtual void* objectPtr() = 0;
+    static CppObject* getMetaTable(lua_State* L, int index);
+
+    /**
+     * Destroy the object in userdata at the index, the object must be of the exact class
+     */
+    template <typename T>
+    static void destroy(lua_State* L, int index);
 
     /**
      * Get internal class id of the given class
@@ -148,6 +212,9 @@ private:
     static void typeMismatchError(lua_State* L, int index);
     static CppObject* getObject(lua_State* L, int index, void* class_id,
         bool is_const, bool is_exact, bool raise_error);
+
+private:
+    void* m_ptr;
 };
 
 //----------------------------------------------------------------------------
@@ -223,7 +290,12 @@ public:
         LuaRef registry(L, LUA_REGISTRYINDEX);
         LuaRef super = registry.rawgetp(CppSignature<SUPER>::value());
         addDowncast<T, SUPER, false>(super.rawget("___class"));
+#if LUAINTF_UNIFIED_CONST_METATABLE
+        // const class id shares the same metatable and downcast list
+        *static_cast<bool*>(CppObject::getClassID<SUPER>(true)) = true;
+#else
         addDowncast<T, SUPER, true>(super.rawget("___const"));
+#endif
     }
 
     template <typename T>
@@ -254,150 +326,282 @@ public:
 template <typename T>
 class CppObjectValue : public CppObject
 {
-private:
-    CppObjectValue()
-    {
-        if (MAX_PADDING > 0) {
-            uintptr_t offset = reinterpret_cast<uintptr_t>(&m_data[0]) % alignof(T);
-            if (offset > 0) offset = alignof(T) - offset;
-            assert(offset < MAX_PADDING);
-            m_data[sizeof(m_data) - 1] = static_cast<unsigned char>(offset);
-        }
-    }
-
 public:
-    virtual ~CppObjectValue()
-    {
-        T* obj = static_cast<T*>(objectPtr());
-        obj->~T();
-    }
-
-    virtual void* objectPtr() override
-    {
-        if (MAX_PADDING == 0) {
-            return &m_data[0];
-        } else {
-            return &m_data[0] + m_data[sizeof(m_data) - 1];
-        }
-    }
-
     template <typename... P>
     static void pushToStack(lua_State* L, bool is_const, P&&... args)
     {
-        void* mem = allocate<CppObjectValue<T>>(L, getClassID<T>(is_const));
-        CppObjectValue<T>* v = ::new (mem) CppObjectValue<T>();
-        ::new (v->objectPtr()) T(std::forward<P>(args)...);
+        void* obj = allocate(L, is_const);
+        ::new (obj) T(std::forward<P>(args)...);
+        attach(L, obj, VALUE, is_const);
     }
 
     template <typename... P>
     static void pushToStack(lua_State* L, std::tuple<P...>& args, bool is_const)
     {
-        void* mem = allocate<CppObjectValue<T>>(L, getClassID<T>(is_const));
-        CppObjectValue<T>* v = ::new (mem) CppObjectValue<T>();
-        CppInvokeClassConstructor<T>::call(v->objectPtr(), args);
+        void* obj = allocate(L, is_const);
+        CppInvokeClassConstructor<T>::call(obj, args);
+        attach(L, obj, VALUE, is_const);
     }
 
     static void pushToStack(lua_State* L, const T& obj, bool is_const)
     {
-        void* mem = allocate<CppObjectValue<T>>(L, getClassID<T>(is_const));
-        CppObjectValue<T>* v = ::new (mem) CppObjectValue<T>();
-        ::new (v->objectPtr()) T(obj);
+        void* mem = allocate(L, is_const);
+        ::new (mem) T(obj);
+        attach(L, mem, VALUE, is_const);
+    }
+
+private:
+    static void* allocate(lua_State* L, bool is_const)
+    {
+        // the kind is EMPTY until the object is constructed, so __gc will skip it if constructor throws
+        unsigned char* mem = static_cast<unsigned char*>(
+            CppObject::allocate(L, getClassID<T>(is_const), sizeof(CppObject) + PADDING + sizeof(T) + 1));
+        uintptr_t obj = reinterpret_cast<uintptr_t>(mem + sizeof(CppObject));
+        if (PADDING > 0) {
+            obj = (obj + alignof(T) - 1) & ~uintptr_t(alignof(T) - 1);
+        }
+        return reinterpret_cast<void*>(obj);
     }
 
 private:
-    using AlignType = typename std::conditional<alignof(T) <= alignof(double), T, void*>::type;
-    static constexpr int MAX_PADDING = alignof(T) <= alignof(AlignType) ? 0 : alignof(T) - alignof(AlignType) + 1;
-    alignas(AlignType) unsigned char m_data[sizeof(T) + MAX_PADDING];
+    static constexpr size_t PADDING = alignof(T) > alignof(CppObject) ? alignof(T) - alignof(CppObject) : 0;
 };
 
 //----------------------------------------------------------------------------
 
+template <typename T>
+struct CppObjectHandleTraits
+{
+    static constexpr bool isHandle = false;
+};
+
 /**
- * Wraps a pointer to a class object inside a Lua userdata.
+ * Push the borrowed pointer or reference of the class as handle instead of userdata.
+ * This must be used inside namespace LuaIntf, and the class must call CppObjectHandle::release
+ * when the object is destroyed.
+ */
+#define LUA_USING_HANDLE_TYPE(T) \
+    template <> \
+    struct CppObjectHandleTraits <T> \
+    { \
+        static constexpr bool isHandle = true; \
+    };
+
+/**
+ * The handle of borrowed class object, for class declared by LUA_USING_HANDLE_TYPE.
  *
- * The lifetime of the object is managed by C++.
+ * The handle is a light userdata that encodes the slot index and generation of entry
+ * in the process-wide handle table, so pushing the object to Lua does not allocate
+ * anything after the first time. Each slot is keyed by both object address and class,
+ * so the same address pushed as different class (such as first member or base class)
+ * gets its own handle. The entries never move once allocated, so looking up the handle
+ * does not need any lock, only acquire and release are serialized. The lookup copies the
+ * entry and checks the generation again, the CppObject* of handle is this per-thread copy,
+ * which is valid until the next lookup on the same thread.
+ *
+ * All light userdata share the same metatable, which forwards the field access to the
+ * class metatable of handle. As a result, indexing other light userdata will raise
+ * error, and binding handle type will throw LuaException if the light userdata metatable
+ * is already set by other library.
+ *
+ * When the object is released, the slot generation is bumped and the existing handles
+ * become stale, any access to stale handle will raise Lua error instead of dangling.
+ * Only the fields, properties and member functions are accessible through handle,
+ * the other meta functions of class (such as operators) are not supported.
  */
-class CppObjectPtr : public CppObject
+class CppObjectHandle : public CppObject
 {
-private:
-    explicit CppObjectPtr(void* obj)
-        : m_ptr(obj)
-    {
-        assert(obj != nullptr);
-    }
+    friend class CppObject;
 
 public:
-    virtual void* objectPtr() override
-    {
-        return m_ptr;
-    }
+    CppObjectHandle()
+        : CppObject(nullptr)
+        , m_class_id(nullptr)
+        {}
 
+    /**
+     * Push the handle of object onto Lua stack.
+     */
     template <typename T>
     static void pushToStack(lua_State* L, T* obj, bool is_const)
     {
-        void* mem = allocate<CppObjectPtr>(L, CppAutoDowncast::getClassID(L, obj, is_const));
-        ::new (mem) CppObjectPtr(obj);
+        assert(obj != nullptr);
+        lua_pushlightuserdata(L, acquire(obj, CppAutoDowncast::getClassID(L, obj, is_const), is_const));
     }
 
+    /**
+     * Release the handle of object, all the existing handles of object will become stale.
+     * This must be called when the object is destroyed, it is no-op if there is no handle.
+     */
+    static void release(const void* obj);
+
+    /**
+     * Install the shared metatable of light userdata, this is called by LuaBinding.
+     * It throws LuaException if the metatable is already set by other library.
+     */
+    static void registerMetaTable(lua_State* L);
+
 private:
-    void* m_ptr;
+    struct Table;
+
+    static Table& table();
+    static void* acquire(void* obj, void* class_id, bool is_const);
+    static CppObjectHandle* find(lua_State* L, int index);
+
+    static constexpr int SLOT_BITS = sizeof(void*) >= 8 ? 24 : 20;
+    static constexpr int GENERATION_BITS = sizeof(void*) >= 8 ? 21 : 10;
+    static constexpr uintptr_t SLOT_MASK = (uintptr_t(1) << SLOT_BITS) - 1;
+    static constexpr uintptr_t GENERATION_MASK = (uintptr_t(1) << GENERATION_BITS) - 1;
+    static constexpr uintptr_t CONST_FLAG = 2;
+    static constexpr uintptr_t HANDLE_FLAG = 1;
+
+private:
+    void* m_class_id;
+};
+
+//----------------------------------------------------------------------------
+
+/**
+ * Wraps a pointer to a class object inside a Lua userdata.
+ *
+ * The lifetime of the object is managed by C++.
+ */
+class CppObjectPtr : public CppObject
+{
+public:
+    template <typename T>
+    static void pushToStack(lua_State* L, T* obj, bool is_const)
+    {
+        if (CppObjectHandleTraits<T>::isHandle) {
+            CppObjectHandle::pushToStack(L, obj, is_const);
+            return;
+        }
+
+        assert(obj != nullptr);
+        size_t size = LUAINTF_UNIFIED_CONST_METATABLE && is_const ? sizeof(CppObject) + 1 : sizeof(CppObject);
+        allocate(L, CppAutoDowncast::getClassID(L, obj, is_const), size);
+        attach(L, obj, POINTER, is_const);
+    }
 };
 
 //----------------------------------------------------------------------------
 
+/**
+ * The common part of shared ptr wrapper, the release function destroys the
+ * shared ptr without knowing its type (the class of metatable may be a subclass
+ * of the shared ptr's type if LUAINTF_AUTO_DOWNCAST is enabled).
+ */
+class CppObjectSharedPtrBase : public CppObject
+{
+    friend class CppObject;
+
+protected:
+    using ReleaseFunc = void (*)(CppObjectSharedPtrBase*);
+
+    explicit CppObjectSharedPtrBase(ReleaseFunc release)
+        : CppObject(nullptr)
+        , m_release(release)
+        {}
+
+private:
+    ReleaseFunc m_release;
+};
+
 /**
  * Wraps a shared ptr that references a class object.
  *
  * The template argument SP is the smart pointer type
  */
 template <typename SP, typename T>
-class CppObjectSharedPtr : public CppObject
+class CppObjectSharedPtr : public CppObjectSharedPtrBase
 {
 private:
-    explicit CppObjectSharedPtr(T* obj)
-        : m_sp(obj)
-        {}
-
-    explicit CppObjectSharedPtr(const SP& sp)
-        : m_sp(sp)
+    CppObjectSharedPtr()
+        : CppObjectSharedPtrBase(&release)
         {}
 
 public:
-    virtual bool isSharedPtr() const override
+    SP& sharedPtr()
     {
-        return true;
+        return *reinterpret_cast<SP*>(&m_sp[0]);
     }
 
-    virtual void* objectPtr() override
+    static void pushToStack(lua_State* L, T* obj, bool is_const)
     {
-        return const_cast<T*>(&*m_sp);
+        CppObjectSharedPtr<SP, T>* v = allocate(L, CppAutoDowncast::getClassID(L, obj, is_const));
+        ::new (&v->m_sp[0]) SP(obj);
+        attach(L, obj, SHARED_PTR, is_const);
     }
 
-    SP& sharedPtr()
+    static void pushToStack(lua_State* L, const SP& sp, bool is_const)
     {
-        return m_sp;
+        T* obj = const_cast<T*>(&*sp);
+        CppObjectSharedPtr<SP, T>* v = allocate(L, CppAutoDowncast::getClassID(L, obj, is_const));
+        ::new (&v->m_sp[0]) SP(sp);
+        attach(L, obj, SHARED_PTR, is_const);
     }
 
-    static void pushToStack(lua_State* L, T* obj, bool is_const)
+private:
+    static CppObjectSharedPtr<SP, T>* allocate(lua_State* L, void* class_id)
     {
-        void* mem = allocate<CppObjectSharedPtr<SP, T>>(L,
-            CppAutoDowncast::getClassID(L, obj, is_const));
-        ::new (mem) CppObjectSharedPtr<SP, T>(obj);
+        void* mem = CppObject::allocate(L, class_id, sizeof(CppObjectSharedPtr<SP, T>) + 1);
+        return ::new (mem) CppObjectSharedPtr<SP, T>();
     }
 
-    static void pushToStack(lua_State* L, const SP& sp, bool is_const)
+    static void release(CppObjectSharedPtrBase* obj)
     {
-        void* mem = allocate<CppObjectSharedPtr<SP, T>>(L,
-            CppAutoDowncast::getClassID(L, const_cast<T*>(&*sp), is_const));
-        ::new (mem) CppObjectSharedPtr<SP, T>(sp);
+        static_cast<CppObjectSharedPtr<SP, T>*>(obj)->sharedPtr().~SP();
     }
 
 private:
-    SP m_sp;
+    alignas(SP) unsigned char m_sp[sizeof(SP)];
 };
 
 //----------------------------------------------------------------------------
 
+inline CppObject::Kind CppObject::kindOf(lua_State* L, int index)
+{
+    size_t len = lua_rawlen(L, index);
+    if (len == sizeof(CppObject) || lua_islightuserdata(L, index)) {
+        return POINTER;
+    } else {
+        return static_cast<Kind>(static_cast<unsigned char*>(lua_touserdata(L, index))[len - 1] & ~CONST);
+    }
+}
+
+inline bool CppObject::isConst(lua_State* L, int index)
+{
+    if (lua_islightuserdata(L, index)) {
+        return (reinterpret_cast<uintptr_t>(lua_touserdata(L, index)) & CppObjectHandle::CONST_FLAG) != 0;
+    } else {
+        size_t len = lua_rawlen(L, index);
+        return len > sizeof(CppObject)
+            && (static_cast<unsigned char*>(lua_touserdata(L, index))[len - 1] & CONST) != 0;
+    }
+}
+
+template <typename T>
+inline void CppObject::destroy(lua_State* L, int index)
+{
+    CppObject* obj = static_cast<CppObject*>(lua_touserdata(L, index));
+    if (obj->m_ptr) {
+        LuaMetrics::addObject(L, -1);
+    }
+    switch (kindOf(L, index)) {
+        case VALUE:
+            static_cast<T*>(obj->m_ptr)->~T();
+            break;
+        case SHARED_PTR:
+            static_cast<CppObjectSharedPtrBase*>(obj)->m_release(static_cast<CppObjectSharedPtrBase*>(obj));
+            break;
+        default:
+            break;
+    }
+    obj->m_ptr = nullptr;
+}
+
+//----------------------------------------------------------------------------
+
 template <typename T>
 struct CppObjectTraits
 {
@@ -430,7 +634,7 @@ struct LuaCppObjectFactory <T, T, false, false>
         CppObjectValue<T>::pushToStack(L, obj, is_const);
     }
 
-    static T& cast(lua_State*, CppObject* obj)
+    static T& cast(lua_State*, int, CppObject* obj)
     {
         return *static_cast<T*>(obj->objectPtr());
     }
@@ -444,7 +648,7 @@ struct LuaCppObjectFactory <T, T, false, true>
         CppObjectPtr::pushToStack(L, const_cast<T*>(&obj), is_const);
     }
 
-    static T& cast(lua_State*, CppObject* obj)
+    static T& cast(lua_State*, int, CppObject* obj)
     {
         return *static_cast<T*>(obj->objectPtr());
     }
@@ -462,9 +666,9 @@ struct LuaCppObjectFactory <SP, T, true, true>
         }
     }
 
-    static SP& cast(lua_State* L, CppObject* obj)
+    static SP& cast(lua_State* L, int index, CppObject* obj)
     {
-        if (!obj->isSharedPtr()) {
+        if (CppObject::kindOf(L, index) != CppObject::SHARED_PTR) {
             luaL_error(L, "is not shared object");
         }
         return static_cast<CppObjectSharedPtr<SP, T>*>(obj)->sharedPtr();
@@ -494,7 +698,7 @@ struct LuaClassMapping
     static T& get(lua_State* L, int index)
     {
         CppObject* obj = CppObject::getObject<ObjectType>(L, index, isConst);
-        return LuaCppObjectFactory<T, ObjectType, isShared, isRef>::cast(L, obj);
+        return LuaCppObjectFactory<T, ObjectType, isShared, isRef>::cast(L, index, obj);
     }
 
     static const T& opt(lua_State* L, int index, const T& def)
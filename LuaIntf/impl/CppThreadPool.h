@@ -0,0 +1,83 @@
+//
+// https://github.com/SteveKChiu/lua-intf
+//
+// Copyright 2014, Steve K. Chiu <steve.k.chiu@gmail.com>
+//
+// The MIT License (http://www.opensource.org/licenses/mit-license.php)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+//
+
+/**
+ * Process-wide pool of worker threads, to run data parallel loop of C++ code.
+ *
+ * The pool is used by bulk function binding (see addBulkFunction), the loop body must not
+ * access Lua state, only the plain C++ data decoded before the loop.
+ */
+class CppThreadPool
+{
+public:
+    using Body = std::function<void(size_t begin, size_t end)>;
+
+    /**
+     * Create pool with the given number of worker threads, the calling thread of parallelFor
+     * also runs the loop, so the total concurrency is threads + 1.
+     */
+    explicit CppThreadPool(size_t threads);
+    ~CppThreadPool();
+
+    CppThreadPool(const CppThreadPool&) = delete;
+    CppThreadPool& operator = (const CppThreadPool&) = delete;
+
+    /**
+     * Get the shared pool, it has one worker thread less than the hardware concurrency
+     */
+    static CppThreadPool& shared();
+
+    /**
+     * Get the number of threads that run the loop, including the calling thread
+     */
+    size_t concurrency() const
+    {
+        return m_threads.size() + 1;
+    }
+
+    /**
+     * Run body over the range [0, count) in slices, and wait until all the slices are done.
+     * If the body throws, the first exception is thrown again after the loop.
+     *
+     * @param count the number of items
+     * @param grain the number of items in each slice, or 0 to decide by count and concurrency
+     * @param body the loop body, called with [begin, end) of each slice
+     */
+    void parallelFor(size_t count, size_t grain, const Body& body);
+
+private:
+    struct Job;
+
+    static void runSlices(Job& job);
+    void loop();
+
+private:
+    std::mutex m_mutex;
+    std::condition_variable m_wake;
+    std::deque<std::shared_ptr<Job>> m_jobs;
+    bool m_stop;
+    std::vector<std::thread> m_threads;
+};
@@ -0,0 +1,323 @@
+//
+// https://github.com/SteveKChiu/lua-intf
+//
+// Copyright 2014, Steve K. Chiu <steve.k.chiu@gmail.com>
+//
+// The MIT License (http://www.opensource.org/licenses/mit-license.php)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+//
+
+#if LUAINTF_CALL_RECORDER
+
+/**
+ * Recorder of the calls across Lua/C++ boundary, for capturing real script traffic and
+ * replaying it later with LuaCallReplay.
+ *
+ * While recording, every call of bound C++ function from Lua, and every call of Lua function
+ * from C++ via LuaRef, is written to the file with the function name, the arguments and the
+ * time taken. The name is resolved on the first call by searching the global tables, such as
+ * "mod.Point.___class.length", so it can be looked up again in another state with the same bindings.
+ *
+ * LuaCallRecorder recorder(L, "trace.bin");
+ * recorder.start();
+ * ...
+ * recorder.stop();
+ *
+ * The recorder only records the calls of the given state on the thread calling start(),
+ * and it must outlive the calls in progress. The file format is:
+ *
+ * file   := "LUAICALL" varint(version) record*
+ * record := 'N' varint(id) varint(len) bytes                   -- name of function
+ *         | 'C' u8(direction) varint(depth) varint(id)
+ *               varint(start_ns) varint(duration_ns) varint(nargs) value*
+ * value  := TAG_NIL | TAG_FALSE | TAG_TRUE | TAG_INTEGER zigzag(i) | TAG_NUMBER f64
+ *         | TAG_STRING varint(len) bytes | TAG_TABLE (value value)* TAG_NIL
+ *         | TAG_OPAQUE u8(type) varint(len) bytes(type_name)
+ *
+ * The start time is relative to the construction of recorder, and the numbers are in native
+ * byte order. The depth is the number of recorded calls in progress when the call is started.
+ * The duration excludes the time spent by the recorder itself, including in the nested calls.
+ */
+class LuaCallRecorder
+{
+public:
+    enum Direction : unsigned char
+    {
+        LUA_TO_CPP = 1,
+        CPP_TO_LUA = 2
+    };
+
+    enum Tag : unsigned char
+    {
+        TAG_NIL,
+        TAG_FALSE,
+        TAG_TRUE,
+        TAG_INTEGER,
+        TAG_NUMBER,
+        TAG_STRING,
+        TAG_TABLE,
+        TAG_OPAQUE
+    };
+
+    static constexpr unsigned VERSION = 1;
+    static constexpr int MAX_TABLE_DEPTH = 8;
+
+    /**
+     * Create recorder of the given state, writing to the given file.
+     * This will throw LuaException if the file can not be created.
+     */
+    LuaCallRecorder(lua_State* L, const char* path);
+    ~LuaCallRecorder();
+
+    LuaCallRecorder(const LuaCallRecorder&) = delete;
+    LuaCallRecorder& operator = (const LuaCallRecorder&) = delete;
+
+    /**
+     * Start recording the calls on the current thread
+     */
+    void start();
+
+    /**
+     * Stop recording, and write the recorded calls to file
+     */
+    void stop();
+
+    /**
+     * Check whether the recorder is recording on the current thread
+     */
+    bool isRecording() const
+    {
+        return active() == this;
+    }
+
+    /**
+     * Write the recorded calls to file
+     */
+    void flush();
+
+    /**
+     * Get the active recorder of the current thread, or nullptr if not recording
+     */
+    static LuaCallRecorder*& active()
+    {
+        static thread_local LuaCallRecorder* recorder = nullptr;
+        return recorder;
+    }
+
+private:
+    friend class LuaCallRecorderScope;
+
+    struct Frame
+    {
+        size_t offset;
+        size_t length;
+        unsigned depth;
+        uint32_t name;
+        Direction direction;
+        uint64_t start;
+        uint64_t overhead;
+    };
+
+    bool begin(lua_State* L, Direction direction, int func, int first, int nargs, Frame& frame);
+    void end(const Frame& frame);
+    uint32_t nameOf(lua_State* L, int func);
+    bool findName(lua_State* L, int func, int visited, int depth, std::string& name);
+    void encode(lua_State* L, int index, int depth);
+    uint64_t now() const;
+
+    static void putVarint(std::string& out, uint64_t v);
+
+    static constexpr int MAX_NAME_DEPTH = 6;
+    static constexpr size_t FLUSH_SIZE = 64 * 1024;
+
+    lua_State* L;
+    const void* m_registry;
+    std::FILE* m_file;
+    std::string m_buffer;
+    std::string m_pending;
+    unsigned m_depth;
+    uint32_t m_next_name;
+    uint64_t m_overhead;
+    std::chrono::steady_clock::time_point m_epoch;
+};
+
+/**
+ * Scope of recorded call, the arguments are captured at the start of scope, and the call is
+ * written when the scope exits. The bound function declares it before decoding arguments,
+ * and the Lua function call declares it after pushing function and arguments.
+ */
+class LuaCallRecorderScope
+{
+public:
+    /**
+     * Scope of bound C++ function, the arguments are the whole stack
+     */
+    explicit LuaCallRecorderScope(lua_State* L)
+        : m_recorder(LuaCallRecorder::active())
+    {
+        if (m_recorder && !m_recorder->begin(L, LuaCallRecorder::LUA_TO_CPP, 0, 1, lua_gettop(L), m_frame)) {
+            m_recorder = nullptr;
+        }
+    }
+
+    /**
+     * Scope of Lua function call, the function and arguments are on the top of stack
+     */
+    LuaCallRecorderScope(lua_State* L, int nargs)
+        : m_recorder(LuaCallRecorder::active())
+    {
+        if (m_recorder) {
+            int func = lua_gettop(L) - nargs;
+            if (!m_recorder->begin(L, LuaCallRecorder::CPP_TO_LUA, func, func + 1, nargs, m_frame)) {
+                m_recorder = nullptr;
+            }
+        }
+    }
+
+    ~LuaCallRecorderScope()
+    {
+        if (m_recorder) {
+            m_recorder->end(m_frame);
+        }
+    }
+
+    LuaCallRecorderScope(const LuaCallRecorderScope&) = delete;
+    LuaCallRecorderScope& operator = (const LuaCallRecorderScope&) = delete;
+
+private:
+    LuaCallRecorder* m_recorder;
+    LuaCallRecorder::Frame m_frame;
+};
+
+//---------------------------------------------------------------------------
+
+/**
+ * Replay of the calls recorded by LuaCallRecorder, against a state with the same bindings.
+ *
+ * LuaContext lua;
+ * bindAll(lua);   // the same bindings and scripts as the recorded state
+ * LuaCallReplay replay(lua, "trace.bin");
+ * replay.run();
+ * compare(replay.recordedTime(), replay.replayedTime());
+ *
+ * By default only the top level calls are replayed, the nested calls are made again by them.
+ * The argument that can not be recorded (such as object or function) is passed to the
+ * object handler if set, it should push a substitute and return true, otherwise the call
+ * is skipped. Calls are made in protected mode, error is counted as failed call.
+ */
+class LuaCallReplay
+{
+public:
+    /**
+     * Statistics of the replayed calls of a function
+     */
+    struct Stat
+    {
+        std::string name;
+        size_t calls;
+        uint64_t recorded_ns;
+        uint64_t replayed_ns;
+    };
+
+    using ObjectHandler = std::function<bool(lua_State* L, LuaTypeID type, const char* type_name)>;
+
+    /**
+     * Load the recorded calls from file.
+     * This will throw LuaException if the file can not be read or is not recorded calls.
+     */
+    LuaCallReplay(lua_State* L, const char* path);
+    ~LuaCallReplay();
+
+    LuaCallReplay(const LuaCallReplay&) = delete;
+    LuaCallReplay& operator = (const LuaCallReplay&) = delete;
+
+    /**
+     * Set the handler to push substitute of argument that can not be recorded
+     */
+    void setObjectHandler(const ObjectHandler& handler)
+    {
+        m_handler = handler;
+    }
+
+    /**
+     * Replay the recorded calls, the statistics are accumulated if run more than once.
+     * This will throw LuaException if the file is corrupted.
+     *
+     * @param top_level_only true to replay only the calls not nested in other recorded calls
+     */
+    void run(bool top_level_only = true);
+
+    size_t replayedCalls() const
+        { return m_replayed; }
+
+    size_t skippedCalls() const
+        { return m_skipped; }
+
+    size_t failedCalls() const
+        { return m_failed; }
+
+    uint64_t recordedTime() const
+        { return m_recorded_ns; }
+
+    uint64_t replayedTime() const
+        { return m_replayed_ns; }
+
+    /**
+     * Get the error message of last failed call
+     */
+    const std::string& lastError() const
+        { return m_error; }
+
+    /**
+     * Get the statistics of each function, indexed by the recorded name id
+     */
+    const std::vector<Stat>& stats() const
+        { return m_stats; }
+
+private:
+    bool pushValue(const unsigned char*& p, int depth, bool push);
+    bool pushFunction(uint32_t name);
+    uint64_t readVarint(const unsigned char*& p);
+    void corrupted();
+
+    lua_State* L;
+    std::string m_data;
+    size_t m_start;
+    std::vector<Stat> m_stats;
+    std::vector<int> m_funcs;
+    ObjectHandler m_handler;
+    std::string m_error;
+    size_t m_replayed;
+    size_t m_skipped;
+    size_t m_failed;
+    uint64_t m_recorded_ns;
+    uint64_t m_replayed_ns;
+};
+
+#else
+
+class LuaCallRecorderScope
+{
+public:
+    explicit LuaCallRecorderScope(lua_State*) {}
+    LuaCallRecorderScope(lua_State*, int) {}
+};
+
+#endif
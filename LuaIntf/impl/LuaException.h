@@ -67,6 +67,37 @@ public:
         return 1;
     }
 
+    /**
+     * Throw LuaMemoryException for LUA_ERRMEM, or LuaException for other error,
+     * the error message is on top of stack
+     */
+    static void raise(lua_State* L, int err);
+
 private:
     std::string m_what;
 };
+
+/**
+ * Exception for Lua memory error, the allocation failed because of memory quota or out of memory
+ */
+class LuaMemoryException : public LuaException
+{
+public:
+    explicit LuaMemoryException(lua_State* L) noexcept
+        : LuaException(L)
+        {}
+
+    explicit LuaMemoryException(const char* msg) noexcept
+        : LuaException(msg)
+        {}
+};
+
+inline void LuaException::raise(lua_State* L, int err)
+{
+    LuaMetrics::addError(L, err);
+    if (err == LUA_ERRMEM) {
+        throw LuaMemoryException(L);
+    } else {
+        throw LuaException(L);
+    }
+}
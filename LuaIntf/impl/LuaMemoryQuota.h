@@ -0,0 +1,143 @@
+//
+// https://github.com/SteveKChiu/lua-intf
+//
+// Copyright 2014, Steve K. Chiu <steve.k.chiu@gmail.com>
+//
+// The MIT License (http://www.opensource.org/licenses/mit-license.php)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+//
+
+/**
+ * Allocator that enforces memory quota for Lua state.
+ *
+ * When the usage grows past the soft limit, the allocation fails once, so Lua runs emergency
+ * full GC and retries it (Lua 5.2 or later). When the usage would grow past the hard limit
+ * (after the emergency GC), the allocation fails and Lua raises memory error, this is thrown
+ * as LuaMemoryException to C++. The state stays usable after the error.
+ *
+ * Lua 5.2 only runs the emergency GC when the collector is running, so the soft limit is not
+ * enforced while the collector is stopped by gc().
+ *
+ * LuaMemoryQuota quota(64 << 20, 48 << 20);
+ * LuaState L = LuaState::newState(quota);
+ *
+ * Or use LuaContext(hard_limit, soft_limit) which owns the quota. The quota must outlive the state,
+ * and the usage can be queried from any thread.
+ */
+class LuaMemoryQuota
+{
+public:
+    /**
+     * Create memory quota, limit of 0 means unlimited
+     *
+     * @param hard_limit the allocation past this limit fails with memory error
+     * @param soft_limit the allocation past this limit triggers emergency full GC
+     * @param alloc the underlying allocator, or nullptr for realloc/free
+     * @param userdata the userdata for the underlying allocator
+     */
+    explicit LuaMemoryQuota(size_t hard_limit = 0, size_t soft_limit = 0,
+            lua_Alloc alloc = nullptr, void* userdata = nullptr);
+
+    LuaMemoryQuota(const LuaMemoryQuota&) = delete;
+    LuaMemoryQuota& operator = (const LuaMemoryQuota&) = delete;
+
+    /**
+     * Change the limits, this must be called on the thread running the state
+     */
+    void setLimits(size_t hard_limit, size_t soft_limit = 0);
+
+    size_t hardLimit() const
+    {
+        return m_hard_limit;
+    }
+
+    size_t softLimit() const
+    {
+        return m_soft_limit;
+    }
+
+    /**
+     * Get the number of bytes allocated by the state
+     */
+    size_t used() const
+    {
+        return m_used.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * Get the highest number of bytes allocated by the state
+     */
+    size_t peak() const
+    {
+        return m_peak.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * Get the number of emergency GC triggered by soft limit
+     */
+    size_t collections() const
+    {
+        return m_collections.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * Get the number of allocations refused by hard limit
+     */
+    size_t failures() const
+    {
+        return m_failures.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * Call lua_gc and keep track of whether the collector is running, this is called by
+     * LuaContext::gc and LuaState::gc. The collectgarbage("stop") in script is only noticed
+     * by the next call.
+     */
+    static int gc(lua_State* L, int what, int data);
+
+    /**
+     * The lua_Alloc function, userdata is the LuaMemoryQuota object
+     */
+    static void* allocate(void* userdata, void* ptr, size_t osize, size_t nsize);
+
+private:
+    static void* defaultAlloc(void* userdata, void* ptr, size_t osize, size_t nsize);
+
+    static void add(std::atomic<size_t>& counter, size_t n)
+    {
+        // only the state thread writes, so no read-modify-write is needed
+        counter.store(counter.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+    }
+
+private:
+    lua_Alloc m_alloc;
+    void* m_ud;
+    size_t m_hard_limit;
+    size_t m_soft_limit;
+    size_t m_trigger;
+    void* m_retry_ptr;
+    size_t m_retry_size;
+    bool m_retry;
+    bool m_gc_running;
+    std::atomic<size_t> m_used;
+    std::atomic<size_t> m_peak;
+    std::atomic<size_t> m_collections;
+    std::atomic<size_t> m_failures;
+};
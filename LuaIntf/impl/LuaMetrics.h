@@ -0,0 +1,273 @@
+//
+// https://github.com/SteveKChiu/lua-intf
+//
+// Copyright 2014, Steve K. Chiu <steve.k.chiu@gmail.com>
+//
+// The MIT License (http://www.opensource.org/licenses/mit-license.php)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+//
+
+#if LUAINTF_METRICS
+
+/**
+ * Per-state runtime metrics, the counters are cheap to update and can be sampled from any thread.
+ *
+ * LuaMetrics::attach(L, "worker-1");
+ * ...
+ * LuaMetrics::Sample s = LuaMetrics::find(L)->sample();
+ *
+ * The metrics are installed by wrapping the state allocator, so the counters are found without
+ * touching the state. LuaContext attaches the metrics to the state it creates, the other state
+ * can use attach() and detach() explicitly. If LuaReleaseQueue is also used, the metrics must be
+ * attached after the queue, and detached before the queue.
+ *
+ * The attached metrics are also listed in a process-wide registry, so the exporter can visit
+ * them with forEach() or sum them with total(), without knowing the Lua states.
+ */
+class LuaMetrics
+{
+public:
+    enum Direction
+    {
+        LUA_TO_CPP,
+        CPP_TO_LUA,
+        DIRECTIONS
+    };
+
+    enum ErrorKind
+    {
+        RUNTIME_ERROR,      // LUA_ERRRUN
+        SYNTAX_ERROR,       // LUA_ERRSYNTAX
+        MEMORY_ERROR,       // LUA_ERRMEM
+        HANDLER_ERROR,      // LUA_ERRERR, or LUA_ERRGCMM
+        FILE_ERROR,         // LUA_ERRFILE
+        CPP_EXCEPTION,      // C++ exception thrown by bound function
+        ERROR_KINDS
+    };
+
+    /**
+     * Snapshot of the counters
+     */
+    struct Sample
+    {
+        size_t bytes;               // bytes allocated by the state
+        size_t peak_bytes;          // highest bytes allocated by the state
+        size_t allocations;         // number of blocks allocated
+        size_t gc_cycles;           // number of completed GC cycles
+        std::chrono::nanoseconds gc_time;   // time spent in full GC or GC step requested by gc()
+        size_t registry_size;       // length of registry reference array, sampled every GC cycle
+        size_t live_refs;           // number of registry references held by LuaRef
+        size_t live_objects;        // number of bound C++ objects not yet collected
+        size_t created_objects;     // number of bound C++ objects pushed to Lua
+        size_t calls[DIRECTIONS];   // number of calls across Lua/C++ boundary
+        size_t errors[ERROR_KINDS]; // number of errors by kind
+
+        Sample();
+        Sample& operator += (const Sample& that);
+    };
+
+    /**
+     * Attach metrics to the state, and add it to the process-wide registry.
+     * This must be called before the state is shared with other threads.
+     */
+    static LuaMetrics* attach(lua_State* L, const std::string& name = std::string());
+
+    /**
+     * Detach metrics from the state, and remove it from the process-wide registry.
+     * This must be called before the state is closed.
+     */
+    static void detach(lua_State* L);
+
+    /**
+     * Get the metrics attached to the state, or nullptr if not attached
+     */
+    static LuaMetrics* find(lua_State* L)
+    {
+        void* ud;
+        return lua_getallocf(L, &ud) == &allocate ? static_cast<LuaMetrics*>(ud) : nullptr;
+    }
+
+    /**
+     * Get the allocator wrapped by the metrics, or the allocator itself if it is not the metrics
+     */
+    static lua_Alloc unwrap(lua_Alloc alloc, void** ud)
+    {
+        if (alloc == &allocate) {
+            LuaMetrics* metrics = static_cast<LuaMetrics*>(*ud);
+            *ud = metrics->m_ud;
+            return metrics->m_alloc;
+        }
+        return alloc;
+    }
+
+    /**
+     * Call each attached metrics, the registry is locked during the call,
+     * so the callback must not attach or detach metrics
+     */
+    static void forEach(const std::function<void(const LuaMetrics&)>& func);
+
+    /**
+     * Sum of the counters of all attached metrics
+     */
+    static Sample total();
+
+    /**
+     * Get the name given on attach or setName(), this is safe to call inside forEach()
+     */
+    const std::string& name() const
+    {
+        return m_name;
+    }
+
+    /**
+     * Change the name, for example the metrics attached by LuaContext
+     */
+    void setName(const std::string& name)
+    {
+        std::lock_guard<std::mutex> lock(attachedMutex());
+        m_name = name;
+    }
+
+    /**
+     * Read the counters, this can be called from any thread
+     */
+    Sample sample() const;
+
+    /**
+     * Call lua_gc and count the time spent
+     */
+    static int gc(lua_State* L, int what, int data);
+
+    /**
+     * Count a call across Lua/C++ boundary
+     */
+    static void addCall(lua_State* L, Direction dir)
+    {
+        LuaMetrics* metrics = find(L);
+        if (metrics) add(metrics->m_calls[dir], 1);
+    }
+
+    /**
+     * Count the error status returned by protected call
+     */
+    static void addError(lua_State* L, int err);
+
+    /**
+     * Count C++ exception converted to Lua error
+     */
+    static void addException(lua_State* L)
+    {
+        LuaMetrics* metrics = find(L);
+        if (metrics) add(metrics->m_errors[CPP_EXCEPTION], 1);
+    }
+
+    /**
+     * Count the registry reference acquired (delta = 1) or released (delta = -1) by LuaRef,
+     * this can be called from any thread
+     */
+    static void addRef(lua_State* L, int ref, int delta)
+    {
+        if (ref >= 0) {
+            LuaMetrics* metrics = find(L);
+            if (metrics) metrics->m_refs.fetch_add(size_t(delta), std::memory_order_relaxed);
+        }
+    }
+
+    /**
+     * Count the bound C++ object created (delta = 1) or destroyed (delta = -1)
+     */
+    static void addObject(lua_State* L, int delta)
+    {
+        LuaMetrics* metrics = find(L);
+        if (metrics) {
+            add(metrics->m_objects, size_t(delta));
+            if (delta > 0) add(metrics->m_created_objects, 1);
+        }
+    }
+
+private:
+    LuaMetrics(lua_Alloc alloc, void* ud, const std::string& name);
+
+    LuaMetrics(const LuaMetrics&) = delete;
+    LuaMetrics& operator = (const LuaMetrics&) = delete;
+
+    static void* allocate(void* ud, void* ptr, size_t osize, size_t nsize);
+    static void pushSentinel(lua_State* L);
+    static int collectSentinel(lua_State* L);
+    static std::vector<LuaMetrics*>& attached();
+    static std::mutex& attachedMutex();
+
+    static void add(std::atomic<size_t>& counter, size_t n)
+    {
+        // only the state thread writes, so no read-modify-write is needed
+        counter.store(counter.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+    }
+
+    static size_t load(const std::atomic<size_t>& counter)
+    {
+        return counter.load(std::memory_order_relaxed);
+    }
+
+private:
+    lua_Alloc m_alloc;
+    void* m_ud;
+    std::string m_name;
+    std::atomic<size_t> m_bytes;
+    std::atomic<size_t> m_peak_bytes;
+    std::atomic<size_t> m_allocations;
+    std::atomic<size_t> m_gc_cycles;
+    std::atomic<std::chrono::nanoseconds::rep> m_gc_time;
+    std::atomic<size_t> m_registry_size;
+    std::atomic<size_t> m_refs;
+    std::atomic<size_t> m_objects;
+    std::atomic<size_t> m_created_objects;
+    std::atomic<size_t> m_calls[DIRECTIONS];
+    std::atomic<size_t> m_errors[ERROR_KINDS];
+};
+
+#else
+
+class LuaMetrics
+{
+public:
+    enum Direction
+    {
+        LUA_TO_CPP,
+        CPP_TO_LUA
+    };
+
+    static lua_Alloc unwrap(lua_Alloc alloc, void**)
+    {
+        return alloc;
+    }
+
+    static int gc(lua_State* L, int what, int data)
+    {
+        return lua_gc(L, what, data);
+    }
+
+    static void addCall(lua_State*, Direction) {}
+    static void addError(lua_State*, int) {}
+    static void addException(lua_State*) {}
+    static void addRef(lua_State*, int, int) {}
+    static void addObject(lua_State*, int) {}
+};
+
+#endif
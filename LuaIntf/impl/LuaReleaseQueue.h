@@ -0,0 +1,158 @@
+//
+// https://github.com/SteveKChiu/lua-intf
+//
+// Copyright 2014, Steve K. Chiu <steve.k.chiu@gmail.com>
+//
+// The MIT License (http://www.opensource.org/licenses/mit-license.php)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+//
+
+#if LUAINTF_DEFERRED_UNREF
+
+/**
+ * Per-state queue of registry references released by threads other than the owner thread.
+ *
+ * When LuaRef (or LuaTableRef) is destroyed off the owner thread, the reference id is pushed onto
+ * a lock-free queue instead of calling luaL_unref, and the owner thread releases them later at
+ * safe points: LuaRef call into Lua, every GC cycle, or drain() explicitly. So C++ worker thread
+ * can hold and drop Lua references without locking the interpreter.
+ *
+ * The queue is installed by wrapping the state allocator, so it can be found from any thread
+ * (or coroutine of the state) without touching the state. LuaContext attaches the queue to the
+ * state it creates, the other state can use attach() and detach() explicitly.
+ *
+ * Only destruction (or reset to nil) and move of LuaRef are allowed off the owner thread,
+ * the other operations still need exclusive access to the state.
+ */
+class LuaReleaseQueue
+{
+public:
+    /**
+     * Attach release queue to the state, the calling thread becomes the owner thread.
+     * This must be called before the state is shared with other threads.
+     */
+    static void attach(lua_State* L);
+
+    /**
+     * Release the pending references and detach the queue from the state, this must be
+     * called on the owner thread before the state is closed.
+     */
+    static void detach(lua_State* L);
+
+    /**
+     * Change the owner thread, for example if the state is moved to another thread.
+     * If the owner is std::thread::id(), every release is queued until the next drain.
+     */
+    static void setOwner(lua_State* L, std::thread::id owner = std::this_thread::get_id());
+
+    /**
+     * Release the pending references, this must be called by the thread running the state.
+     */
+    static void drain(lua_State* L);
+
+    /**
+     * Release the pending references if there is any, this is cheap if the queue is empty.
+     */
+    static void poll(lua_State* L)
+    {
+        LuaReleaseQueue* queue = find(L);
+        if (queue && queue->m_head.load(std::memory_order_relaxed)) {
+            queue->release(L);
+        }
+    }
+
+    /**
+     * Release the reference, or push it onto the queue if called off the owner thread.
+     */
+    static void unref(lua_State* L, int ref)
+    {
+        if (ref >= 0) {
+            LuaReleaseQueue* queue = find(L);
+            if (queue && queue->m_owner.load(std::memory_order_relaxed) != std::this_thread::get_id()) {
+                queue->push(ref);
+            } else {
+                luaL_unref(L, LUA_REGISTRYINDEX, ref);
+            }
+        }
+    }
+
+    /**
+     * Get the allocator wrapped by the queue, or the allocator itself if it is not the queue
+     */
+    static lua_Alloc unwrap(lua_Alloc alloc, void** ud)
+    {
+        if (alloc == &allocate) {
+            LuaReleaseQueue* queue = static_cast<LuaReleaseQueue*>(*ud);
+            *ud = queue->m_ud;
+            return queue->m_alloc;
+        }
+        return alloc;
+    }
+
+private:
+    struct Node
+    {
+        int ref;
+        Node* next;
+    };
+
+    LuaReleaseQueue(lua_Alloc alloc, void* ud);
+    ~LuaReleaseQueue();
+
+    static LuaReleaseQueue* find(lua_State* L)
+    {
+        void* ud;
+        lua_Alloc alloc = LuaMetrics::unwrap(lua_getallocf(L, &ud), &ud);
+        return alloc == &allocate ? static_cast<LuaReleaseQueue*>(ud) : nullptr;
+    }
+
+    static void* allocate(void* ud, void* ptr, size_t osize, size_t nsize);
+    static void pushSentinel(lua_State* L);
+    static int collectSentinel(lua_State* L);
+
+    void push(int ref);
+    void release(lua_State* L);
+
+private:
+    std::atomic<Node*> m_head;
+    std::atomic<std::thread::id> m_owner;
+    lua_Alloc m_alloc;
+    void* m_ud;
+};
+
+#else
+
+class LuaReleaseQueue
+{
+public:
+    static void poll(lua_State*) {}
+
+    static void unref(lua_State* L, int ref)
+    {
+        luaL_unref(L, LUA_REGISTRYINDEX, ref);
+    }
+
+    static lua_Alloc unwrap(lua_Alloc alloc, void**)
+    {
+        return alloc;
+    }
+};
+
+#endif
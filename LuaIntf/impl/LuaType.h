@@ -324,6 +324,8 @@ struct LuaTypeMapping <std::string>
         lua_pushlstring(L, str.data(), str.length());
     }
 
+    static void push(lua_State* L, std::string&& str);
+
     static std::string get(lua_State* L, int index)
     {
         size_t len;
@@ -337,6 +339,31 @@ struct LuaTypeMapping <std::string>
     }
 };
 
+#if LUAINTF_ARG_ARENA
+
+template <>
+struct LuaTypeMapping <std::pmr::string>
+{
+    static void push(lua_State* L, const std::pmr::string& str)
+    {
+        lua_pushlstring(L, str.data(), str.length());
+    }
+
+    static std::pmr::string get(lua_State* L, int index)
+    {
+        size_t len;
+        const char* p = luaL_checklstring(L, index, &len);
+        return std::pmr::string(p, len, CppArgArena::resource());
+    }
+
+    static std::pmr::string opt(lua_State* L, int index, const std::pmr::string& def)
+    {
+        return lua_isnoneornil(L, index) ? def : get(L, index);
+    }
+};
+
+#endif
+
 //---------------------------------------------------------------------------
 
 #if LUAINTF_STD_WIDE_STRING
@@ -379,30 +406,52 @@ struct LuaTypeMapping <std::basic_string<CH>>
 /**
  * Transitient string type without copying underlying char values, use with caution.
  * It works like const char* with length field.
+ *
+ * If release function is given, the buffer is handed over to Lua when pushed, and
+ * release(owner, data, size + 1, 0) is called when Lua no longer needs it. The buffer must be
+ * null-terminated and not modified afterward; with Lua 5.5 or later it is not copied.
+ * Such string must be pushed exactly once.
  */
 struct LuaString
 {
     constexpr LuaString()
         : data(nullptr)
         , size(0)
+        , release(nullptr)
+        , owner(nullptr)
         {}
 
     LuaString(const std::string& str)
         : data(str.data())
         , size(str.size())
+        , release(nullptr)
+        , owner(nullptr)
         {}
 
     LuaString(const char* str)
         : data(str)
         , size(std::strlen(str))
+        , release(nullptr)
+        , owner(nullptr)
         {}
 
     LuaString(const char* str, size_t len)
         : data(str)
         , size(len)
+        , release(nullptr)
+        , owner(nullptr)
+        {}
+
+    LuaString(const char* str, size_t len, lua_Alloc release_func, void* release_owner)
+        : data(str)
+        , size(len)
+        , release(release_func)
+        , owner(release_owner)
         {}
 
     LuaString(lua_State* L, int index)
+        : release(nullptr)
+        , owner(nullptr)
     {
         data = luaL_checklstring(L, index, &size);
     }
@@ -414,6 +463,8 @@ struct LuaString
 
     const char* data;
     size_t size;
+    lua_Alloc release;
+    void* owner;
 };
 
 template <>
@@ -421,10 +472,12 @@ struct LuaTypeMapping <LuaString>
 {
     static void push(lua_State* L, const LuaString& str)
     {
-        if (str.data) {
-            lua_pushlstring(L, str.data, str.size);
-        } else {
+        if (!str.data) {
             lua_pushnil(L);
+        } else if (str.release) {
+            lua_pushexternalstring(L, str.data, str.size, str.release, str.owner);
+        } else {
+            lua_pushlstring(L, str.data, str.size);
         }
     }
 
@@ -441,6 +494,107 @@ struct LuaTypeMapping <LuaString>
 
 //---------------------------------------------------------------------------
 
+/**
+ * Immutable string with shared buffer, the buffer is reference counted and can be shared by
+ * C++ and Lua. With Lua 5.5 or later, the large string is pushed without copying, and the Lua string
+ * holds a reference to the buffer until it is collected. It is useful to hand over large payload
+ * (such as file contents or request body) to Lua.
+ */
+class LuaSharedString
+{
+public:
+    LuaSharedString() = default;
+
+    LuaSharedString(std::string str)
+        : m_buf(std::make_shared<const std::string>(std::move(str)))
+        {}
+
+    LuaSharedString(std::shared_ptr<const std::string> buf)
+        : m_buf(std::move(buf))
+        {}
+
+    LuaSharedString(lua_State* L, int index)
+    {
+        size_t len;
+        const char* p = luaL_checklstring(L, index, &len);
+        m_buf = std::make_shared<const std::string>(p, len);
+    }
+
+    explicit operator bool () const
+    {
+        return m_buf != nullptr;
+    }
+
+    const char* data() const
+    {
+        return m_buf ? m_buf->data() : nullptr;
+    }
+
+    size_t size() const
+    {
+        return m_buf ? m_buf->size() : 0;
+    }
+
+    const std::shared_ptr<const std::string>& buffer() const
+    {
+        return m_buf;
+    }
+
+private:
+    std::shared_ptr<const std::string> m_buf;
+};
+
+template <>
+struct LuaTypeMapping <LuaSharedString>
+{
+    static void push(lua_State* L, const LuaSharedString& str);
+
+    static LuaSharedString get(lua_State* L, int index)
+    {
+        return LuaSharedString(L, index);
+    }
+
+    static LuaSharedString opt(lua_State* L, int index, const LuaSharedString& def)
+    {
+        return lua_isnoneornil(L, index) ? def : LuaSharedString(L, index);
+    }
+};
+
+//---------------------------------------------------------------------------
+
+/**
+ * String with static lifetime (such as string literal or static name table), use with caution.
+ * The interned Lua string is cached per Lua state and keyed by the address of the string,
+ * so pushing the same string again is only a pointer lookup, without strlen, hashing or
+ * string interning. The address must always refer to the same content for the lifetime of Lua state.
+ * This type can only be pushed onto Lua stack.
+ */
+struct LuaStaticString
+{
+    constexpr LuaStaticString()
+        : data(nullptr)
+        {}
+
+    constexpr LuaStaticString(const char* str)
+        : data(str)
+        {}
+
+    explicit operator bool () const
+    {
+        return data != nullptr;
+    }
+
+    const char* data;
+};
+
+template <>
+struct LuaTypeMapping <LuaStaticString>
+{
+    static void push(lua_State* L, const LuaStaticString& str);
+};
+
+//---------------------------------------------------------------------------
+
 /**
  * Default type mapping to catch all enum conversion
  */
@@ -464,6 +618,147 @@ struct LuaTypeMapping <T, typename std::enable_if<std::is_enum<T>::value>::type>
 
 //---------------------------------------------------------------------------
 
+/**
+ * The name of enum value, used by LUA_USING_ENUM_NAMES
+ */
+template <typename E>
+struct LuaEnumName
+{
+    E value;
+    const char* name;
+};
+
+/**
+ * Lookup table between enum value and name, the name is looked up by perfect hashing
+ * (hash and displace), so it only costs two hashes and one string compare.
+ * The names must have static lifetime.
+ */
+class LuaEnumNameTable
+{
+public:
+    /**
+     * Build the table, the names must be unique, but the values can have alias.
+     *
+     * @throw LuaException if the names are not unique
+     */
+    LuaEnumNameTable(const lua_Integer* values, const char* const* names, size_t count);
+
+    /**
+     * Find the enum value by name.
+     *
+     * @return true if the name is found
+     */
+    bool find(const char* name, size_t len, lua_Integer& value) const;
+
+    /**
+     * Find the name by enum value, if the value has alias, the first declared name is returned.
+     *
+     * @return the name or nullptr if not found
+     */
+    const char* name(lua_Integer value) const;
+
+private:
+    static uint32_t hash(const char* s, size_t len, uint32_t seed);
+
+private:
+    struct Entry
+    {
+        lua_Integer value;
+        const char* name;
+        size_t len;
+    };
+
+    std::vector<Entry> m_entries;
+    std::vector<uint32_t> m_seeds;
+    std::vector<int> m_slots;
+    std::vector<int> m_sorted;
+    bool m_dense;
+};
+
+/**
+ * Enum type mapping by name, please use LUA_USING_ENUM_NAMES instead of using this directly.
+ * The enum value is pushed as interned name (see LuaStaticString), and the name
+ * or integer value are both accepted when getting from Lua.
+ */
+template <typename MAPPING, typename E>
+struct LuaEnumNameMapping
+{
+    static const LuaEnumNameTable& table()
+    {
+        static const LuaEnumNameTable t = build();
+        return t;
+    }
+
+    static void push(lua_State* L, E value)
+    {
+        const char* name = table().name(static_cast<lua_Integer>(value));
+        if (name) {
+            LuaTypeMapping<LuaStaticString>::push(L, name);
+        } else {
+            lua_pushinteger(L, static_cast<lua_Integer>(value));
+        }
+    }
+
+    static E get(lua_State* L, int index)
+    {
+        if (lua_type(L, index) == LUA_TSTRING) {
+            size_t len;
+            const char* name = lua_tolstring(L, index, &len);
+            lua_Integer value;
+            if (!table().find(name, len, value)) {
+                luaL_argerror(L, index, lua_pushfstring(L, "invalid enum name '%s'", name));
+            }
+            return static_cast<E>(value);
+        }
+        return static_cast<E>(luaL_checkinteger(L, index));
+    }
+
+    static E opt(lua_State* L, int index, E def)
+    {
+        return lua_isnoneornil(L, index) ? def : get(L, index);
+    }
+
+private:
+    static LuaEnumNameTable build()
+    {
+        size_t count;
+        const LuaEnumName<E>* list = MAPPING::names(count);
+        std::vector<lua_Integer> values(count);
+        std::vector<const char*> names(count);
+        for (size_t i = 0; i < count; i++) {
+            values[i] = static_cast<lua_Integer>(list[i].value);
+            names[i] = list[i].name;
+        }
+        return LuaEnumNameTable(values.data(), names.data(), count);
+    }
+};
+
+/**
+ * Map enum to Lua string by name, this must be used inside namespace LuaIntf
+ * and before the enum type is used by any binding:
+ *
+ * enum class Color { RED, GREEN, BLUE };
+ *
+ * namespace LuaIntf
+ * {
+ *     LUA_USING_ENUM_NAMES(Color, {Color::RED, "red"}, {Color::GREEN, "green"}, {Color::BLUE, "blue"})
+ * }
+ */
+#define LUA_USING_ENUM_NAMES(E, ...) \
+    template <> \
+    struct LuaTypeMapping <E> \
+        : LuaEnumNameMapping <LuaTypeMapping <E>, E> \
+    { \
+        static const LuaEnumName<E>* names(size_t& count) \
+        { \
+            static const LuaEnumName<E> list[] = { __VA_ARGS__ }; \
+            count = sizeof(list) / sizeof(list[0]); \
+            return list; \
+        } \
+    };
+
+//---------------------------------------------------------------------------
+
 /**
  * Template for list container type
  */
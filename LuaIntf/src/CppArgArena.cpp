@@ -0,0 +1,87 @@
+//
+// https://github.com/SteveKChiu/lua-intf
+//
+// Copyright 2014, Steve K. Chiu <steve.k.chiu@gmail.com>
+//
+// The MIT License (http://www.opensource.org/licenses/mit-license.php)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+//
+
+#ifndef LUAINTF_H
+    #include "LuaIntf/LuaIntf.h"
+    using namespace LuaIntf;
+#endif
+
+//---------------------------------------------------------------------------
+
+#if LUAINTF_ARG_ARENA
+
+LUA_INLINE CppArgArena::CppArgArena()
+    : m_chunk(0)
+    , m_offset(0)
+    , m_active(false)
+    , m_resource(this)
+{}
+
+LUA_INLINE CppArgArena::~CppArgArena()
+{
+    for (auto& chunk : m_chunks) {
+        ::operator delete(chunk.data);
+    }
+}
+
+LUA_INLINE CppArgArena& CppArgArena::current()
+{
+    static thread_local CppArgArena arena;
+    return arena;
+}
+
+LUA_INLINE std::pmr::memory_resource* CppArgArena::resource()
+{
+    CppArgArena& arena = current();
+    return arena.m_active ? &arena.m_resource : std::pmr::get_default_resource();
+}
+
+LUA_INLINE void* CppArgArena::allocate(size_t size, size_t align)
+{
+    for (;;) {
+        if (m_chunk < m_chunks.size()) {
+            Chunk& chunk = m_chunks[m_chunk];
+            uintptr_t base = reinterpret_cast<uintptr_t>(chunk.data);
+            uintptr_t p = (base + m_offset + align - 1) & ~uintptr_t(align - 1);
+            if (p + size <= base + chunk.size) {
+                m_offset = p + size - base;
+                return reinterpret_cast<void*>(p);
+            }
+
+            // try next chunk, the rest of this chunk is wasted until rewound
+            m_chunk++;
+            m_offset = 0;
+        } else {
+            // no more chunk, the oversized chunk is also kept for next call
+            size_t n = std::max(CHUNK_SIZE, size + align);
+            m_chunks.push_back(Chunk { static_cast<unsigned char*>(::operator new(n)), n });
+            m_chunk = m_chunks.size() - 1;
+            m_offset = 0;
+        }
+    }
+}
+
+#endif
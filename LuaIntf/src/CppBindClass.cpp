@@ -37,7 +37,10 @@ LUA_INLINE int CppBindClassMetaMethod::index(lua_State* L)
     // <SP:2> -> key
 
     // get signature metatable -> <mt> <sign_mt>
-    lua_getmetatable(L, 1);
+    if (!CppObject::getMetaTable(L, 1)) {
+        return luaL_error(L, "invalid object or stale handle found when try to get property '%s'",
+            lua_tostring(L, 2));
+    }
     lua_rawgetp(L, -1, CppSignature<CppObject>::value());
     lua_rawget(L, LUA_REGISTRYINDEX);
 
@@ -114,7 +117,7 @@ LUA_INLINE int CppBindClassMetaMethod::index(lua_State* L)
         if (lua_isnil(L, -1)) {
 
 #if LUAINTF_EXTRA_LUA_FIELDS
-            if (lua_isuserdata(L, 1)) {
+            if (lua_type(L, 1) == LUA_TUSERDATA) {
                 lua_getuservalue(L, 1);
                 if (!lua_isnil(L, -1)) {
                     // get extra_fields[key] -> <mt> <nil> <extra_fields> <extra_fields[key]>
@@ -143,7 +146,10 @@ LUA_INLINE int CppBindClassMetaMethod::newIndex(lua_State* L)
     // <SP:3> -> value
 
     // get signature metatable -> <mt> <sign_mt>
-    lua_getmetatable(L, 1);
+    if (!CppObject::getMetaTable(L, 1)) {
+        return luaL_error(L, "invalid object or stale handle found when try to set property '%s'",
+            lua_tostring(L, 2));
+    }
     lua_rawgetp(L, -1, CppSignature<CppObject>::value());
     lua_rawget(L, LUA_REGISTRYINDEX);
 
@@ -210,11 +216,15 @@ LUA_INLINE int CppBindClassMetaMethod::newIndex(lua_State* L)
         if (lua_isnil(L, -1)) {
 
 #if LUAINTF_EXTRA_LUA_FIELDS
-            if (lua_isuserdata(L, 1)) {
+            if (lua_type(L, 1) == LUA_TUSERDATA) {
                 // set instance fields
+#if LUAINTF_UNIFIED_CONST_METATABLE
+                if (!CppObject::isConst(L, 1)) {
+#else
                 lua_pushliteral(L, "___const");
                 lua_rawget(L, -3);
                 if (!lua_rawequal(L, -1, -3)) {
+#endif
                     // set field only if not const
                     lua_getuservalue(L, 1);
                     if (lua_isnil(L, -1)) {
@@ -230,8 +240,10 @@ LUA_INLINE int CppBindClassMetaMethod::newIndex(lua_State* L)
                     }
                     break;
                 }
+#if !LUAINTF_UNIFIED_CONST_METATABLE
                 lua_pop(L, 1);
-            } else {
+#endif
+            } else if (lua_istable(L, 1)) {
                 // set class fields
                 lua_pushvalue(L, 2);
                 lua_pushvalue(L, 3);
@@ -261,12 +273,203 @@ LUA_INLINE int CppBindClassMetaMethod::errorReadOnly(lua_State* L)
         lua_tostring(L, lua_upvalueindex(1)));
 }
 
+#if LUAINTF_UNIFIED_CONST_METATABLE
+
+LUA_INLINE int CppBindClassMetaMethod::getByConst(lua_State* L)
+{
+    // <SP:1> -> userdata
+    lua_pushvalue(L, lua_upvalueindex(CppObject::isConst(L, 1) ? 2 : 1));
+    lua_insert(L, 1);
+    lua_call(L, lua_gettop(L) - 1, 1);
+    return 1;
+}
+
+#endif
+
 LUA_INLINE int CppBindClassMetaMethod::errorConstMismatch(lua_State* L)
 {
     return luaL_error(L, "member function '%s' can not be access by const object",
         lua_tostring(L, lua_upvalueindex(1)));
 }
 
+#if LUAINTF_BULK_PROPERTY_ACCESS
+
+LUA_INLINE void CppBindClassMetaMethod::checkMetaTable(lua_State* L, const char* op)
+{
+    // get signature metatable -> <mt> <sign_mt>
+    if (!lua_isuserdata(L, 1) || !CppObject::getMetaTable(L, 1)) {
+        luaL_error(L, "invalid object or stale handle found when try to %s properties", op);
+    }
+    lua_rawgetp(L, -1, CppSignature<CppObject>::value());
+    lua_rawget(L, LUA_REGISTRYINDEX);
+
+    // check if both are equal
+    if (!lua_rawequal(L, -1, -2)) {
+        lua_pushliteral(L, "___type");
+        lua_rawget(L, -3);
+        luaL_error(L, "invalid meta table found when try to %s properties of '%s'",
+            op, luaL_optstring(L, -1, "<unknown>"));
+    }
+
+    // matched, pop <sign_mt> -> <mt>
+    lua_pop(L, 1);
+}
+
+LUA_INLINE bool CppBindClassMetaMethod::pushAccessor(lua_State* L, int mt, int key, const char* field)
+{
+    // walk the super chain -> <accessors[key]> or <nil>
+    key = lua_absindex(L, key);
+    lua_pushvalue(L, mt);
+    for (;;) {
+        lua_pushstring(L, field);
+        lua_rawget(L, -2);
+        assert(lua_istable(L, -1));
+        lua_pushvalue(L, key);
+        lua_rawget(L, -2);
+
+        if (!lua_isnil(L, -1)) {
+            lua_replace(L, -3);
+            lua_pop(L, 1);
+            return true;
+        }
+
+        lua_pop(L, 2);
+        lua_pushliteral(L, "___super");
+        lua_rawget(L, -2);
+        lua_remove(L, -2);
+
+        if (lua_isnil(L, -1)) {
+            return false;
+        }
+    }
+}
+
+LUA_INLINE void CppBindClassMetaMethod::pushFields(lua_State* L, int mt)
+{
+    // the getters of this class only, cached as { name1, getter1, name2, getter2, ... }
+    lua_pushliteral(L, "___fields");
+    lua_rawget(L, mt);
+    if (!lua_isnil(L, -1)) return;
+    lua_pop(L, 1);
+
+    lua_newtable(L);
+    lua_pushliteral(L, "___getters");
+    lua_rawget(L, mt);
+    assert(lua_istable(L, -1));
+
+    int n = 0;
+    lua_pushnil(L);
+    while (lua_next(L, -2)) {
+        lua_pushvalue(L, -2);
+        lua_rawseti(L, -5, ++n);
+        lua_rawseti(L, -4, ++n);
+    }
+    lua_pop(L, 1);
+
+    lua_pushliteral(L, "___fields");
+    lua_pushvalue(L, -2);
+    lua_rawset(L, mt);
+}
+
+LUA_INLINE int CppBindClassMetaMethod::toTable(lua_State* L)
+{
+    // <SP:1> -> userdata
+    // <SP:2> -> array of property names or nil
+    lua_settop(L, 2);
+    checkMetaTable(L, "get");
+    int mt = lua_gettop(L);
+
+    if (!lua_isnoneornil(L, 2)) {
+        luaL_checktype(L, 2, LUA_TTABLE);
+        int n = int(lua_rawlen(L, 2));
+        lua_createtable(L, 0, n);
+        int result = lua_gettop(L);
+
+        for (int i = 1; i <= n; i++) {
+            lua_rawgeti(L, 2, i);
+            if (!pushAccessor(L, mt, -1, "___getters")) {
+                lua_pushliteral(L, "___type");
+                lua_rawget(L, mt);
+                return luaL_error(L, "property '%s.%s' is not found",
+                    luaL_optstring(L, -1, "<unknown>"), lua_tostring(L, result + 1));
+            }
+            if (lua_iscfunction(L, -1)) {
+                lua_pushvalue(L, 1);
+                lua_call(L, 1, 1);
+            }
+            lua_rawset(L, result);
+        }
+        return 1;
+    }
+
+    // collect the cached getters from base class to this class -> <mt> <fields>...
+    int size = 0;
+    lua_pushvalue(L, mt);
+    for (;;) {
+        luaL_checkstack(L, 2, nullptr);
+        pushFields(L, lua_gettop(L));
+        size += int(lua_rawlen(L, -1)) / 2;
+        lua_replace(L, -2);
+
+        lua_pushliteral(L, "___super");
+        lua_rawget(L, mt);
+        if (lua_isnil(L, -1)) {
+            lua_pop(L, 1);
+            break;
+        }
+        lua_replace(L, mt);
+        lua_pushvalue(L, mt);
+    }
+    int last = lua_gettop(L);
+
+    // the getters of derived class are read last, so they override the base class
+    lua_createtable(L, 0, size);
+    for (int level = last; level > mt; level--) {
+        int n = int(lua_rawlen(L, level));
+        for (int i = 1; i < n; i += 2) {
+            lua_rawgeti(L, level, i);
+            lua_rawgeti(L, level, i + 1);
+            if (lua_iscfunction(L, -1)) {
+                lua_pushvalue(L, 1);
+                lua_call(L, 1, 1);
+            }
+            lua_rawset(L, -3);
+        }
+    }
+    return 1;
+}
+
+LUA_INLINE int CppBindClassMetaMethod::assign(lua_State* L)
+{
+    // <SP:1> -> userdata
+    // <SP:2> -> table of property values
+    lua_settop(L, 2);
+    luaL_checktype(L, 2, LUA_TTABLE);
+    checkMetaTable(L, "set");
+    int mt = lua_gettop(L);
+
+    // stack: <mt> <key> <value> <setter>
+    lua_pushnil(L);
+    while (lua_next(L, 2)) {
+        if (lua_type(L, -2) != LUA_TSTRING || !pushAccessor(L, mt, -2, "___setters")
+            || !lua_iscfunction(L, -1))
+        {
+            const char* key = luaL_tolstring(L, mt + 1, nullptr);
+            lua_pushliteral(L, "___type");
+            lua_rawget(L, mt);
+            return luaL_error(L, "property '%s.%s' is not found or not writable",
+                luaL_optstring(L, -1, "<unknown>"), key);
+        }
+        lua_pushvalue(L, 1);
+        lua_pushvalue(L, -3);
+        lua_call(L, 2, 0);
+        lua_pop(L, 1);
+    }
+    return 0;
+}
+
+#endif
+
 //---------------------------------------------------------------------------
 
 LUA_INLINE bool CppBindClassBase::buildMetaTable(LuaRef& meta, LuaRef& parent, const char* name,
@@ -285,6 +488,20 @@ LUA_INLINE bool CppBindClassBase::buildMetaTable(LuaRef& meta, LuaRef& parent, c
     LuaRef type_clazz = LuaRef::fromPtr(L, clazz_id);
     LuaRef type_static = LuaRef::fromPtr(L, static_id);
 
+#if LUAINTF_UNIFIED_CONST_METATABLE
+    // const object shares the class metatable, and has the same signature
+    LuaRef clazz = LuaRef::createTable(L);
+    clazz.setMetaTable(clazz);
+    clazz.rawset("__index", &CppBindClassMetaMethod::index);
+    clazz.rawset("__newindex", &CppBindClassMetaMethod::newIndex);
+    clazz.rawset("___getters", LuaRef::createTable(L));
+    clazz.rawset("___setters", LuaRef::createTable(L));
+    clazz.rawset("___type", type_name);
+    clazz.rawset("___const", clazz);
+    clazz.rawsetp(CppSignature<CppObject>::value(), type_clazz);
+
+    LuaRef clazz_const = clazz;
+#else
     LuaRef clazz_const = LuaRef::createTable(L);
     clazz_const.setMetaTable(clazz_const);
     clazz_const.rawset("__index", &CppBindClassMetaMethod::index);
@@ -304,6 +521,7 @@ LUA_INLINE bool CppBindClassBase::buildMetaTable(LuaRef& meta, LuaRef& parent, c
     clazz.rawset("___type", type_name);
     clazz.rawset("___const", clazz_const);
     clazz.rawsetp(CppSignature<CppObject>::value(), type_clazz);
+#endif
 
     LuaRef clazz_static = LuaRef::createTable(L);
     clazz_static.setMetaTable(clazz_static);
@@ -317,9 +535,21 @@ LUA_INLINE bool CppBindClassBase::buildMetaTable(LuaRef& meta, LuaRef& parent, c
     clazz_static.rawset("___parent", parent);
     clazz_static.rawsetp(CppSignature<CppObject>::value(), type_static);
 
+#if !LUAINTF_UNIFIED_CONST_METATABLE
     clazz_const.rawset("class", clazz_static);
+#endif
     clazz.rawset("class", clazz_static);
 
+#if LUAINTF_BULK_PROPERTY_ACCESS
+    clazz.rawset("toTable", &CppBindClassMetaMethod::toTable);
+    clazz.rawset("assign", &CppBindClassMetaMethod::assign);
+#if !LUAINTF_UNIFIED_CONST_METATABLE
+    clazz_const.rawset("toTable", &CppBindClassMetaMethod::toTable);
+    clazz_const.rawset("assign", LuaRef::createFunctionWith(L, &CppBindClassMetaMethod::errorConstMismatch,
+        type_name + ".assign"));
+#endif
+#endif
+
     LuaRef registry(L, LUA_REGISTRYINDEX);
     registry.rawset(type_clazz, clazz);
     registry.rawset(type_const, clazz_const);
@@ -338,7 +568,17 @@ LUA_INLINE bool CppBindClassBase::buildMetaTable(LuaRef& meta, LuaRef& parent, c
         LuaRef super = registry.rawgetp(super_static_id);
         meta.rawset("___super", super);
         meta.rawget("___class").rawset("___super", super.rawget("___class"));
+#if !LUAINTF_UNIFIED_CONST_METATABLE
         meta.rawget("___const").rawset("___super", super.rawget("___const"));
+#endif
+
+#if LUAINTF_BULK_PROPERTY_ACCESS
+        // inherit from the base class, so the member functions of base class with the same name are visible
+        meta.rawget("___class").rawset("toTable", nullptr);
+        meta.rawget("___class").rawset("assign", nullptr);
+        meta.rawget("___const").rawset("toTable", nullptr);
+        meta.rawget("___const").rawset("assign", nullptr);
+#endif
         return true;
     }
     return false;
@@ -362,8 +602,23 @@ LUA_INLINE void CppBindClassBase::setStaticReadOnly(const char* name)
 
 LUA_INLINE void CppBindClassBase::setMemberGetter(const char* name, const LuaRef& getter, const LuaRef& getter_const)
 {
+#if LUAINTF_UNIFIED_CONST_METATABLE
+    LuaRef getters = m_meta.rawget("___class").rawget("___getters");
+    if (getter.isIdenticalTo(getter_const)) {
+        getters.rawset(name, getter);
+    } else {
+        getters.rawset(name, LuaRef::createFunctionWith(state(), &CppBindClassMetaMethod::getByConst, getter, getter_const));
+    }
+#else
     m_meta.rawget("___class").rawget("___getters").rawset(name, getter);
     m_meta.rawget("___const").rawget("___getters").rawset(name, getter_const);
+#endif
+
+#if LUAINTF_BULK_PROPERTY_ACCESS
+    // invalidate the cached getters for toTable
+    m_meta.rawget("___class").rawset("___fields", nullptr);
+    m_meta.rawget("___const").rawset("___fields", nullptr);
+#endif
 }
 
 LUA_INLINE void CppBindClassBase::setMemberGetter(const char* name, const LuaRef& getter)
@@ -373,12 +628,17 @@ LUA_INLINE void CppBindClassBase::setMemberGetter(const char* name, const LuaRef
 
 LUA_INLINE void CppBindClassBase::setMemberSetter(const char* name, const LuaRef& setter)
 {
+#if LUAINTF_UNIFIED_CONST_METATABLE
+    // the setter checks the constness of object
+    m_meta.rawget("___class").rawget("___setters").rawset(name, setter);
+#else
     LuaRef meta_class = m_meta.rawget("___class");
     LuaRef meta_const = m_meta.rawget("___const");
     std::string full_name = CppBindModuleBase::getMemberName(meta_class, name);
     LuaRef err = LuaRef::createFunctionWith(state(), &CppBindClassMetaMethod::errorConstMismatch, full_name);
     meta_class.rawget("___setters").rawset(name, setter);
     meta_const.rawget("___setters").rawset(name, err);
+#endif
 }
 
 LUA_INLINE void CppBindClassBase::setMemberReadOnly(const char* name)
@@ -388,11 +648,18 @@ LUA_INLINE void CppBindClassBase::setMemberReadOnly(const char* name)
     std::string full_name = CppBindModuleBase::getMemberName(meta_class, name);
     LuaRef err = LuaRef::createFunctionWith(state(), &CppBindClassMetaMethod::errorReadOnly, full_name);
     meta_class.rawget("___setters").rawset(name, err);
+#if !LUAINTF_UNIFIED_CONST_METATABLE
     meta_const.rawget("___setters").rawset(name, err);
+#endif
 }
 
 LUA_INLINE void CppBindClassBase::setMemberFunction(const char* name, const LuaRef& proc, bool is_const)
 {
+#if LUAINTF_UNIFIED_CONST_METATABLE
+    // the non-const function checks the constness of object
+    (void)is_const;
+    m_meta.rawget("___class").rawset(name, proc);
+#else
     LuaRef meta_class = m_meta.rawget("___class");
     LuaRef meta_const = m_meta.rawget("___const");
     meta_class.rawset(name, proc);
@@ -403,4 +670,5 @@ LUA_INLINE void CppBindClassBase::setMemberFunction(const char* name, const LuaR
         LuaRef err = LuaRef::createFunctionWith(state(), &CppBindClassMetaMethod::errorConstMismatch, full_name);
         meta_const.rawset(name, err);
     }
+#endif
 }
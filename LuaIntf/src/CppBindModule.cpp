@@ -119,6 +119,33 @@ LUA_INLINE int CppBindModuleMetaMethod::errorReadOnly(lua_State* L)
 
 //---------------------------------------------------------------------------
 
+LUA_INLINE LuaRef CppBindBulk::create(lua_State* L, const LuaRef& call, const LuaRef& map)
+{
+    LuaRef meta = LuaRef::createTable(L);
+    meta.rawset("__call", call);
+    LuaRef fn = LuaRef::createTable(L);
+    fn.rawset("map", map);
+    fn.setMetaTable(meta);
+    return fn;
+}
+
+LUA_INLINE std::string CppBindBulk::elementError(lua_State* L, size_t index)
+{
+    // the element is decoded at stack top, so only keep the reason of "bad argument #-1 to '?' (reason)",
+    // Lua 5.5 may say "bad extra argument" instead
+    const char* err = lua_tostring(L, -1);
+    std::string msg = err ? err : "unknown error";
+    lua_pop(L, 1);
+
+    size_t pos = msg.find(" (");
+    if (msg.compare(0, 4, "bad ") == 0 && msg.find("argument #") < pos && msg.back() == ')') {
+        msg = msg.substr(pos + 2, msg.size() - pos - 3);
+    }
+    return "bad element #" + std::to_string(index) + " in map (" + msg + ")";
+}
+
+//---------------------------------------------------------------------------
+
 LUA_INLINE CppBindModuleBase::CppBindModuleBase(LuaRef& meta, const char* name)
 {
     LuaRef ref = meta.rawget(name);
@@ -91,3 +91,70 @@ LUA_INLINE int CppFunctor::pushToStack(lua_State* L, CppFunctor* f)
     *p = f;
     return bind(L, &callp, &gcp);
 }
+
+//---------------------------------------------------------------------------
+
+#if LUA_VERSION_NUM >= 502
+
+LUA_INLINE int CppYieldable::start(lua_State* L)
+{
+    // share the same metatable for all yieldable objects
+    lua_rawgetp(L, LUA_REGISTRYINDEX, CppSignature<CppYieldable>::value());
+    if (lua_isnil(L, -1)) {
+        lua_pop(L, 1);
+        lua_createtable(L, 0, 1);
+        lua_pushcfunction(L, &gc);
+        lua_setfield(L, -2, "__gc");
+        lua_pushvalue(L, -1);
+        lua_rawsetp(L, LUA_REGISTRYINDEX, CppSignature<CppYieldable>::value());
+    }
+    lua_setmetatable(L, -2);
+    lua_insert(L, 1);
+
+    try {
+        CppYieldable* f = self(L);
+        return f->run(L, LUA_OK);
+    } catch (std::exception& e) {
+        return luaL_error(L, "%s", e.what());
+    }
+}
+
+#if LUA_VERSION_NUM == 502
+LUA_INLINE int CppYieldable::resume(lua_State* L)
+{
+    int ctx;
+    int status = lua_getctx(L, &ctx);
+#else
+LUA_INLINE int CppYieldable::resume(lua_State* L, int status, lua_KContext)
+{
+#endif
+    try {
+        CppYieldable* f = self(L);
+        return f->run(L, status);
+    } catch (std::exception& e) {
+        return luaL_error(L, "%s", e.what());
+    }
+}
+
+LUA_INLINE int CppYieldable::gc(lua_State* L)
+{
+    try {
+        CppYieldable* f = self(L);
+        f->~CppYieldable();
+        return 0;
+    } catch (std::exception& e) {
+        return luaL_error(L, "%s", e.what());
+    }
+}
+
+LUA_INLINE void CppYieldable::call(lua_State* L, int nargs, int nresults)
+{
+    lua_callk(L, nargs, nresults, 0, &resume);
+}
+
+LUA_INLINE int CppYieldable::pcall(lua_State* L, int nargs, int nresults, int errfunc)
+{
+    return lua_pcallk(L, nargs, nresults, errfunc, 0, &resume);
+}
+
+#endif
@@ -84,8 +84,20 @@ LUA_INLINE CppObject* CppObject::getObject(lua_State* L, int index, void* class_
     }
 
     // get the object metatable -> <base_mt> <obj_mt>
-    lua_getmetatable(L, index);
+    CppObject* object = getMetaTable(L, index);
 
+    // report error if no metatable or the handle is stale
+    if (!object) {
+        if (raise_error) {
+            luaL_error(L, "invalid object, %s has no class or the handle is stale",
+                lua_typename(L, lua_type(L, index)));
+        } else {
+            lua_pop(L, 1);
+        }
+        return nullptr;
+    }
+
+#if !LUAINTF_UNIFIED_CONST_METATABLE
     // use const metatable if needed
     if (is_const && !is_exact) {
         // get the const metatable -> <base_mt> <const_obj_mt>
@@ -103,6 +115,7 @@ LUA_INLINE CppObject* CppObject::getObject(lua_State* L, int index, void* class_
             return nullptr;
         }
     }
+#endif
 
     for (;;) {
         // check if <obj_mt> and <base_mt> are equal
@@ -141,6 +154,209 @@ LUA_INLINE CppObject* CppObject::getObject(lua_State* L, int index, void* class_
         }
     }
 
-    return static_cast<CppObject*>(lua_touserdata(L, index));
+#if LUAINTF_UNIFIED_CONST_METATABLE
+    // const and non-const share the same metatable, so constness is checked by object
+    if (!is_const && !is_exact && isConst(L, index)) {
+        if (raise_error) {
+            lua_getmetatable(L, index);
+            lua_pushliteral(L, "___type");
+            lua_rawget(L, -2);
+            luaL_where(L, 1);
+            lua_pushfstring(L, "non-const %s expected, got const object", lua_tostring(L, -2));
+            lua_concat(L, 2);
+            lua_error(L);
+        }
+        return nullptr;
+    }
+#endif
+
+    return object;
+}
+
+LUA_INLINE CppObject* CppObject::getMetaTable(lua_State* L, int index)
+{
+    if (lua_islightuserdata(L, index)) {
+        CppObjectHandle* handle = CppObjectHandle::find(L, index);
+        if (!handle) return nullptr;
+
+        // get class metatable of handle -> <obj_mt>
+        lua_rawgetp(L, LUA_REGISTRYINDEX, handle->m_class_id);
+        if (!lua_istable(L, -1)) {
+            lua_pop(L, 1);
+            return nullptr;
+        }
+        return handle;
+    } else if (lua_getmetatable(L, index)) {
+        return static_cast<CppObject*>(lua_touserdata(L, index));
+    } else {
+        return nullptr;
+    }
+}
+
+//---------------------------------------------------------------------------
+
+struct CppObjectHandle::Table
+{
+    // the entries are allocated in chunks that never move, so find() can read them without lock
+    static constexpr int CHUNK_BITS = 12;
+    static constexpr uintptr_t CHUNK_SIZE = uintptr_t(1) << CHUNK_BITS;
+    static constexpr uintptr_t CHUNK_COUNT = (SLOT_MASK >> CHUNK_BITS) + 1;
+
+    struct Entry
+    {
+        Entry()
+            : generation(0)
+            , ptr(nullptr)
+            , class_id(nullptr)
+            {}
+
+        std::atomic<uintptr_t> generation;
+        std::atomic<void*> ptr;
+        std::atomic<void*> class_id;
+    };
+
+    Table()
+    {
+        for (auto& chunk : chunks) {
+            chunk.store(nullptr, std::memory_order_relaxed);
+        }
+    }
+
+    ~Table()
+    {
+        for (auto& chunk : chunks) {
+            delete [] chunk.load(std::memory_order_relaxed);
+        }
+    }
+
+    Entry* entry(uintptr_t slot) const
+    {
+        Entry* chunk = chunks[slot >> CHUNK_BITS].load(std::memory_order_acquire);
+        return chunk ? chunk + (slot & (CHUNK_SIZE - 1)) : nullptr;
+    }
+
+    std::mutex mutex;
+    std::atomic<Entry*> chunks[CHUNK_COUNT];
+    uintptr_t size = 0;
+    std::vector<uintptr_t> free_slots;
+    std::unordered_multimap<const void*, uintptr_t> slots;
+};
+
+LUA_INLINE CppObjectHandle::Table& CppObjectHandle::table()
+{
+    static Table t;
+    return t;
+}
+
+LUA_INLINE void* CppObjectHandle::acquire(void* obj, void* class_id, bool is_const)
+{
+    Table& t = table();
+    std::lock_guard<std::mutex> lock(t.mutex);
+
+    // the same address may be pushed as different class (such as first member or base class),
+    // each class has its own slot, so the existing handles keep their class
+    Table::Entry* entry = nullptr;
+    uintptr_t slot = 0;
+    auto range = t.slots.equal_range(obj);
+    for (auto it = range.first; it != range.second; ++it) {
+        if (t.entry(it->second)->class_id.load(std::memory_order_relaxed) == class_id) {
+            slot = it->second;
+            entry = t.entry(slot);
+            break;
+        }
+    }
+
+    if (!entry) {
+        if (!t.free_slots.empty()) {
+            slot = t.free_slots.back();
+            t.free_slots.pop_back();
+        } else if (t.size <= SLOT_MASK) {
+            slot = t.size++;
+            if (!t.entry(slot)) {
+                t.chunks[slot >> Table::CHUNK_BITS].store(new Table::Entry[Table::CHUNK_SIZE], std::memory_order_release);
+            }
+        } else {
+            throw LuaException("too many object handles");
+        }
+        t.slots.emplace(obj, slot);
+
+        // the generation is already bumped by release, so the stale reader that sees the new
+        // object will also see the new generation
+        entry = t.entry(slot);
+        entry->ptr.store(obj, std::memory_order_release);
+        entry->class_id.store(class_id, std::memory_order_release);
+    }
+
+    uintptr_t handle = (entry->generation.load(std::memory_order_relaxed) << SLOT_BITS) | slot;
+    return reinterpret_cast<void*>((handle << 2) | (is_const ? CONST_FLAG : 0) | HANDLE_FLAG);
+}
+
+LUA_INLINE void CppObjectHandle::release(const void* obj)
+{
+    Table& t = table();
+    std::lock_guard<std::mutex> lock(t.mutex);
+
+    auto range = t.slots.equal_range(obj);
+    for (auto it = range.first; it != range.second; ++it) {
+        uintptr_t slot = it->second;
+        Table::Entry* entry = t.entry(slot);
+
+        // retire the slot if generation is exhausted, so stale handle will never be valid again
+        uintptr_t generation = entry->generation.load(std::memory_order_relaxed);
+        if (generation < GENERATION_MASK) {
+            entry->generation.store(generation + 1, std::memory_order_relaxed);
+            t.free_slots.push_back(slot);
+        }
+        entry->ptr.store(nullptr, std::memory_order_release);
+        entry->class_id.store(nullptr, std::memory_order_release);
+    }
+    t.slots.erase(range.first, range.second);
+}
+
+LUA_INLINE CppObjectHandle* CppObjectHandle::find(lua_State* L, int index)
+{
+    uintptr_t handle = reinterpret_cast<uintptr_t>(lua_touserdata(L, index));
+    if ((handle & HANDLE_FLAG) == 0) return nullptr;
+
+    handle >>= 2;
+    uintptr_t slot = handle & SLOT_MASK;
+    uintptr_t generation = handle >> SLOT_BITS;
+
+    // no lock here: copy the entry, then check the generation again, so a stale handle
+    // never resolves to the new object in the reused slot
+    const Table::Entry* entry = table().entry(slot);
+    if (!entry || entry->generation.load(std::memory_order_acquire) != generation) return nullptr;
+    void* ptr = entry->ptr.load(std::memory_order_acquire);
+    void* class_id = entry->class_id.load(std::memory_order_acquire);
+    if (!ptr || !class_id || entry->generation.load(std::memory_order_relaxed) != generation) return nullptr;
+
+    static thread_local CppObjectHandle snapshot;
+    snapshot.m_ptr = ptr;
+    snapshot.m_class_id = class_id;
+    return &snapshot;
+}
+
+LUA_INLINE void CppObjectHandle::registerMetaTable(lua_State* L)
+{
+    lua_pushlightuserdata(L, nullptr);
+    if (lua_getmetatable(L, -1)) {
+        // the metatable is shared by all light userdata, so it can not be replaced silently
+        lua_pushliteral(L, "__index");
+        lua_rawget(L, -2);
+        bool is_handle_mt = lua_tocfunction(L, -1) == &CppBindClassMetaMethod::index;
+        lua_pop(L, 3);
+        if (!is_handle_mt) {
+            throw LuaException("can not bind handle type, the light userdata metatable is already set by other library");
+        }
+        return;
+    }
+
+    lua_createtable(L, 0, 2);
+    lua_pushcfunction(L, &CppBindClassMetaMethod::index);
+    lua_setfield(L, -2, "__index");
+    lua_pushcfunction(L, &CppBindClassMetaMethod::newIndex);
+    lua_setfield(L, -2, "__newindex");
+    lua_setmetatable(L, -2);
+    lua_pop(L, 1);
 }
 
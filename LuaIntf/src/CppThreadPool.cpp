@@ -0,0 +1,159 @@
+//
+// https://github.com/SteveKChiu/lua-intf
+//
+// Copyright 2014, Steve K. Chiu <steve.k.chiu@gmail.com>
+//
+// The MIT License (http://www.opensource.org/licenses/mit-license.php)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+//
+
+#ifndef LUAINTF_H
+    #include "LuaIntf/LuaIntf.h"
+    using namespace LuaIntf;
+#endif
+
+//---------------------------------------------------------------------------
+
+struct CppThreadPool::Job
+{
+    const Body* body;
+    size_t count;
+    size_t grain;
+    size_t slices;
+    std::atomic<size_t> next;
+    std::atomic<size_t> done;
+    std::mutex mutex;
+    std::condition_variable finished;
+    std::exception_ptr error;
+};
+
+LUA_INLINE CppThreadPool::CppThreadPool(size_t threads)
+    : m_stop(false)
+{
+    m_threads.reserve(threads);
+    for (size_t i = 0; i < threads; i++) {
+        m_threads.emplace_back(&CppThreadPool::loop, this);
+    }
+}
+
+LUA_INLINE CppThreadPool::~CppThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+    }
+    m_wake.notify_all();
+    for (auto& thread : m_threads) {
+        thread.join();
+    }
+}
+
+LUA_INLINE CppThreadPool& CppThreadPool::shared()
+{
+    static CppThreadPool pool(std::max(std::thread::hardware_concurrency(), 1u) - 1);
+    return pool;
+}
+
+LUA_INLINE void CppThreadPool::parallelFor(size_t count, size_t grain, const Body& body)
+{
+    if (count == 0) return;
+
+    // a few slices per thread, so the threads finish at about the same time
+    if (grain == 0) {
+        grain = std::max<size_t>(count / (concurrency() * 4), 256);
+    }
+    if (m_threads.empty() || count <= grain) {
+        body(0, count);
+        return;
+    }
+
+    auto job = std::make_shared<Job>();
+    job->body = &body;
+    job->count = count;
+    job->grain = grain;
+    job->slices = (count + grain - 1) / grain;
+    job->next = 0;
+    job->done = 0;
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_jobs.push_back(job);
+    }
+    m_wake.notify_all();
+
+    runSlices(*job);
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto it = std::find(m_jobs.begin(), m_jobs.end(), job);
+        if (it != m_jobs.end()) {
+            m_jobs.erase(it);
+        }
+    }
+
+    std::unique_lock<std::mutex> lock(job->mutex);
+    job->finished.wait(lock, [&job] { return job->done.load() == job->slices; });
+    if (job->error) {
+        std::rethrow_exception(job->error);
+    }
+}
+
+LUA_INLINE void CppThreadPool::runSlices(Job& job)
+{
+    for (;;) {
+        size_t slice = job.next.fetch_add(1);
+        if (slice >= job.slices) return;
+
+        size_t begin = slice * job.grain;
+        try {
+            (*job.body)(begin, std::min(begin + job.grain, job.count));
+        } catch (...) {
+            std::lock_guard<std::mutex> lock(job.mutex);
+            if (!job.error) {
+                job.error = std::current_exception();
+            }
+        }
+
+        if (job.done.fetch_add(1) + 1 == job.slices) {
+            std::lock_guard<std::mutex> lock(job.mutex);
+            job.finished.notify_all();
+        }
+    }
+}
+
+LUA_INLINE void CppThreadPool::loop()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    for (;;) {
+        m_wake.wait(lock, [this] { return m_stop || !m_jobs.empty(); });
+        if (m_stop) return;
+
+        // the job with no slice left is removed, the caller waits for the running slices
+        std::shared_ptr<Job> job = m_jobs.front();
+        if (job->next.load() >= job->slices) {
+            m_jobs.pop_front();
+            continue;
+        }
+
+        lock.unlock();
+        runSlices(*job);
+        lock.lock();
+    }
+}
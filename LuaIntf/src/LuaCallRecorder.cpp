@@ -0,0 +1,561 @@
+//
+// https://github.com/SteveKChiu/lua-intf
+//
+// Copyright 2014, Steve K. Chiu <steve.k.chiu@gmail.com>
+//
+// The MIT License (http://www.opensource.org/licenses/mit-license.php)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+//
+
+#ifndef LUAINTF_H
+    #include "LuaIntf/LuaIntf.h"
+    using namespace LuaIntf;
+#endif
+
+//---------------------------------------------------------------------------
+
+#if LUAINTF_CALL_RECORDER
+
+LUA_INLINE LuaCallRecorder::LuaCallRecorder(lua_State* state, const char* path)
+    : L(state)
+    , m_registry(lua_topointer(state, LUA_REGISTRYINDEX))
+    , m_file(std::fopen(path, "wb"))
+    , m_depth(0)
+    , m_next_name(0)
+    , m_overhead(0)
+    , m_epoch(std::chrono::steady_clock::now())
+{
+    if (!m_file) {
+        throw LuaException(std::string("can not create call record file: ") + path);
+    }
+
+    m_buffer.append("LUAICALL", 8);
+    putVarint(m_buffer, VERSION);
+
+    // name cache: function -> name id, weak keys so collected function can not be mistaken
+    lua_newtable(L);
+    lua_createtable(L, 0, 1);
+    lua_pushliteral(L, "k");
+    lua_setfield(L, -2, "__mode");
+    lua_setmetatable(L, -2);
+    lua_rawsetp(L, LUA_REGISTRYINDEX, this);
+}
+
+LUA_INLINE LuaCallRecorder::~LuaCallRecorder()
+{
+    // the state may be closed already, so the name cache is left to the state
+    if (active() == this) {
+        active() = nullptr;
+    }
+    flush();
+    std::fclose(m_file);
+}
+
+LUA_INLINE void LuaCallRecorder::start()
+{
+    active() = this;
+}
+
+LUA_INLINE void LuaCallRecorder::stop()
+{
+    if (active() == this) {
+        active() = nullptr;
+    }
+    flush();
+}
+
+LUA_INLINE void LuaCallRecorder::flush()
+{
+    if (!m_buffer.empty()) {
+        std::fwrite(m_buffer.data(), 1, m_buffer.size(), m_file);
+        std::fflush(m_file);
+        m_buffer.clear();
+    }
+}
+
+LUA_INLINE void LuaCallRecorder::putVarint(std::string& out, uint64_t v)
+{
+    while (v >= 0x80) {
+        out += char(v | 0x80);
+        v >>= 7;
+    }
+    out += char(v);
+}
+
+LUA_INLINE uint64_t LuaCallRecorder::now() const
+{
+    return uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - m_epoch).count());
+}
+
+LUA_INLINE bool LuaCallRecorder::begin(lua_State* L, Direction direction, int func, int first, int nargs, Frame& frame)
+{
+    // coroutine shares the registry with its main state
+    if (lua_topointer(L, LUA_REGISTRYINDEX) != m_registry
+            || !lua_checkstack(L, MAX_TABLE_DEPTH * 2 + 8)) {
+        return false;
+    }
+
+    uint64_t entry = now();
+    if (func == 0) {
+        // the running C function
+        lua_Debug ar;
+        if (!lua_getstack(L, 0, &ar)) return false;
+        lua_getinfo(L, "f", &ar);
+        frame.name = nameOf(L, -1);
+        lua_pop(L, 1);
+    } else {
+        frame.name = nameOf(L, func);
+    }
+
+    frame.offset = m_pending.size();
+    frame.depth = m_depth++;
+    frame.direction = direction;
+    putVarint(m_pending, unsigned(nargs));
+    for (int i = 0; i < nargs; i++) {
+        encode(L, first + i, 0);
+    }
+    frame.length = m_pending.size() - frame.offset;
+
+    // exclude the recorder overhead from call time, including the nested calls
+    frame.start = now();
+    m_overhead += frame.start - entry;
+    frame.overhead = m_overhead;
+    return true;
+}
+
+LUA_INLINE void LuaCallRecorder::end(const Frame& frame)
+{
+    uint64_t exit = now();
+    uint64_t duration = exit - frame.start - (m_overhead - frame.overhead);
+
+    m_buffer += 'C';
+    m_buffer += char(frame.direction);
+    putVarint(m_buffer, frame.depth);
+    putVarint(m_buffer, frame.name);
+    putVarint(m_buffer, frame.start);
+    putVarint(m_buffer, duration);
+    m_buffer.append(m_pending, frame.offset, frame.length);
+
+    // the inner scope skipped by longjmp (if any) is discarded as well
+    m_pending.resize(frame.offset);
+    m_depth = frame.depth;
+
+    if (m_buffer.size() >= FLUSH_SIZE) {
+        flush();
+    }
+    m_overhead += now() - exit;
+}
+
+LUA_INLINE uint32_t LuaCallRecorder::nameOf(lua_State* L, int func)
+{
+    func = lua_absindex(L, func);
+
+    // <cache> <cache[func]>
+    lua_rawgetp(L, LUA_REGISTRYINDEX, this);
+    lua_pushvalue(L, func);
+    lua_rawget(L, -2);
+    if (lua_isnumber(L, -1)) {
+        uint32_t id = uint32_t(lua_tointeger(L, -1));
+        lua_pop(L, 2);
+        return id;
+    }
+    lua_pop(L, 1);
+
+    // search the global tables with increasing depth, so the shortest name is found
+    // <cache> <visited> <_G>
+    std::string name;
+    bool found = false;
+    lua_newtable(L);
+    int visited = lua_gettop(L);
+    for (int depth = 1; depth <= MAX_NAME_DEPTH && !found; depth++) {
+        lua_pushglobaltable(L);
+        found = findName(L, func, visited, depth, name);
+        lua_pop(L, 1);
+    }
+    lua_pop(L, 1);
+
+    if (!found) {
+        // not reachable from global, it can not be replayed
+        lua_Debug ar;
+        lua_pushvalue(L, func);
+        lua_getinfo(L, ">S", &ar);
+        name = std::string("?") + ar.short_src + ":" + std::to_string(ar.linedefined);
+    }
+
+    uint32_t id = m_next_name++;
+    m_buffer += 'N';
+    putVarint(m_buffer, id);
+    putVarint(m_buffer, name.size());
+    m_buffer += name;
+
+    lua_pushvalue(L, func);
+    lua_pushinteger(L, lua_Integer(id));
+    lua_rawset(L, -3);
+    lua_pop(L, 1);
+    return id;
+}
+
+LUA_INLINE bool LuaCallRecorder::findName(lua_State* L, int func, int visited, int depth, std::string& name)
+{
+    // visited[table] = the search depth left, the table is searched again only if more depth is left
+    int table = lua_gettop(L);
+    lua_pushvalue(L, table);
+    lua_pushinteger(L, depth);
+    lua_rawset(L, visited);
+
+    // <table> <key> <value>
+    lua_pushnil(L);
+    while (lua_next(L, table)) {
+        size_t len = 0;
+        const char* key = lua_type(L, -2) == LUA_TSTRING ? lua_tolstring(L, -2, &len) : nullptr;
+        if (key && !memchr(key, '.', len)) {
+            if (lua_rawequal(L, -1, func)) {
+                name.assign(key, len);
+                lua_pop(L, 2);
+                return true;
+            }
+
+            if (depth > 1 && lua_istable(L, -1)) {
+                lua_pushvalue(L, -1);
+                lua_rawget(L, visited);
+                int left = lua_isnil(L, -1) ? 0 : int(lua_tointeger(L, -1));
+                lua_pop(L, 1);
+
+                if (left < depth - 1 && lua_checkstack(L, 4)
+                        && findName(L, func, visited, depth - 1, name)) {
+                    name.insert(0, 1, '.');
+                    name.insert(0, key, len);
+                    lua_pop(L, 2);
+                    return true;
+                }
+            }
+        }
+        lua_pop(L, 1);
+    }
+    return false;
+}
+
+LUA_INLINE void LuaCallRecorder::encode(lua_State* L, int index, int depth)
+{
+    index = lua_absindex(L, index);
+    int type = lua_type(L, index);
+    if (type == LUA_TNIL) {
+        m_pending += char(TAG_NIL);
+    } else if (type == LUA_TBOOLEAN) {
+        m_pending += char(lua_toboolean(L, index) ? TAG_TRUE : TAG_FALSE);
+    } else if (type == LUA_TNUMBER) {
+#if LUA_VERSION_NUM >= 503
+        if (lua_isinteger(L, index)) {
+            int64_t v = int64_t(lua_tointeger(L, index));
+            m_pending += char(TAG_INTEGER);
+            putVarint(m_pending, (uint64_t(v) << 1) ^ uint64_t(v >> 63));
+            return;
+        }
+#endif
+        double v = double(lua_tonumber(L, index));
+        m_pending += char(TAG_NUMBER);
+        m_pending.append(reinterpret_cast<const char*>(&v), sizeof(v));
+    } else if (type == LUA_TSTRING) {
+        size_t len;
+        const char* p = lua_tolstring(L, index, &len);
+        m_pending += char(TAG_STRING);
+        putVarint(m_pending, len);
+        m_pending.append(p, len);
+    } else if (type == LUA_TTABLE && depth < MAX_TABLE_DEPTH && !lua_getmetatable(L, index)) {
+        // <key> <value>
+        m_pending += char(TAG_TABLE);
+        lua_pushnil(L);
+        while (lua_next(L, index)) {
+            encode(L, -2, depth + 1);
+            encode(L, -1, depth + 1);
+            lua_pop(L, 1);
+        }
+        m_pending += char(TAG_NIL);
+    } else {
+        // object, function and table with metatable are recorded as type only
+        // <meta> <meta.___type>
+        const char* type_name = lua_typename(L, type);
+        bool has_meta = type == LUA_TTABLE ? depth < MAX_TABLE_DEPTH : lua_getmetatable(L, index) != 0;
+        if (has_meta) {
+            lua_pushliteral(L, "___type");
+            lua_rawget(L, -2);
+            if (lua_type(L, -1) == LUA_TSTRING) {
+                type_name = lua_tostring(L, -1);
+            }
+        }
+
+        size_t len = strlen(type_name);
+        m_pending += char(TAG_OPAQUE);
+        m_pending += char(type);
+        putVarint(m_pending, len);
+        m_pending.append(type_name, len);
+        if (has_meta) {
+            lua_pop(L, 2);
+        }
+    }
+}
+
+//---------------------------------------------------------------------------
+
+LUA_INLINE LuaCallReplay::LuaCallReplay(lua_State* state, const char* path)
+    : L(state)
+    , m_replayed(0)
+    , m_skipped(0)
+    , m_failed(0)
+    , m_recorded_ns(0)
+    , m_replayed_ns(0)
+{
+    std::FILE* file = std::fopen(path, "rb");
+    if (!file) {
+        throw LuaException(std::string("can not open call record file: ") + path);
+    }
+
+    char buf[4096];
+    size_t n;
+    while ((n = std::fread(buf, 1, sizeof(buf), file)) > 0) {
+        m_data.append(buf, n);
+    }
+    std::fclose(file);
+
+    const unsigned char* p = reinterpret_cast<const unsigned char*>(m_data.data()) + 8;
+    if (m_data.size() < 9 || m_data.compare(0, 8, "LUAICALL") != 0
+            || readVarint(p) != LuaCallRecorder::VERSION) {
+        throw LuaException(std::string("not a call record file: ") + path);
+    }
+    m_start = size_t(p - reinterpret_cast<const unsigned char*>(m_data.data()));
+}
+
+LUA_INLINE LuaCallReplay::~LuaCallReplay()
+{
+    for (int ref : m_funcs) {
+        if (ref != LUA_NOREF && ref != LUA_REFNIL) {
+            luaL_unref(L, LUA_REGISTRYINDEX, ref);
+        }
+    }
+}
+
+LUA_INLINE void LuaCallReplay::corrupted()
+{
+    throw LuaException("call record file is corrupted");
+}
+
+LUA_INLINE uint64_t LuaCallReplay::readVarint(const unsigned char*& p)
+{
+    const unsigned char* end = reinterpret_cast<const unsigned char*>(m_data.data()) + m_data.size();
+    uint64_t v = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        if (p == end) corrupted();
+        unsigned char c = *p++;
+        v |= uint64_t(c & 0x7f) << shift;
+        if (!(c & 0x80)) return v;
+    }
+    corrupted();
+    return 0;
+}
+
+LUA_INLINE void LuaCallReplay::run(bool top_level_only)
+{
+    const unsigned char* p = reinterpret_cast<const unsigned char*>(m_data.data()) + m_start;
+    const unsigned char* end = reinterpret_cast<const unsigned char*>(m_data.data()) + m_data.size();
+
+    while (p < end) {
+        unsigned char kind = *p++;
+        if (kind == 'N') {
+            uint64_t id = readVarint(p);
+            uint64_t len = readVarint(p);
+            if (id > UINT32_MAX || len > uint64_t(end - p)) corrupted();
+            if (id >= m_stats.size()) {
+                m_stats.resize(size_t(id + 1), Stat { std::string(), 0, 0, 0 });
+                m_funcs.resize(size_t(id + 1), LUA_NOREF);
+            }
+            m_stats[size_t(id)].name.assign(reinterpret_cast<const char*>(p), size_t(len));
+            p += len;
+        } else if (kind == 'C') {
+            if (p == end) corrupted();
+            p++;    // direction
+            uint64_t depth = readVarint(p);
+            uint64_t id = readVarint(p);
+            readVarint(p);  // start time
+            uint64_t duration = readVarint(p);
+            uint64_t nargs = readVarint(p);
+            if (id >= m_stats.size() || nargs > uint64_t(end - p)) corrupted();
+
+            bool selected = !top_level_only || depth == 0;
+            int top = lua_gettop(L);
+            bool push = selected
+                && lua_checkstack(L, int(nargs) + 2 * LuaCallRecorder::MAX_TABLE_DEPTH + 8);
+            if (push) {
+                lua_pushcfunction(L, &LuaException::traceback);
+                push = pushFunction(uint32_t(id));
+            }
+            for (uint64_t i = 0; i < nargs; i++) {
+                if (!pushValue(p, 0, push)) push = false;
+            }
+
+            if (push) {
+                auto start = std::chrono::steady_clock::now();
+                int status = lua_pcall(L, int(nargs), 0, top + 1);
+                uint64_t elapsed = uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    std::chrono::steady_clock::now() - start).count());
+
+                if (status == LUA_OK) {
+                    m_replayed++;
+                } else {
+                    const char* msg = lua_tostring(L, -1);
+                    m_error = msg ? msg : "unknown error";
+                    m_failed++;
+                }
+
+                Stat& stat = m_stats[size_t(id)];
+                stat.calls++;
+                stat.recorded_ns += duration;
+                stat.replayed_ns += elapsed;
+                m_recorded_ns += duration;
+                m_replayed_ns += elapsed;
+            } else if (selected) {
+                m_skipped++;
+            }
+            lua_settop(L, top);
+        } else {
+            corrupted();
+        }
+    }
+}
+
+LUA_INLINE bool LuaCallReplay::pushFunction(uint32_t id)
+{
+    int& ref = m_funcs[id];
+    if (ref == LUA_NOREF) {
+        // the name is made of raw keys from global table, so lookup with rawget
+        const std::string& name = m_stats[id].name;
+        if (name.empty() || name[0] == '?') {
+            ref = LUA_REFNIL;
+        } else {
+            lua_pushglobaltable(L);
+            size_t pos = 0;
+            for (;;) {
+                size_t dot = name.find('.', pos);
+                if (!lua_istable(L, -1)) break;
+                lua_pushlstring(L, name.data() + pos, (dot == std::string::npos ? name.size() : dot) - pos);
+                lua_rawget(L, -2);
+                lua_remove(L, -2);
+                if (dot == std::string::npos) break;
+                pos = dot + 1;
+            }
+            ref = lua_isfunction(L, -1) ? luaL_ref(L, LUA_REGISTRYINDEX) : LUA_REFNIL;
+            if (ref == LUA_REFNIL) lua_pop(L, 1);
+        }
+    }
+
+    if (ref == LUA_REFNIL) {
+        return false;
+    }
+    lua_rawgeti(L, LUA_REGISTRYINDEX, ref);
+    return true;
+}
+
+LUA_INLINE bool LuaCallReplay::pushValue(const unsigned char*& p, int depth, bool push)
+{
+    const unsigned char* end = reinterpret_cast<const unsigned char*>(m_data.data()) + m_data.size();
+    if (p == end || depth > LuaCallRecorder::MAX_TABLE_DEPTH) corrupted();
+
+    bool ok = true;
+    switch (*p++) {
+    case LuaCallRecorder::TAG_NIL:
+        if (push) lua_pushnil(L);
+        break;
+    case LuaCallRecorder::TAG_FALSE:
+        if (push) lua_pushboolean(L, 0);
+        break;
+    case LuaCallRecorder::TAG_TRUE:
+        if (push) lua_pushboolean(L, 1);
+        break;
+    case LuaCallRecorder::TAG_INTEGER:
+        {
+            uint64_t v = readVarint(p);
+            int64_t i = int64_t(v >> 1) ^ -int64_t(v & 1);
+            if (push) lua_pushinteger(L, lua_Integer(i));
+        }
+        break;
+    case LuaCallRecorder::TAG_NUMBER:
+        {
+            double v;
+            if (uint64_t(end - p) < sizeof(v)) corrupted();
+            memcpy(&v, p, sizeof(v));
+            p += sizeof(v);
+            if (push) lua_pushnumber(L, lua_Number(v));
+        }
+        break;
+    case LuaCallRecorder::TAG_STRING:
+        {
+            uint64_t len = readVarint(p);
+            if (len > uint64_t(end - p)) corrupted();
+            if (push) lua_pushlstring(L, reinterpret_cast<const char*>(p), size_t(len));
+            p += len;
+        }
+        break;
+    case LuaCallRecorder::TAG_TABLE:
+        if (push) lua_newtable(L);
+        for (;;) {
+            if (p == end) corrupted();
+            if (*p == LuaCallRecorder::TAG_NIL) {
+                p++;
+                break;
+            }
+            if (!pushValue(p, depth + 1, push)) ok = false;
+            if (!pushValue(p, depth + 1, push)) ok = false;
+            if (push) {
+                if (lua_isnil(L, -2)) {
+                    lua_pop(L, 2);
+                } else {
+                    lua_rawset(L, -3);
+                }
+            }
+        }
+        break;
+    case LuaCallRecorder::TAG_OPAQUE:
+        {
+            if (p == end) corrupted();
+            int type = *p++;
+            uint64_t len = readVarint(p);
+            if (len > uint64_t(end - p)) corrupted();
+            std::string type_name(reinterpret_cast<const char*>(p), size_t(len));
+            p += len;
+            if (push) {
+                int top = lua_gettop(L);
+                ok = m_handler && m_handler(L, static_cast<LuaTypeID>(type), type_name.c_str())
+                    && lua_gettop(L) == top + 1;
+                if (!ok) {
+                    lua_settop(L, top);
+                    lua_pushnil(L);
+                }
+            } else {
+                ok = false;
+            }
+        }
+        break;
+    default:
+        corrupted();
+    }
+    return ok && push;
+}
+
+#endif
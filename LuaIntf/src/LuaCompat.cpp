@@ -463,3 +463,18 @@ LUA_INLINE int luaL_fileresult(lua_State* L, int stat, const char* fname)
 //---------------------------------------------------------------------------
 
 #endif
+
+//---------------------------------------------------------------------------
+
+#if LUA_VERSION_NUM <= 504
+
+LUA_INLINE const char* lua_pushexternalstring(lua_State* L, const char* s, size_t len, lua_Alloc falloc, void* ud)
+{
+    lua_pushlstring(L, s, len);
+    if (falloc) {
+        falloc(ud, const_cast<char*>(s), len + 1, 0);
+    }
+    return lua_tostring(L, -1);
+}
+
+#endif
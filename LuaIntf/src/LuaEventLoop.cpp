@@ -0,0 +1,668 @@
+//
+// https://github.com/SteveKChiu/lua-intf
+//
+// Copyright 2014, Steve K. Chiu <steve.k.chiu@gmail.com>
+//
+// The MIT License (http://www.opensource.org/licenses/mit-license.php)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+//
+
+#ifndef LUAEVENTLOOP_H
+    #include "LuaIntf/LuaEventLoop.h"
+    using namespace LuaIntf;
+#endif
+
+//---------------------------------------------------------------------------
+
+LUA_INLINE LuaEventLoop::LuaEventLoop(lua_State* state)
+    : L(state)
+    , m_epoll(-1)
+    , m_timer(-1)
+    , m_signal(-1)
+    , m_stop(false)
+    , m_armed(-1)
+{
+    sigemptyset(&m_sigset);
+    m_epoll = epoll_create1(EPOLL_CLOEXEC);
+    m_timer = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+
+    epoll_event ev;
+    ev.events = EPOLLIN;
+    ev.data.fd = m_timer;
+    if (m_epoll < 0 || m_timer < 0 || epoll_ctl(m_epoll, EPOLL_CTL_ADD, m_timer, &ev) < 0) {
+        std::string msg = std::string("can not create event loop: ") + strerror(errno);
+        if (m_epoll >= 0) close(m_epoll);
+        if (m_timer >= 0) close(m_timer);
+        throw LuaException(msg);
+    }
+}
+
+LUA_INLINE LuaEventLoop::~LuaEventLoop()
+{
+    for (auto& task : m_tasks) {
+        if (task.thread) {
+            luaL_unref(L, LUA_REGISTRYINDEX, task.ref);
+            luaL_unref(L, LUA_REGISTRYINDEX, task.data_ref);
+        }
+    }
+    if (m_signal >= 0) {
+        close(m_signal);
+        pthread_sigmask(SIG_UNBLOCK, &m_sigset, nullptr);
+    }
+    close(m_timer);
+    close(m_epoll);
+}
+
+LUA_INLINE void LuaEventLoop::bind(const char* name)
+{
+    static const luaL_Reg funcs[] = {
+        { "spawn", &spawnFunc },
+        { "sleep", &sleepFunc },
+        { "read", &readFunc },
+        { "write", &writeFunc },
+        { "wait", &waitFunc },
+        { "signal", &signalFunc },
+        { "nonblock", &nonblockFunc },
+        { "now", &nowFunc },
+        { "stop", &stopFunc },
+        { nullptr, nullptr }
+    };
+
+    lua_newtable(L);
+    lua_pushlightuserdata(L, this);
+    luaL_setfuncs(L, funcs, 1);
+    Lua::popToGlobal(L, name);
+}
+
+LUA_INLINE void LuaEventLoop::run()
+{
+    m_stop = false;
+    while (!m_stop && runOnce(true)) {}
+    m_stop = false;
+}
+
+LUA_INLINE bool LuaEventLoop::runOnce(bool block)
+{
+    if (m_threads.empty()) {
+        return false;
+    }
+
+    armTimer();
+
+    epoll_event events[256];
+    int n = epoll_wait(m_epoll, events, 256, (block && m_ready.empty()) ? -1 : 0);
+    if (n < 0 && errno != EINTR) {
+        throw LuaException(std::string("epoll_wait failed: ") + strerror(errno));
+    }
+
+    // collect everything that became ready, then resume them in one batch
+    for (int i = 0; i < n; i++) {
+        int fd = events[i].data.fd;
+        if (fd == m_timer) {
+            fireTimers();
+        } else if (fd == m_signal) {
+            fireSignals();
+        } else {
+            fireFd(fd, events[i].events);
+        }
+    }
+
+    resumeReady();
+    return !m_threads.empty();
+}
+
+LUA_INLINE double LuaEventLoop::now()
+{
+    return clock() / 1e9;
+}
+
+//---------------------------------------------------------------------------
+
+LUA_INLINE int64_t LuaEventLoop::clock()
+{
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return int64_t(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+LUA_INLINE LuaEventLoop* LuaEventLoop::get(lua_State* L)
+{
+    return static_cast<LuaEventLoop*>(lua_touserdata(L, lua_upvalueindex(1)));
+}
+
+LUA_INLINE size_t LuaEventLoop::current(lua_State* L, LuaEventLoop* loop)
+{
+    auto it = loop->m_threads.find(L);
+    if (it == loop->m_threads.end()) {
+        luaL_error(L, "must be called in coroutine spawned by the event loop");
+        return NO_TASK;
+    }
+    return it->second;
+}
+
+LUA_INLINE int LuaEventLoop::pushError(lua_State* L, int err)
+{
+    lua_pushnil(L);
+    lua_pushstring(L, strerror(err));
+    lua_pushinteger(L, err);
+    return 3;
+}
+
+LUA_INLINE int LuaEventLoop::wait(lua_State* L, LuaEventLoop* loop, size_t id, int fd, int events)
+{
+    if (!loop->watch(id, fd, events)) {
+        int err = errno;
+        // bump generation so the timeout timer of the failed wait is discarded
+        Task& task = loop->m_tasks[id];
+        luaL_unref(L, LUA_REGISTRYINDEX, task.data_ref);
+        task.data_ref = LUA_NOREF;
+        task.wait = WaitKind::NONE;
+        task.generation++;
+        return luaL_error(L, "can not wait for fd %d: %s", fd, strerror(err));
+    }
+    return lua_yield(L, 0);
+}
+
+LUA_INLINE int LuaEventLoop::spawnFunc(lua_State* L)
+{
+    LuaEventLoop* loop = get(L);
+    luaL_checktype(L, 1, LUA_TFUNCTION);
+    int n = lua_gettop(L);
+
+    // stack: thread fn args... -> thread thread
+    lua_State* thread = lua_newthread(L);
+    lua_insert(L, 1);
+    lua_xmove(L, thread, n);
+    lua_pushvalue(L, 1);
+    loop->addTask(L, thread, n - 1);
+    return 1;
+}
+
+LUA_INLINE int LuaEventLoop::sleepFunc(lua_State* L)
+{
+    LuaEventLoop* loop = get(L);
+    size_t id = current(L, loop);
+    double sec = luaL_checknumber(L, 1);
+    loop->m_tasks[id].wait = WaitKind::SLEEP;
+    loop->addTimer(id, clock() + int64_t(sec * 1e9));
+    return lua_yield(L, 0);
+}
+
+LUA_INLINE int LuaEventLoop::readFunc(lua_State* L)
+{
+    LuaEventLoop* loop = get(L);
+    size_t id = current(L, loop);
+    int fd = static_cast<int>(luaL_checkinteger(L, 1));
+    lua_Integer max_size = luaL_optinteger(L, 2, 65536);
+    luaL_argcheck(L, max_size > 0, 2, "size must be positive");
+
+    // the read buffer is sized by script, so cap it instead of failing the allocation
+    size_t size = size_t(max_size) < MAX_READ_SIZE ? size_t(max_size) : MAX_READ_SIZE;
+
+    // try first, only yield if it would block
+    int n = loop->doRead(L, fd, size);
+    if (n >= 0) {
+        return n;
+    }
+
+    Task& task = loop->m_tasks[id];
+    task.wait = WaitKind::READ;
+    task.size = size;
+    return wait(L, loop, id, fd, EPOLLIN);
+}
+
+LUA_INLINE int LuaEventLoop::writeFunc(lua_State* L)
+{
+    LuaEventLoop* loop = get(L);
+    size_t id = current(L, loop);
+    int fd = static_cast<int>(luaL_checkinteger(L, 1));
+    size_t len;
+    const char* data = luaL_checklstring(L, 2, &len);
+
+    int n = loop->doWrite(L, fd, data, len);
+    if (n >= 0) {
+        return n;
+    }
+
+    // keep the data alive until the fd is writable
+    lua_pushvalue(L, 2);
+    Task& task = loop->m_tasks[id];
+    task.wait = WaitKind::WRITE;
+    task.data_ref = luaL_ref(L, LUA_REGISTRYINDEX);
+    return wait(L, loop, id, fd, EPOLLOUT);
+}
+
+LUA_INLINE int LuaEventLoop::waitFunc(lua_State* L)
+{
+    LuaEventLoop* loop = get(L);
+    size_t id = current(L, loop);
+    int fd = static_cast<int>(luaL_checkinteger(L, 1));
+    const char* mode = luaL_optstring(L, 2, "r");
+    int events = (strchr(mode, 'r') ? int(EPOLLIN) : 0) | (strchr(mode, 'w') ? int(EPOLLOUT) : 0);
+    luaL_argcheck(L, events != 0, 2, "mode must be \"r\", \"w\" or \"rw\"");
+    bool has_timeout = !lua_isnoneornil(L, 3);
+    double timeout = has_timeout ? luaL_checknumber(L, 3) : 0;
+
+    Task& task = loop->m_tasks[id];
+    task.wait = WaitKind::POLL;
+    task.events = events;
+    if (has_timeout) {
+        loop->addTimer(id, clock() + int64_t(timeout * 1e9));
+    }
+    return wait(L, loop, id, fd, events);
+}
+
+LUA_INLINE int LuaEventLoop::signalFunc(lua_State* L)
+{
+    LuaEventLoop* loop = get(L);
+    size_t id = current(L, loop);
+    int signo = static_cast<int>(luaL_checkinteger(L, 1));
+
+    if (!sigismember(&loop->m_sigset, signo)) {
+        sigset_t set;
+        sigemptyset(&set);
+        if (sigaddset(&set, signo) < 0) {
+            return luaL_argerror(L, 1, "invalid signal number");
+        }
+        pthread_sigmask(SIG_BLOCK, &set, nullptr);
+        sigaddset(&loop->m_sigset, signo);
+
+        bool created = loop->m_signal < 0;
+        loop->m_signal = signalfd(loop->m_signal, &loop->m_sigset, SFD_NONBLOCK | SFD_CLOEXEC);
+        if (loop->m_signal < 0) {
+            return luaL_error(L, "can not create signalfd: %s", strerror(errno));
+        }
+        if (created) {
+            epoll_event ev;
+            ev.events = EPOLLIN;
+            ev.data.fd = loop->m_signal;
+            epoll_ctl(loop->m_epoll, EPOLL_CTL_ADD, loop->m_signal, &ev);
+        }
+    }
+
+    Task& task = loop->m_tasks[id];
+    task.wait = WaitKind::SIGNAL;
+    task.signo = signo;
+    loop->m_signals[signo].push_back(id);
+    return lua_yield(L, 0);
+}
+
+LUA_INLINE int LuaEventLoop::nonblockFunc(lua_State* L)
+{
+    int fd = static_cast<int>(luaL_checkinteger(L, 1));
+    int flags = fcntl(fd, F_GETFL);
+    if (flags < 0 || fcntl(fd, F_SETFL, flags | O_NONBLOCK) < 0) {
+        return pushError(L, errno);
+    }
+    lua_pushboolean(L, 1);
+    return 1;
+}
+
+LUA_INLINE int LuaEventLoop::nowFunc(lua_State* L)
+{
+    lua_pushnumber(L, now());
+    return 1;
+}
+
+LUA_INLINE int LuaEventLoop::stopFunc(lua_State* L)
+{
+    get(L)->stop();
+    return 0;
+}
+
+//---------------------------------------------------------------------------
+
+LUA_INLINE void LuaEventLoop::addTask(lua_State* from, lua_State* thread, int nargs)
+{
+    // the thread object is on top of from stack
+    int ref = luaL_ref(from, LUA_REGISTRYINDEX);
+
+    size_t id;
+    if (m_free.empty()) {
+        id = m_tasks.size();
+        m_tasks.push_back(Task());
+    } else {
+        id = m_free.back();
+        m_free.pop_back();
+    }
+
+    Task& task = m_tasks[id];
+    task.thread = thread;
+    task.ref = ref;
+    task.nargs = nargs;
+    task.wait = WaitKind::NONE;
+    task.fd = -1;
+    task.signo = 0;
+    task.events = 0;
+    task.size = 0;
+    task.data_ref = LUA_NOREF;
+
+    m_threads[thread] = id;
+    m_ready.push_back(id);
+}
+
+LUA_INLINE void LuaEventLoop::removeTask(size_t id)
+{
+    Task& task = m_tasks[id];
+    luaL_unref(L, LUA_REGISTRYINDEX, task.ref);
+    luaL_unref(L, LUA_REGISTRYINDEX, task.data_ref);
+    m_threads.erase(task.thread);
+    task.thread = nullptr;
+    task.ref = LUA_NOREF;
+    task.data_ref = LUA_NOREF;
+    task.generation++;
+    m_free.push_back(id);
+}
+
+LUA_INLINE void LuaEventLoop::ready(size_t id, int nargs)
+{
+    // bump generation so pending timer of the wait is discarded
+    Task& task = m_tasks[id];
+    task.wait = WaitKind::NONE;
+    task.nargs = nargs;
+    task.generation++;
+    m_ready.push_back(id);
+}
+
+LUA_INLINE void LuaEventLoop::addTimer(size_t id, int64_t deadline)
+{
+    Timer timer;
+    timer.deadline = deadline;
+    timer.task = id;
+    timer.generation = m_tasks[id].generation;
+    m_timers.push_back(timer);
+    std::push_heap(m_timers.begin(), m_timers.end());
+}
+
+LUA_INLINE bool LuaEventLoop::watch(size_t id, int fd, int events)
+{
+    FdEntry init = { NO_TASK, NO_TASK, 0 };
+    FdEntry& entry = m_fds.emplace(fd, init).first->second;
+    if (((events & EPOLLIN) && entry.reader != NO_TASK)
+        || ((events & EPOLLOUT) && entry.writer != NO_TASK))
+    {
+        if (entry.events == 0) m_fds.erase(fd);
+        errno = EBUSY;
+        return false;
+    }
+
+    if (events & EPOLLIN) entry.reader = id;
+    if (events & EPOLLOUT) entry.writer = id;
+    m_tasks[id].fd = fd;
+
+    if (!updateFd(fd, entry)) {
+        int err = errno;
+        unwatch(id);
+        errno = err;
+        return false;
+    }
+    return true;
+}
+
+LUA_INLINE void LuaEventLoop::unwatch(size_t id)
+{
+    Task& task = m_tasks[id];
+    auto it = m_fds.find(task.fd);
+    if (it != m_fds.end()) {
+        if (it->second.reader == id) it->second.reader = NO_TASK;
+        if (it->second.writer == id) it->second.writer = NO_TASK;
+        updateFd(task.fd, it->second);
+    }
+    task.fd = -1;
+}
+
+LUA_INLINE bool LuaEventLoop::updateFd(int fd, FdEntry& entry)
+{
+    uint32_t events = (entry.reader != NO_TASK ? uint32_t(EPOLLIN) : 0)
+        | (entry.writer != NO_TASK ? uint32_t(EPOLLOUT) : 0);
+
+    bool ok = true;
+    if (events != entry.events) {
+        epoll_event ev;
+        ev.events = events;
+        ev.data.fd = fd;
+        int op = entry.events == 0 ? EPOLL_CTL_ADD : (events == 0 ? EPOLL_CTL_DEL : EPOLL_CTL_MOD);
+        ok = epoll_ctl(m_epoll, op, fd, &ev) == 0 || op == EPOLL_CTL_DEL;
+        if (ok) entry.events = events;
+    }
+
+    if (entry.reader == NO_TASK && entry.writer == NO_TASK) {
+        m_fds.erase(fd);
+    }
+    return ok;
+}
+
+LUA_INLINE void LuaEventLoop::armTimer()
+{
+    // drop the timers of waits that are already finished
+    while (!m_timers.empty() && m_tasks[m_timers.front().task].generation != m_timers.front().generation) {
+        std::pop_heap(m_timers.begin(), m_timers.end());
+        m_timers.pop_back();
+    }
+
+    int64_t deadline = m_timers.empty() ? -1 : m_timers.front().deadline;
+    if (deadline == m_armed) {
+        return;
+    }
+
+    itimerspec spec;
+    memset(&spec, 0, sizeof(spec));
+    if (deadline >= 0) {
+        // zero value disarms the timer, so expired deadline is set to 1ns
+        int64_t t = std::max<int64_t>(deadline, 1);
+        spec.it_value.tv_sec = time_t(t / 1000000000);
+        spec.it_value.tv_nsec = long(t % 1000000000);
+    }
+    timerfd_settime(m_timer, TFD_TIMER_ABSTIME, &spec, nullptr);
+    m_armed = deadline;
+}
+
+LUA_INLINE void LuaEventLoop::fireTimers()
+{
+    uint64_t expired;
+    while (read(m_timer, &expired, sizeof(expired)) > 0) {}
+    m_armed = -1;
+
+    int64_t t = clock();
+    while (!m_timers.empty() && m_timers.front().deadline <= t) {
+        Timer timer = m_timers.front();
+        std::pop_heap(m_timers.begin(), m_timers.end());
+        m_timers.pop_back();
+
+        Task& task = m_tasks[timer.task];
+        if (task.generation != timer.generation) {
+            continue;
+        }
+
+        if (task.wait == WaitKind::SLEEP) {
+            ready(timer.task, 0);
+        } else if (task.wait == WaitKind::POLL) {
+            unwatch(timer.task);
+            lua_pushnil(task.thread);
+            ready(timer.task, 1);
+        }
+    }
+}
+
+LUA_INLINE void LuaEventLoop::fireSignals()
+{
+    signalfd_siginfo info;
+    while (read(m_signal, &info, sizeof(info)) == sizeof(info)) {
+        int signo = int(info.ssi_signo);
+        auto it = m_signals.find(signo);
+        if (it == m_signals.end()) {
+            continue;
+        }
+
+        for (size_t id : it->second) {
+            Task& task = m_tasks[id];
+            if (task.thread && task.wait == WaitKind::SIGNAL && task.signo == signo) {
+                lua_pushinteger(task.thread, signo);
+                ready(id, 1);
+            }
+        }
+        it->second.clear();
+    }
+}
+
+LUA_INLINE void LuaEventLoop::fireFd(int fd, uint32_t events)
+{
+    auto it = m_fds.find(fd);
+    if (it == m_fds.end()) {
+        return;
+    }
+
+    // error and hang up wake both sides, the following read or write reports it
+    bool readable = (events & (EPOLLIN | EPOLLERR | EPOLLHUP)) != 0;
+    bool writable = (events & (EPOLLOUT | EPOLLERR | EPOLLHUP)) != 0;
+    size_t reader = it->second.reader;
+    size_t writer = it->second.writer;
+
+    if (reader != NO_TASK && (readable || (reader == writer && writable))) {
+        complete(reader, readable, writable);
+    }
+    if (writer != NO_TASK && writer != reader && writable) {
+        complete(writer, readable, writable);
+    }
+}
+
+LUA_INLINE void LuaEventLoop::complete(size_t id, bool readable, bool writable)
+{
+    Task& task = m_tasks[id];
+    int n = -1;
+
+    if (task.wait == WaitKind::READ) {
+        n = doRead(task.thread, task.fd, task.size);
+    } else if (task.wait == WaitKind::WRITE) {
+        size_t len;
+        lua_rawgeti(L, LUA_REGISTRYINDEX, task.data_ref);
+        const char* data = lua_tolstring(L, -1, &len);
+        lua_pop(L, 1);
+        n = doWrite(task.thread, task.fd, data, len);
+        if (n >= 0) {
+            luaL_unref(L, LUA_REGISTRYINDEX, task.data_ref);
+            task.data_ref = LUA_NOREF;
+        }
+    } else if (task.wait == WaitKind::POLL) {
+        bool r = readable && (task.events & EPOLLIN);
+        bool w = writable && (task.events & EPOLLOUT);
+        if (r || w) {
+            lua_pushstring(task.thread, r ? (w ? "rw" : "r") : "w");
+            n = 1;
+        }
+    }
+
+    if (n >= 0) {
+        unwatch(id);
+        ready(id, n);
+    }
+}
+
+LUA_INLINE int LuaEventLoop::doRead(lua_State* target, int fd, size_t size)
+{
+    if (m_buffer.size() < size) {
+        m_buffer.resize(size);
+    }
+
+    ssize_t n;
+    do {
+        n = ::read(fd, m_buffer.data(), size);
+    } while (n < 0 && errno == EINTR);
+
+    if (n > 0) {
+        lua_pushlstring(target, m_buffer.data(), size_t(n));
+        return 1;
+    } else if (n == 0) {
+        lua_pushnil(target);
+        return 1;
+    } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+        return -1;
+    } else {
+        return pushError(target, errno);
+    }
+}
+
+LUA_INLINE int LuaEventLoop::doWrite(lua_State* target, int fd, const char* data, size_t len)
+{
+    ssize_t n;
+    do {
+        n = ::write(fd, data, len);
+    } while (n < 0 && errno == EINTR);
+
+    if (n >= 0) {
+        lua_pushinteger(target, lua_Integer(n));
+        return 1;
+    } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+        return -1;
+    } else {
+        return pushError(target, errno);
+    }
+}
+
+LUA_INLINE void LuaEventLoop::resumeReady()
+{
+    // the coroutines readied while resuming this batch go to next iteration
+    m_resuming.clear();
+    m_resuming.swap(m_ready);
+
+    std::string error;
+    for (size_t id : m_resuming) {
+        lua_State* thread = m_tasks[id].thread;
+        int nargs = m_tasks[id].nargs;
+        m_tasks[id].nargs = 0;
+
+#if LUA_VERSION_NUM >= 504
+        int nres;
+        int status = lua_resume(thread, L, nargs, &nres);
+#elif LUA_VERSION_NUM >= 502
+        int status = lua_resume(thread, L, nargs);
+        int nres = lua_gettop(thread);
+#else
+        int status = lua_resume(thread, nargs);
+        int nres = lua_gettop(thread);
+#endif
+
+        if (status == LUA_YIELD) {
+            // the values passed to yield are discarded
+            lua_pop(thread, nres);
+            if (m_tasks[id].wait == WaitKind::NONE) {
+                m_ready.push_back(id);
+            }
+        } else if (status == LUA_OK) {
+            removeTask(id);
+        } else {
+            luaL_traceback(L, thread, lua_tostring(thread, -1), 0);
+            std::string msg = lua_tostring(L, -1);
+            lua_pop(L, 1);
+            removeTask(id);
+
+            if (m_error_handler) {
+                m_error_handler(msg);
+            } else if (error.empty()) {
+                error = msg;
+            }
+        }
+    }
+    m_resuming.clear();
+
+    if (!error.empty()) {
+        throw LuaException(error);
+    }
+}
@@ -0,0 +1,778 @@
+//
+// https://github.com/SteveKChiu/lua-intf
+//
+// Copyright 2014, Steve K. Chiu <steve.k.chiu@gmail.com>
+//
+// The MIT License (http://www.opensource.org/licenses/mit-license.php)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+//
+
+#ifndef LUAJSON_H
+    #include "LuaIntf/LuaJson.h"
+    using namespace LuaIntf;
+#endif
+
+//---------------------------------------------------------------------------
+
+class LuaJson::Decoder
+{
+public:
+    Decoder(lua_State* state, const char* data, size_t len)
+        : L(state)
+        , m_begin(data)
+        , m_p(data)
+        , m_end(data + len)
+        , m_point(*std::localeconv()->decimal_point)
+        , m_cache(0)
+        , m_cache_size(0)
+    {
+        std::memset(m_keys, 0, sizeof(m_keys));
+    }
+
+    void parse()
+    {
+        // the key cache table is kept below the value
+        lua_newtable(L);
+        m_cache = lua_gettop(L);
+        skipSpace();
+        parseValue(0);
+        skipSpace();
+        if (m_p != m_end) {
+            fail("unexpected character after value");
+        }
+        lua_remove(L, m_cache);
+    }
+
+private:
+    struct Key
+    {
+        const char* data;
+        size_t len;
+        int ref;
+    };
+
+    static const int KEY_CACHE_SIZE = 256;
+
+    [[noreturn]] void fail(const char* message) const
+    {
+        char buf[64];
+        std::snprintf(buf, sizeof(buf), "json decode error at position %d: ", int(m_p - m_begin) + 1);
+        throw LuaException(buf + std::string(message));
+    }
+
+    void skipSpace()
+    {
+        while (m_p < m_end && (*m_p == ' ' || *m_p == '\n' || *m_p == '\r' || *m_p == '\t')) {
+            m_p++;
+        }
+    }
+
+    void expect(const char* word, size_t len)
+    {
+        if (size_t(m_end - m_p) < len || std::memcmp(m_p, word, len) != 0) {
+            fail("invalid literal");
+        }
+        m_p += len;
+    }
+
+    void parseValue(int depth)
+    {
+        if (m_p == m_end) {
+            fail("unexpected end of text");
+        }
+
+        switch (*m_p) {
+        case '{':
+            parseObject(depth + 1);
+            break;
+        case '[':
+            parseArray(depth + 1);
+            break;
+        case '"':
+            parseString(false);
+            break;
+        case 't':
+            expect("true", 4);
+            lua_pushboolean(L, 1);
+            break;
+        case 'f':
+            expect("false", 5);
+            lua_pushboolean(L, 0);
+            break;
+        case 'n':
+            expect("null", 4);
+            lua_pushlightuserdata(L, nullptr);
+            break;
+        default:
+            parseNumber();
+            break;
+        }
+    }
+
+    void reserve(int depth)
+    {
+        if (depth > MAX_DEPTH || !lua_checkstack(L, CHUNK_SIZE * 2 + LUA_MINSTACK)) {
+            fail("nested too deep");
+        }
+    }
+
+    void parseArray(int depth)
+    {
+        // stack: <table or nil> <element>...
+        reserve(depth);
+        m_p++;
+        lua_pushnil(L);
+        int table = lua_gettop(L);
+        int count = 0;
+        int pending = 0;
+
+        skipSpace();
+        if (m_p < m_end && *m_p == ']') {
+            m_p++;
+            lua_createtable(L, 0, 0);
+            lua_replace(L, table);
+            return;
+        }
+
+        for (;;) {
+            skipSpace();
+            parseValue(depth);
+            pending++;
+
+            skipSpace();
+            if (m_p == m_end) {
+                fail("unexpected end of text in array");
+            }
+            char c = *m_p++;
+            if (c == ']') {
+                break;
+            } else if (c != ',') {
+                m_p--;
+                fail("expect ',' or ']' in array");
+            }
+
+            if (pending == CHUNK_SIZE) {
+                flushArray(table, count, pending);
+                reserve(depth);
+            }
+        }
+        flushArray(table, count, pending);
+    }
+
+    void flushArray(int table, int& count, int& pending)
+    {
+        if (lua_isnil(L, table)) {
+            lua_createtable(L, pending, 0);
+            lua_replace(L, table);
+        }
+        for (int i = pending; i > 0; i--) {
+            lua_rawseti(L, table, count + i);
+        }
+        count += pending;
+        pending = 0;
+    }
+
+    void parseObject(int depth)
+    {
+        // stack: <table or nil> <key> <value>...
+        reserve(depth);
+        m_p++;
+        lua_pushnil(L);
+        int table = lua_gettop(L);
+        int pending = 0;
+
+        skipSpace();
+        if (m_p < m_end && *m_p == '}') {
+            m_p++;
+            lua_createtable(L, 0, 0);
+            lua_replace(L, table);
+            return;
+        }
+
+        for (;;) {
+            skipSpace();
+            if (m_p == m_end || *m_p != '"') {
+                fail("expect string key in object");
+            }
+            parseString(true);
+
+            skipSpace();
+            if (m_p == m_end || *m_p != ':') {
+                fail("expect ':' in object");
+            }
+            m_p++;
+            skipSpace();
+            parseValue(depth);
+            pending++;
+
+            skipSpace();
+            if (m_p == m_end) {
+                fail("unexpected end of text in object");
+            }
+            char c = *m_p++;
+            if (c == '}') {
+                break;
+            } else if (c != ',') {
+                m_p--;
+                fail("expect ',' or '}' in object");
+            }
+
+            if (pending == CHUNK_SIZE) {
+                flushObject(table, pending);
+                reserve(depth);
+            }
+        }
+        flushObject(table, pending);
+    }
+
+    void flushObject(int table, int& pending)
+    {
+        if (lua_isnil(L, table)) {
+            lua_createtable(L, 0, pending);
+            lua_replace(L, table);
+        }
+
+        // set in order, so the last one wins for duplicated key
+        for (int i = 0; i < pending; i++) {
+            lua_pushvalue(L, table + i * 2 + 1);
+            lua_pushvalue(L, table + i * 2 + 2);
+            lua_rawset(L, table);
+        }
+        lua_settop(L, table);
+        pending = 0;
+    }
+
+    void parseString(bool is_key)
+    {
+        const char* start = ++m_p;
+        const char* p = scanString(start, m_end);
+
+        if (p < m_end && *p == '"') {
+            m_p = p + 1;
+            if (is_key) {
+                pushKey(start, size_t(p - start));
+            } else {
+                lua_pushlstring(L, start, size_t(p - start));
+            }
+            return;
+        }
+
+        // slow path with escape sequence
+        m_buf.assign(start, p);
+        for (;;) {
+            m_p = p;
+            if (p == m_end) {
+                fail("unexpected end of text in string");
+            } else if (*p == '"') {
+                break;
+            } else if (*p != '\\') {
+                fail("invalid control character in string");
+            }
+
+            m_p = ++p;
+            if (p == m_end) {
+                fail("unexpected end of text in string");
+            }
+            switch (*p++) {
+            case '"': m_buf += '"'; break;
+            case '\\': m_buf += '\\'; break;
+            case '/': m_buf += '/'; break;
+            case 'b': m_buf += '\b'; break;
+            case 'f': m_buf += '\f'; break;
+            case 'n': m_buf += '\n'; break;
+            case 'r': m_buf += '\r'; break;
+            case 't': m_buf += '\t'; break;
+            case 'u': p = parseUnicode(p); break;
+            default: fail("invalid escape sequence in string");
+            }
+
+            const char* run = p;
+            p = scanString(p, m_end);
+            m_buf.append(run, p);
+        }
+
+        m_p = p + 1;
+        lua_pushlstring(L, m_buf.data(), m_buf.size());
+    }
+
+    const char* parseUnicode(const char* p)
+    {
+        uint32_t cp = parseHex(p);
+        p += 4;
+        if (cp >= 0xD800 && cp <= 0xDBFF) {
+            // surrogate pair
+            if (m_end - p < 6 || p[0] != '\\' || p[1] != 'u') {
+                fail("invalid unicode surrogate pair in string");
+            }
+            m_p = p + 2;
+            uint32_t low = parseHex(p + 2);
+            if (low < 0xDC00 || low > 0xDFFF) {
+                fail("invalid unicode surrogate pair in string");
+            }
+            cp = 0x10000 + ((cp - 0xD800) << 10) + (low - 0xDC00);
+            p += 6;
+        } else if (cp >= 0xDC00 && cp <= 0xDFFF) {
+            fail("invalid unicode surrogate pair in string");
+        }
+
+        if (cp < 0x80) {
+            m_buf += char(cp);
+        } else if (cp < 0x800) {
+            m_buf += char(0xC0 | (cp >> 6));
+            m_buf += char(0x80 | (cp & 0x3F));
+        } else if (cp < 0x10000) {
+            m_buf += char(0xE0 | (cp >> 12));
+            m_buf += char(0x80 | ((cp >> 6) & 0x3F));
+            m_buf += char(0x80 | (cp & 0x3F));
+        } else {
+            m_buf += char(0xF0 | (cp >> 18));
+            m_buf += char(0x80 | ((cp >> 12) & 0x3F));
+            m_buf += char(0x80 | ((cp >> 6) & 0x3F));
+            m_buf += char(0x80 | (cp & 0x3F));
+        }
+        return p;
+    }
+
+    uint32_t parseHex(const char* p)
+    {
+        if (m_end - p < 4) {
+            fail("invalid unicode escape in string");
+        }
+        uint32_t cp = 0;
+        for (int i = 0; i < 4; i++) {
+            char c = p[i];
+            cp <<= 4;
+            if (c >= '0' && c <= '9') {
+                cp |= uint32_t(c - '0');
+            } else if (c >= 'a' && c <= 'f') {
+                cp |= uint32_t(c - 'a' + 10);
+            } else if (c >= 'A' && c <= 'F') {
+                cp |= uint32_t(c - 'A' + 10);
+            } else {
+                fail("invalid unicode escape in string");
+            }
+        }
+        return cp;
+    }
+
+    void pushKey(const char* data, size_t len)
+    {
+        // direct mapped cache of the keys without escape, the data points into the text
+        size_t h = (len * 31 + (len ? size_t(uint8_t(data[0])) * 7 + uint8_t(data[len - 1]) : 0)) % KEY_CACHE_SIZE;
+        Key& key = m_keys[h];
+        if (key.data && key.len == len && std::memcmp(key.data, data, len) == 0) {
+            lua_rawgeti(L, m_cache, key.ref);
+            return;
+        }
+
+        lua_pushlstring(L, data, len);
+        if (key.data == nullptr) {
+            key.ref = ++m_cache_size;
+        }
+        key.data = data;
+        key.len = len;
+        lua_pushvalue(L, -1);
+        lua_rawseti(L, m_cache, key.ref);
+    }
+
+    void parseNumber()
+    {
+        const char* start = m_p;
+        const char* p = m_p;
+        bool neg = false;
+        if (p < m_end && *p == '-') {
+            neg = true;
+            p++;
+        }
+
+        // integer part, accumulate up to 18 digits that can not overflow
+        int64_t v = 0;
+        int digits = 0;
+        if (p < m_end && *p == '0') {
+            p++;
+            digits = 1;
+        } else if (p < m_end && *p >= '1' && *p <= '9') {
+            while (p < m_end && *p >= '0' && *p <= '9') {
+                v = v * 10 + (*p++ - '0');
+                digits++;
+            }
+        } else {
+            fail("invalid value");
+        }
+
+        bool is_int = digits <= 18;
+        if (p < m_end && *p == '.') {
+            p++;
+            if (p == m_end || *p < '0' || *p > '9') {
+                m_p = p;
+                fail("invalid number");
+            }
+            while (p < m_end && *p >= '0' && *p <= '9') p++;
+            is_int = false;
+        }
+        if (p < m_end && (*p == 'e' || *p == 'E')) {
+            p++;
+            if (p < m_end && (*p == '+' || *p == '-')) p++;
+            if (p == m_end || *p < '0' || *p > '9') {
+                m_p = p;
+                fail("invalid number");
+            }
+            while (p < m_end && *p >= '0' && *p <= '9') p++;
+            is_int = false;
+        }
+        m_p = p;
+
+        if (is_int) {
+#if LUA_VERSION_NUM >= 503
+            lua_pushinteger(L, lua_Integer(neg ? -v : v));
+#else
+            lua_pushnumber(L, lua_Number(neg ? -v : v));
+#endif
+            return;
+        }
+
+        // strtod needs terminated string with the decimal point of current locale
+        m_buf.assign(start, p);
+        if (m_point != '.') {
+            size_t dot = m_buf.find('.');
+            if (dot != std::string::npos) m_buf[dot] = m_point;
+        }
+        lua_pushnumber(L, lua_Number(std::strtod(m_buf.c_str(), nullptr)));
+    }
+
+private:
+    lua_State* L;
+    const char* m_begin;
+    const char* m_p;
+    const char* m_end;
+    char m_point;
+    int m_cache;
+    int m_cache_size;
+    std::string m_buf;
+    Key m_keys[KEY_CACHE_SIZE];
+};
+
+//---------------------------------------------------------------------------
+
+class LuaJson::Encoder
+{
+public:
+    Encoder(lua_State* state, std::string& out)
+        : L(state)
+        , m_out(out)
+        , m_point(*std::localeconv()->decimal_point)
+    {}
+
+    void encode(int index, int depth)
+    {
+        switch (lua_type(L, index)) {
+        case LUA_TNIL:
+            m_out.append("null", 4);
+            break;
+        case LUA_TBOOLEAN:
+            if (lua_toboolean(L, index)) {
+                m_out.append("true", 4);
+            } else {
+                m_out.append("false", 5);
+            }
+            break;
+        case LUA_TNUMBER:
+            encodeNumber(index);
+            break;
+        case LUA_TSTRING: {
+            size_t len;
+            const char* s = lua_tolstring(L, index, &len);
+            encodeString(s, len);
+            break;
+        }
+        case LUA_TTABLE:
+            encodeTable(index, depth + 1);
+            break;
+        case LUA_TLIGHTUSERDATA:
+            if (lua_touserdata(L, index) == nullptr) {
+                m_out.append("null", 4);
+                break;
+            }
+            // fall through
+        default:
+            fail(std::string("can not encode value of type ") + luaL_typename(L, index));
+        }
+    }
+
+private:
+    [[noreturn]] void fail(const std::string& message) const
+    {
+        throw LuaException("json encode error: " + message);
+    }
+
+    void encodeInteger(int64_t v)
+    {
+        char buf[24];
+        char* end = buf + sizeof(buf);
+        char* p = end;
+        uint64_t u = v < 0 ? 0 - uint64_t(v) : uint64_t(v);
+        do {
+            *--p = char('0' + u % 10);
+            u /= 10;
+        } while (u);
+        if (v < 0) *--p = '-';
+        m_out.append(p, size_t(end - p));
+    }
+
+    void encodeNumber(int index)
+    {
+#if LUA_VERSION_NUM >= 503
+        if (lua_isinteger(L, index)) {
+            encodeInteger(int64_t(lua_tointeger(L, index)));
+            return;
+        }
+#endif
+        double d = double(lua_tonumber(L, index));
+        if (std::isnan(d) || std::isinf(d)) {
+            fail("can not encode NaN or infinity");
+        }
+        if (d == std::floor(d) && std::fabs(d) < 9007199254740992.0) {
+            encodeInteger(int64_t(d));
+            return;
+        }
+
+        // shortest of 15 or 17 digits that converts back to the same value
+        char buf[32];
+        int n = std::snprintf(buf, sizeof(buf), "%.15g", d);
+        if (std::strtod(buf, nullptr) != d) {
+            n = std::snprintf(buf, sizeof(buf), "%.17g", d);
+        }
+        if (m_point != '.') {
+            char* dot = std::strchr(buf, m_point);
+            if (dot) *dot = '.';
+        }
+        m_out.append(buf, size_t(n));
+    }
+
+    void encodeString(const char* s, size_t len)
+    {
+        static const char hex[] = "0123456789abcdef";
+        const char* end = s + len;
+        m_out += '"';
+        for (;;) {
+            const char* p = scanString(s, end);
+            m_out.append(s, p);
+            if (p == end) break;
+
+            char c = *p;
+            switch (c) {
+            case '"': m_out.append("\\\"", 2); break;
+            case '\\': m_out.append("\\\\", 2); break;
+            case '\b': m_out.append("\\b", 2); break;
+            case '\f': m_out.append("\\f", 2); break;
+            case '\n': m_out.append("\\n", 2); break;
+            case '\r': m_out.append("\\r", 2); break;
+            case '\t': m_out.append("\\t", 2); break;
+            default: {
+                char buf[6] = { '\\', 'u', '0', '0', hex[(c >> 4) & 0xF], hex[c & 0xF] };
+                m_out.append(buf, 6);
+                break;
+            }
+            }
+            s = p + 1;
+        }
+        m_out += '"';
+    }
+
+    void encodeTable(int index, int depth)
+    {
+        if (depth > MAX_DEPTH) {
+            fail("nested too deep or table has cycle");
+        }
+        if (!lua_checkstack(L, LUA_MINSTACK)) {
+            fail("out of stack space");
+        }
+        index = lua_absindex(L, index);
+
+        // the table is array if the keys are exactly 1..n
+        size_t n = lua_rawlen(L, index);
+        size_t count = 0;
+        bool is_array = n > 0;
+        lua_pushnil(L);
+        while (lua_next(L, index)) {
+            lua_pop(L, 1);
+            count++;
+            if (is_array && (lua_type(L, -1) != LUA_TNUMBER || count > n)) {
+                is_array = false;
+            }
+        }
+        is_array = is_array && count == n;
+
+        if (is_array) {
+            m_out += '[';
+            for (size_t i = 1; i <= n; i++) {
+                if (i > 1) m_out += ',';
+                lua_rawgeti(L, index, lua_Integer(i));
+                encode(-1, depth);
+                lua_pop(L, 1);
+            }
+            m_out += ']';
+            return;
+        }
+
+        m_out += '{';
+        bool first = true;
+        lua_pushnil(L);
+        while (lua_next(L, index)) {
+            if (!first) m_out += ',';
+            first = false;
+
+            int type = lua_type(L, -2);
+            if (type == LUA_TSTRING) {
+                size_t len;
+                const char* s = lua_tolstring(L, -2, &len);
+                encodeString(s, len);
+            } else if (type == LUA_TNUMBER) {
+                // copy the key, so lua_next is not confused
+                m_out += '"';
+                lua_pushvalue(L, -2);
+                encodeNumber(-1);
+                lua_pop(L, 1);
+                m_out += '"';
+            } else {
+                lua_pop(L, 2);
+                fail(std::string("can not encode table key of type ") + lua_typename(L, type));
+            }
+
+            m_out += ':';
+            encode(-1, depth);
+            lua_pop(L, 1);
+        }
+        m_out += '}';
+    }
+
+private:
+    lua_State* L;
+    std::string& m_out;
+    char m_point;
+};
+
+//---------------------------------------------------------------------------
+
+LUA_INLINE const char* LuaJson::scanString(const char* p, const char* end)
+{
+    // find the first '"', '\\' or control character
+#if LUAINTF_JSON_SSE2
+    const __m128i quote = _mm_set1_epi8('"');
+    const __m128i slash = _mm_set1_epi8('\\');
+    const __m128i ctrl = _mm_set1_epi8(0x1F);
+    while (end - p >= 16) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        __m128i m = _mm_or_si128(
+            _mm_or_si128(_mm_cmpeq_epi8(v, quote), _mm_cmpeq_epi8(v, slash)),
+            _mm_cmpeq_epi8(_mm_min_epu8(v, ctrl), v));
+        unsigned mask = unsigned(_mm_movemask_epi8(m));
+        if (mask) {
+#ifdef _MSC_VER
+            unsigned long bit;
+            _BitScanForward(&bit, mask);
+            return p + bit;
+#else
+            return p + __builtin_ctz(mask);
+#endif
+        }
+        p += 16;
+    }
+#endif
+
+    while (p < end && *p != '"' && *p != '\\' && uint8_t(*p) >= 0x20) {
+        p++;
+    }
+    return p;
+}
+
+LUA_INLINE void LuaJson::decode(lua_State* L, const char* data, size_t len)
+{
+    int top = lua_gettop(L);
+    try {
+        Decoder decoder(L, data, len);
+        decoder.parse();
+    } catch (...) {
+        lua_settop(L, top);
+        throw;
+    }
+}
+
+LUA_INLINE void LuaJson::encode(lua_State* L, int index, std::string& out)
+{
+    int top = lua_gettop(L);
+    try {
+        Encoder encoder(L, out);
+        encoder.encode(lua_absindex(L, index), 0);
+    } catch (...) {
+        lua_settop(L, top);
+        throw;
+    }
+}
+
+LUA_INLINE std::string LuaJson::encode(const LuaRef& value)
+{
+    lua_State* L = value.state();
+    std::string out;
+    value.pushToStack();
+    encode(L, -1, out);
+    lua_pop(L, 1);
+    return out;
+}
+
+LUA_INLINE void LuaJson::bind(lua_State* L, const char* name)
+{
+    static const luaL_Reg funcs[] = {
+        { "decode", &decodeFunc },
+        { "encode", &encodeFunc },
+        { nullptr, nullptr }
+    };
+
+    lua_newtable(L);
+    luaL_setfuncs(L, funcs, 0);
+    lua_pushlightuserdata(L, nullptr);
+    lua_setfield(L, -2, "null");
+    Lua::popToGlobal(L, name);
+}
+
+LUA_INLINE int LuaJson::decodeFunc(lua_State* L)
+{
+    size_t len;
+    const char* data = luaL_checklstring(L, 1, &len);
+    try {
+        decode(L, data, len);
+        return 1;
+    } catch (std::exception& e) {
+        return luaL_error(L, "%s", e.what());
+    }
+}
+
+LUA_INLINE int LuaJson::encodeFunc(lua_State* L)
+{
+    luaL_checkany(L, 1);
+    try {
+        std::string out;
+        encode(L, 1, out);
+        lua_pushlstring(L, out.data(), out.size());
+        return 1;
+    } catch (std::exception& e) {
+        return luaL_error(L, "%s", e.what());
+    }
+}
@@ -0,0 +1,143 @@
+//
+// https://github.com/SteveKChiu/lua-intf
+//
+// Copyright 2014, Steve K. Chiu <steve.k.chiu@gmail.com>
+//
+// The MIT License (http://www.opensource.org/licenses/mit-license.php)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+//
+
+#ifndef LUAINTF_H
+    #include "LuaIntf/LuaIntf.h"
+    using namespace LuaIntf;
+#endif
+
+//---------------------------------------------------------------------------
+
+LUA_INLINE LuaMemoryQuota::LuaMemoryQuota(size_t hard_limit, size_t soft_limit, lua_Alloc alloc, void* userdata)
+    : m_alloc(alloc ? alloc : &defaultAlloc)
+    , m_ud(userdata)
+    , m_retry_ptr(nullptr)
+    , m_retry_size(0)
+    , m_retry(false)
+    , m_gc_running(true)
+    , m_used(0)
+    , m_peak(0)
+    , m_collections(0)
+    , m_failures(0)
+{
+    setLimits(hard_limit, soft_limit);
+}
+
+LUA_INLINE void LuaMemoryQuota::setLimits(size_t hard_limit, size_t soft_limit)
+{
+    m_hard_limit = hard_limit;
+    m_soft_limit = soft_limit;
+    m_trigger = soft_limit;
+}
+
+LUA_INLINE void* LuaMemoryQuota::defaultAlloc(void*, void* ptr, size_t, size_t nsize)
+{
+    if (nsize == 0) {
+        free(ptr);
+        return nullptr;
+    } else {
+        return realloc(ptr, nsize);
+    }
+}
+
+LUA_INLINE int LuaMemoryQuota::gc(lua_State* L, int what, int data)
+{
+    int ret = LuaMetrics::gc(L, what, data);
+#if LUA_VERSION_NUM == 502
+    // lua_gc can not be called inside the allocator, so the state is refreshed here,
+    // the quota is wrapped by the release queue and then the metrics (see LuaContext)
+    void* ud;
+    lua_Alloc alloc = LuaReleaseQueue::unwrap(LuaMetrics::unwrap(lua_getallocf(L, &ud), &ud), &ud);
+    if (alloc == &allocate) {
+        static_cast<LuaMemoryQuota*>(ud)->m_gc_running = lua_gc(L, LUA_GCISRUNNING, 0) != 0;
+    }
+#endif
+    return ret;
+}
+
+LUA_INLINE void* LuaMemoryQuota::allocate(void* userdata, void* ptr, size_t osize, size_t nsize)
+{
+    LuaMemoryQuota* quota = static_cast<LuaMemoryQuota*>(userdata);
+
+    // osize is the object type if ptr is null
+    if (!ptr) osize = 0;
+    size_t used = quota->m_used.load(std::memory_order_relaxed);
+
+    if (nsize > osize) {
+        size_t next = used + (nsize - osize);
+
+        // Lua runs emergency full GC when allocation fails, and then retries the same request,
+        // the retry is exempted from the soft limit, so only the hard limit can fail it
+        bool retry = quota->m_retry && quota->m_retry_ptr == ptr && quota->m_retry_size == nsize;
+        quota->m_retry = false;
+
+#if LUA_VERSION_NUM >= 502
+        // Lua 5.2 does not retry if the collector is stopped, the refusal would be memory error
+        if (quota->m_soft_limit && quota->m_gc_running) {
+            if (retry) {
+                // still above soft limit after GC, back off to avoid GC on every allocation
+                if (next > quota->m_soft_limit) {
+                    size_t room = quota->m_hard_limit > next ? (quota->m_hard_limit - next) / 2 : next / 2;
+                    quota->m_trigger = next + std::max(room, quota->m_soft_limit / 16);
+                }
+            } else if (next > quota->m_trigger) {
+                quota->m_retry = true;
+                quota->m_retry_ptr = ptr;
+                quota->m_retry_size = nsize;
+                add(quota->m_collections, 1);
+                return nullptr;
+            }
+        }
+#endif
+
+        if (quota->m_hard_limit && next > quota->m_hard_limit) {
+            quota->m_retry = !retry;
+            quota->m_retry_ptr = ptr;
+            quota->m_retry_size = nsize;
+            add(quota->m_failures, 1);
+            return nullptr;
+        }
+
+        void* p = quota->m_alloc(quota->m_ud, ptr, osize, nsize);
+        if (p) {
+            quota->m_used.store(next, std::memory_order_relaxed);
+            if (next > quota->m_peak.load(std::memory_order_relaxed)) {
+                quota->m_peak.store(next, std::memory_order_relaxed);
+            }
+        }
+        return p;
+    } else {
+        void* p = quota->m_alloc(quota->m_ud, ptr, osize, nsize);
+        if (p || nsize == 0) {
+            used -= osize - nsize;
+            quota->m_used.store(used, std::memory_order_relaxed);
+            if (used < quota->m_soft_limit) {
+                quota->m_trigger = quota->m_soft_limit;
+            }
+        }
+        return p;
+    }
+}
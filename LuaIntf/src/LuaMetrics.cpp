@@ -0,0 +1,263 @@
+//
+// https://github.com/SteveKChiu/lua-intf
+//
+// Copyright 2014, Steve K. Chiu <steve.k.chiu@gmail.com>
+//
+// The MIT License (http://www.opensource.org/licenses/mit-license.php)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+//
+
+#ifndef LUAINTF_H
+    #include "LuaIntf/LuaIntf.h"
+    using namespace LuaIntf;
+#endif
+
+
+//---------------------------------------------------------------------------
+
+#if LUAINTF_METRICS
+
+LUA_INLINE LuaMetrics::Sample::Sample()
+    : bytes(0)
+    , peak_bytes(0)
+    , allocations(0)
+    , gc_cycles(0)
+    , gc_time(0)
+    , registry_size(0)
+    , live_refs(0)
+    , live_objects(0)
+    , created_objects(0)
+    , calls()
+    , errors()
+{}
+
+LUA_INLINE LuaMetrics::Sample& LuaMetrics::Sample::operator += (const Sample& that)
+{
+    bytes += that.bytes;
+    peak_bytes += that.peak_bytes;
+    allocations += that.allocations;
+    gc_cycles += that.gc_cycles;
+    gc_time += that.gc_time;
+    registry_size += that.registry_size;
+    live_refs += that.live_refs;
+    live_objects += that.live_objects;
+    created_objects += that.created_objects;
+    for (int i = 0; i < DIRECTIONS; i++) {
+        calls[i] += that.calls[i];
+    }
+    for (int i = 0; i < ERROR_KINDS; i++) {
+        errors[i] += that.errors[i];
+    }
+    return *this;
+}
+
+LUA_INLINE LuaMetrics::LuaMetrics(lua_Alloc alloc, void* ud, const std::string& name)
+    : m_alloc(alloc)
+    , m_ud(ud)
+    , m_name(name)
+    , m_bytes(0)
+    , m_peak_bytes(0)
+    , m_allocations(0)
+    , m_gc_cycles(0)
+    , m_gc_time(0)
+    , m_registry_size(0)
+    , m_refs(0)
+    , m_objects(0)
+    , m_created_objects(0)
+{
+    for (auto& n : m_calls) {
+        n.store(0, std::memory_order_relaxed);
+    }
+    for (auto& n : m_errors) {
+        n.store(0, std::memory_order_relaxed);
+    }
+}
+
+LUA_INLINE LuaMetrics* LuaMetrics::attach(lua_State* L, const std::string& name)
+{
+    LuaMetrics* metrics = find(L);
+    if (metrics) return metrics;
+
+    void* ud;
+    lua_Alloc alloc = lua_getallocf(L, &ud);
+    metrics = new LuaMetrics(alloc, ud, name);
+
+    // the memory allocated before attach is taken from GC count
+    size_t bytes = size_t(lua_gc(L, LUA_GCCOUNT, 0)) * 1024 + size_t(lua_gc(L, LUA_GCCOUNTB, 0));
+    metrics->m_bytes.store(bytes, std::memory_order_relaxed);
+    metrics->m_peak_bytes.store(bytes, std::memory_order_relaxed);
+    metrics->m_registry_size.store(lua_rawlen(L, LUA_REGISTRYINDEX), std::memory_order_relaxed);
+
+    lua_setallocf(L, &allocate, metrics);
+    pushSentinel(L);
+
+    std::lock_guard<std::mutex> lock(attachedMutex());
+    attached().push_back(metrics);
+    return metrics;
+}
+
+LUA_INLINE void LuaMetrics::detach(lua_State* L)
+{
+    LuaMetrics* metrics = find(L);
+    if (!metrics) return;
+
+    {
+        std::lock_guard<std::mutex> lock(attachedMutex());
+        std::vector<LuaMetrics*>& list = attached();
+        list.erase(std::find(list.begin(), list.end(), metrics));
+    }
+
+    lua_setallocf(L, metrics->m_alloc, metrics->m_ud);
+    delete metrics;
+}
+
+LUA_INLINE void LuaMetrics::forEach(const std::function<void(const LuaMetrics&)>& func)
+{
+    std::lock_guard<std::mutex> lock(attachedMutex());
+    for (LuaMetrics* metrics : attached()) {
+        func(*metrics);
+    }
+}
+
+LUA_INLINE LuaMetrics::Sample LuaMetrics::total()
+{
+    Sample sum;
+    forEach([&sum] (const LuaMetrics& metrics) {
+        sum += metrics.sample();
+    });
+    return sum;
+}
+
+LUA_INLINE LuaMetrics::Sample LuaMetrics::sample() const
+{
+    Sample s;
+    s.bytes = load(m_bytes);
+    s.peak_bytes = load(m_peak_bytes);
+    s.allocations = load(m_allocations);
+    s.gc_cycles = load(m_gc_cycles);
+    s.gc_time = std::chrono::nanoseconds(m_gc_time.load(std::memory_order_relaxed));
+    s.registry_size = load(m_registry_size);
+    s.live_refs = load(m_refs);
+    s.live_objects = load(m_objects);
+    s.created_objects = load(m_created_objects);
+    for (int i = 0; i < DIRECTIONS; i++) {
+        s.calls[i] = load(m_calls[i]);
+    }
+    for (int i = 0; i < ERROR_KINDS; i++) {
+        s.errors[i] = load(m_errors[i]);
+    }
+    return s;
+}
+
+LUA_INLINE int LuaMetrics::gc(lua_State* L, int what, int data)
+{
+    LuaMetrics* metrics = find(L);
+    if (!metrics || (what != LUA_GCCOLLECT && what != LUA_GCSTEP)) {
+        return lua_gc(L, what, data);
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    int ret = lua_gc(L, what, data);
+    auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start);
+    metrics->m_gc_time.store(metrics->m_gc_time.load(std::memory_order_relaxed) + elapsed.count(),
+        std::memory_order_relaxed);
+    return ret;
+}
+
+LUA_INLINE void LuaMetrics::addError(lua_State* L, int err)
+{
+    LuaMetrics* metrics = find(L);
+    if (!metrics) return;
+
+    ErrorKind kind;
+    switch (err) {
+        case LUA_ERRRUN:
+            kind = RUNTIME_ERROR;
+            break;
+        case LUA_ERRSYNTAX:
+            kind = SYNTAX_ERROR;
+            break;
+        case LUA_ERRMEM:
+            kind = MEMORY_ERROR;
+            break;
+        case LUA_ERRFILE:
+            kind = FILE_ERROR;
+            break;
+        default:
+            kind = HANDLER_ERROR;
+            break;
+    }
+    add(metrics->m_errors[kind], 1);
+}
+
+LUA_INLINE void* LuaMetrics::allocate(void* ud, void* ptr, size_t osize, size_t nsize)
+{
+    LuaMetrics* metrics = static_cast<LuaMetrics*>(ud);
+    void* mem = metrics->m_alloc(metrics->m_ud, ptr, osize, nsize);
+    if (mem || nsize == 0) {
+        // osize is the type tag if ptr is nullptr
+        size_t bytes = load(metrics->m_bytes) - (ptr ? osize : 0) + nsize;
+        metrics->m_bytes.store(bytes, std::memory_order_relaxed);
+        if (bytes > load(metrics->m_peak_bytes)) {
+            metrics->m_peak_bytes.store(bytes, std::memory_order_relaxed);
+        }
+        if (!ptr && nsize) {
+            add(metrics->m_allocations, 1);
+        }
+    }
+    return mem;
+}
+
+LUA_INLINE void LuaMetrics::pushSentinel(lua_State* L)
+{
+    // unreachable userdata, so its __gc is called once per GC cycle
+    lua_newuserdata(L, 1);
+    lua_createtable(L, 0, 1);
+    lua_pushcfunction(L, &collectSentinel);
+    lua_setfield(L, -2, "__gc");
+    lua_setmetatable(L, -2);
+    lua_pop(L, 1);
+}
+
+LUA_INLINE int LuaMetrics::collectSentinel(lua_State* L)
+{
+    // the metrics is detached before the state is closed, so no new sentinel when closing
+    LuaMetrics* metrics = find(L);
+    if (metrics) {
+        add(metrics->m_gc_cycles, 1);
+        metrics->m_registry_size.store(lua_rawlen(L, LUA_REGISTRYINDEX), std::memory_order_relaxed);
+        pushSentinel(L);
+    }
+    return 0;
+}
+
+LUA_INLINE std::vector<LuaMetrics*>& LuaMetrics::attached()
+{
+    static std::vector<LuaMetrics*> list;
+    return list;
+}
+
+LUA_INLINE std::mutex& LuaMetrics::attachedMutex()
+{
+    static std::mutex mutex;
+    return mutex;
+}
+
+#endif
@@ -84,8 +84,8 @@ LUA_INLINE LuaTableIterator::LuaTableIterator(LuaTableIterator&& that)
 LUA_INLINE LuaTableIterator::~LuaTableIterator()
 {
     if (L) {
-        luaL_unref(L, LUA_REGISTRYINDEX, m_key);
-        luaL_unref(L, LUA_REGISTRYINDEX, m_value);
+        LuaReleaseQueue::unref(L, m_key);
+        LuaReleaseQueue::unref(L, m_value);
     }
 }
 
@@ -158,6 +158,7 @@ LUA_INLINE LuaRef::LuaRef(const LuaRef& that)
     if (L) {
         lua_rawgeti(L, LUA_REGISTRYINDEX, that.m_ref);
         m_ref = luaL_ref(L, LUA_REGISTRYINDEX);
+        LuaMetrics::addRef(L, m_ref, 1);
     } else {
         m_ref = LUA_NOREF;
     }
@@ -167,12 +168,14 @@ LUA_INLINE LuaRef& LuaRef::operator = (const LuaRef& that)
 {
     if (this != &that) {
         if (L) {
+            LuaMetrics::addRef(L, m_ref, -1);
             luaL_unref(L, LUA_REGISTRYINDEX, m_ref);
         }
         L = that.L;
         if (L) {
             lua_rawgeti(L, LUA_REGISTRYINDEX, that.m_ref);
             m_ref = luaL_ref(L, LUA_REGISTRYINDEX);
+            LuaMetrics::addRef(L, m_ref, 1);
         } else {
             m_ref = LUA_NOREF;
         }
@@ -259,3 +262,106 @@ LUA_INLINE void LuaRef::setMetaTable(const LuaRef& meta)
     lua_setmetatable(L, -2);
     lua_pop(L, 1);
 }
+
+//---------------------------------------------------------------------------
+
+LUA_INLINE LuaDispatcher::LuaDispatcher(lua_State* L, const char* name)
+    : m_name(LuaRef::fromValue(L, name))
+{
+    invalidate();
+}
+
+LUA_INLINE void LuaDispatcher::invalidate()
+{
+    lua_State* L = state();
+    lua_newtable(L);
+    lua_createtable(L, 0, 1);
+    lua_pushliteral(L, "k");
+    lua_setfield(L, -2, "__mode");
+    lua_setmetatable(L, -2);
+    m_cache = LuaRef::popFromStack(L);
+}
+
+LUA_INLINE void LuaDispatcher::pushMethod(const LuaRef& obj) const
+{
+    lua_State* L = state();
+
+    // stack: obj name
+    obj.pushToStack();
+    int base = lua_gettop(L);
+    m_name.pushToStack();
+
+    // field in object itself takes precedence
+    if (lua_istable(L, base)) {
+        lua_pushvalue(L, base + 1);
+        lua_rawget(L, base);
+        if (!lua_isnil(L, -1)) {
+            lua_replace(L, base);
+            lua_settop(L, base);
+            return;
+        }
+        lua_pop(L, 1);
+    }
+
+    // stack: obj name meta cache entry
+    if (lua_getmetatable(L, base)) {
+        m_cache.pushToStack();
+        lua_pushvalue(L, base + 2);
+        lua_rawget(L, base + 3);
+
+        // entry = { holder, func }, valid if holder[name] is still func
+        if (lua_istable(L, base + 4)) {
+            lua_rawgeti(L, base + 4, 1);
+            lua_pushvalue(L, base + 1);
+            lua_rawget(L, -2);
+            lua_rawgeti(L, base + 4, 2);
+            if (!lua_isnil(L, -1) && lua_rawequal(L, -1, -2)) {
+                lua_replace(L, base);
+                lua_settop(L, base);
+                return;
+            }
+        }
+
+        // walk the __index chain, stack: obj name meta cache meta
+        lua_settop(L, base + 3);
+        lua_pushvalue(L, base + 2);
+        for (int depth = 0; depth < 100; depth++) {
+            lua_pushliteral(L, "__index");
+            lua_rawget(L, -2);
+            lua_remove(L, -2);
+            if (!lua_istable(L, -1)) {
+                break;
+            }
+
+            // stack: obj name meta cache holder func
+            lua_pushvalue(L, base + 1);
+            lua_rawget(L, -2);
+            if (!lua_isnil(L, -1)) {
+                lua_pushvalue(L, base + 2);
+                lua_createtable(L, 2, 0);
+                lua_pushvalue(L, -4);
+                lua_rawseti(L, -2, 1);
+                lua_pushvalue(L, -3);
+                lua_rawseti(L, -2, 2);
+                lua_rawset(L, base + 3);
+                lua_replace(L, base);
+                lua_settop(L, base);
+                return;
+            }
+            lua_pop(L, 1);
+
+            if (!lua_getmetatable(L, -1)) {
+                lua_pushnil(L);
+                lua_replace(L, base);
+                lua_settop(L, base);
+                return;
+            }
+            lua_remove(L, -2);
+        }
+    }
+
+    // fallback to normal lookup, stack: obj name
+    lua_settop(L, base + 1);
+    lua_gettable(L, base);
+    lua_replace(L, base);
+}
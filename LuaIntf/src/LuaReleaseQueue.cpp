@@ -0,0 +1,136 @@
+//
+// https://github.com/SteveKChiu/lua-intf
+//
+// Copyright 2014, Steve K. Chiu <steve.k.chiu@gmail.com>
+//
+// The MIT License (http://www.opensource.org/licenses/mit-license.php)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+//
+
+#ifndef LUAINTF_H
+    #include "LuaIntf/LuaIntf.h"
+    using namespace LuaIntf;
+#endif
+
+//---------------------------------------------------------------------------
+
+#if LUAINTF_DEFERRED_UNREF
+
+LUA_INLINE LuaReleaseQueue::LuaReleaseQueue(lua_Alloc alloc, void* ud)
+    : m_head(nullptr)
+    , m_owner(std::this_thread::get_id())
+    , m_alloc(alloc)
+    , m_ud(ud)
+{}
+
+LUA_INLINE LuaReleaseQueue::~LuaReleaseQueue()
+{
+    Node* node = m_head.exchange(nullptr, std::memory_order_acquire);
+    while (node) {
+        Node* next = node->next;
+        delete node;
+        node = next;
+    }
+}
+
+LUA_INLINE void LuaReleaseQueue::attach(lua_State* L)
+{
+    if (find(L)) return;
+
+    void* ud;
+    lua_Alloc alloc = lua_getallocf(L, &ud);
+    lua_setallocf(L, &allocate, new LuaReleaseQueue(alloc, ud));
+    pushSentinel(L);
+}
+
+LUA_INLINE void LuaReleaseQueue::detach(lua_State* L)
+{
+    LuaReleaseQueue* queue = find(L);
+    if (!queue) return;
+
+    queue->release(L);
+    lua_setallocf(L, queue->m_alloc, queue->m_ud);
+    delete queue;
+}
+
+LUA_INLINE void LuaReleaseQueue::setOwner(lua_State* L, std::thread::id owner)
+{
+    LuaReleaseQueue* queue = find(L);
+    if (queue) {
+        queue->m_owner.store(owner, std::memory_order_relaxed);
+    }
+}
+
+LUA_INLINE void LuaReleaseQueue::drain(lua_State* L)
+{
+    LuaReleaseQueue* queue = find(L);
+    if (queue) {
+        queue->release(L);
+    }
+}
+
+LUA_INLINE void* LuaReleaseQueue::allocate(void* ud, void* ptr, size_t osize, size_t nsize)
+{
+    LuaReleaseQueue* queue = static_cast<LuaReleaseQueue*>(ud);
+    return queue->m_alloc(queue->m_ud, ptr, osize, nsize);
+}
+
+LUA_INLINE void LuaReleaseQueue::pushSentinel(lua_State* L)
+{
+    // unreachable userdata, so its __gc is called once per GC cycle
+    lua_newuserdata(L, 1);
+    lua_createtable(L, 0, 1);
+    lua_pushcfunction(L, &collectSentinel);
+    lua_setfield(L, -2, "__gc");
+    lua_setmetatable(L, -2);
+    lua_pop(L, 1);
+}
+
+LUA_INLINE int LuaReleaseQueue::collectSentinel(lua_State* L)
+{
+    // the queue is detached before the state is closed, so no new sentinel when closing
+    LuaReleaseQueue* queue = find(L);
+    if (queue) {
+        queue->release(L);
+        pushSentinel(L);
+    }
+    return 0;
+}
+
+LUA_INLINE void LuaReleaseQueue::push(int ref)
+{
+    Node* node = new Node { ref, m_head.load(std::memory_order_relaxed) };
+    while (!m_head.compare_exchange_weak(node->next, node,
+        std::memory_order_release, std::memory_order_relaxed)) {}
+}
+
+LUA_INLINE void LuaReleaseQueue::release(lua_State* L)
+{
+    // take the whole list at once, so there is no ABA problem
+    Node* node = m_head.exchange(nullptr, std::memory_order_acquire);
+    while (node) {
+        luaL_unref(L, LUA_REGISTRYINDEX, node->ref);
+        Node* next = node->next;
+        delete node;
+        node = next;
+    }
+}
+
+#endif
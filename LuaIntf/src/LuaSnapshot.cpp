@@ -0,0 +1,1367 @@
+//
+// https://github.com/SteveKChiu/lua-intf
+//
+// Copyright 2014, Steve K. Chiu <steve.k.chiu@gmail.com>
+//
+// The MIT License (http://www.opensource.org/licenses/mit-license.php)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+//
+
+#ifndef LUASNAPSHOT_H
+    #include "LuaIntf/LuaSnapshot.h"
+    using namespace LuaIntf;
+#endif
+
+//---------------------------------------------------------------------------
+
+class LuaSnapshot::Writer
+{
+public:
+    using Sink = std::function<void(const char* data, size_t size)>;
+
+    Writer(lua_State* state, bool strip, bool portable, const Hooks* hooks, const Sink& sink)
+        : L(state)
+        , m_strip(strip)
+        , m_portable(portable)
+        , m_hooks(hooks)
+        , m_sink(sink)
+        , m_emit(false)
+        , m_count(0)
+        , m_roots(0)
+        , m_strings(0)
+    {}
+
+    void run()
+    {
+        lua_checkstack(L, 16);
+        lua_newtable(L);
+        m_seen_index = lua_gettop(L);
+        lua_newtable(L);
+        m_objs_index = lua_gettop(L);
+        lua_newtable(L);
+        m_keys_index = lua_gettop(L);
+        lua_newtable(L);
+        m_strings_index = lua_gettop(L);
+        lua_newtable(L);
+        m_hooks_index = lua_gettop(L);
+        if (m_hooks) {
+            for (size_t i = 0; i < m_hooks->m_hooks.size(); i++) {
+                addHook(m_hooks->m_hooks[i].class_id, i);
+                addHook(m_hooks->m_hooks[i].const_id, i);
+            }
+        }
+        m_objects.push_back(Object());
+
+        // roots: registry, globals and string metatable
+        lua_pushvalue(L, LUA_REGISTRYINDEX);
+        discover(lua_gettop(L), 0, 0, 0);
+        lua_pushglobaltable(L);
+        discover(lua_gettop(L), 0, 0, 0);
+        lua_pushliteral(L, "");
+        if (lua_getmetatable(L, -1)) {
+            discover(lua_gettop(L), 0, 0, 0);
+            lua_pop(L, 1);
+        }
+        lua_pop(L, 3);
+        m_roots = m_count;
+
+        // the first pass discovers the objects and their paths breadth first, nothing is written
+        for (int id = 1; id <= m_count; id++) {
+            process(id);
+        }
+        int count = m_count;
+
+        // the second pass writes the paths and objects before the contents, so the reader can
+        // resolve the paths and create the objects in one sequential read
+        m_emit = true;
+        m_upvalues.clear();
+        m_buf.clear();
+        putBytes("LUAISNAP", 8);
+        putVarint(VERSION);
+        putVarint(LUA_VERSION_NUM);
+        putVarint(sizeof(void*));
+        putVarint(sizeof(lua_Number));
+        putVarint(m_portable ? FLAG_PORTABLE : 0);
+        putVarint(uint64_t(m_count));
+        putVarint(uint64_t(m_roots));
+        putPaths();
+        putVarint(m_anchors.size());
+        for (auto& anchor : m_anchors) {
+            putVarint(uint64_t(anchor.id));
+            putVarint(uint64_t(anchor.meta));
+            putVarint(uint64_t(anchor.type));
+        }
+        for (int id = 1; id <= m_count; id++) {
+            create(id);
+        }
+        for (int id = 1; id <= m_count; id++) {
+            process(id);
+        }
+        if (m_count != count) {
+            throw LuaException("can not capture heap, it is changed during capture");
+        }
+        flush(true);
+    }
+
+private:
+    static const int ORIGIN_METATABLE = -1;
+    static const int MAX_ORIGINS = 4;
+
+    struct Origin
+    {
+        int parent;
+        int step;
+    };
+
+    struct Object
+    {
+        Object()
+            : tag(0), hook(0), depth(0), origins(0), narr(0), nhash(0)
+            {}
+
+        char tag;
+        int hook;
+        int depth;
+        int origins;
+        Origin origin[MAX_ORIGINS];
+        uint64_t narr;
+        uint64_t nhash;
+    };
+
+    struct Anchor
+    {
+        int id;
+        int meta;
+        int type;
+    };
+
+    void flush(bool force = false)
+    {
+        if (force || m_buf.size() >= 0x10000) {
+            if (m_emit && !m_buf.empty()) {
+                m_sink(m_buf.data(), m_buf.size());
+            }
+            m_buf.clear();
+        }
+    }
+
+    void put(char c)
+    {
+        m_buf += c;
+    }
+
+    void putBytes(const char* p, size_t size)
+    {
+        m_buf.append(p, size);
+    }
+
+    void putBlob(const char* p, size_t size)
+    {
+        putVarint(size);
+        putBytes(p, size);
+    }
+
+    void putVarint(uint64_t v)
+    {
+        while (v >= 0x80) {
+            m_buf += char((v & 0x7f) | 0x80);
+            v >>= 7;
+        }
+        m_buf += char(v);
+    }
+
+    template <typename T>
+    void putRaw(const T& v)
+    {
+        m_buf.append(reinterpret_cast<const char*>(&v), sizeof(T));
+    }
+
+    static int dump(lua_State*, const void* p, size_t size, void* data)
+    {
+        static_cast<std::string*>(data)->append(static_cast<const char*>(p), size);
+        return 0;
+    }
+
+    void addHook(void* class_id, size_t index)
+    {
+        lua_rawgetp(L, LUA_REGISTRYINDEX, class_id);
+        if (lua_istable(L, -1)) {
+            lua_pushinteger(L, lua_Integer(index + 1));
+            lua_rawset(L, m_hooks_index);
+        } else {
+            lua_pop(L, 1);
+        }
+    }
+
+    /**
+     * Get the hook of bound object (userdata or handle) at the index, 1-based, or 0 if not hooked
+     */
+    int findHook(int index)
+    {
+        if (!m_hooks || m_hooks->m_hooks.empty() || !CppObject::getMetaTable(L, index)) {
+            return 0;
+        }
+        lua_rawget(L, m_hooks_index);
+        int hook = int(lua_tointeger(L, -1));
+        lua_pop(L, 1);
+        return hook;
+    }
+
+    bool isPathKey(int type) const
+    {
+        return type == LUA_TSTRING || type == LUA_TNUMBER
+            || type == LUA_TBOOLEAN || (type == LUA_TLIGHTUSERDATA && !m_portable);
+    }
+
+    int discover(int index, int parent, int key, int step)
+    {
+        bool has_origin = parent && (step || (key && isPathKey(lua_type(L, key))));
+
+        lua_pushvalue(L, index);
+        lua_rawget(L, m_seen_index);
+        if (!lua_isnil(L, -1)) {
+            int id = int(lua_tointeger(L, -1));
+            lua_pop(L, 1);
+
+            if (!m_emit && has_origin && parent != id && id > m_roots) {
+                addOrigin(id, parent, key, step);
+            }
+            return id;
+        }
+        lua_pop(L, 1);
+
+        int id = ++m_count;
+        lua_pushvalue(L, index);
+        lua_pushinteger(L, id);
+        lua_rawset(L, m_seen_index);
+        lua_pushvalue(L, index);
+        lua_rawseti(L, m_objs_index, id);
+
+        m_objects.push_back(Object());
+        if (has_origin && m_roots) {
+            addOrigin(id, parent, key, step);
+        }
+        return id;
+    }
+
+    /**
+     * Add the path of object, the object may have several paths and not all of them exist in
+     * the restored state, so the shortest ones are kept (the earlier first if same length)
+     */
+    void addOrigin(int id, int parent, int key, int step)
+    {
+        int depth = m_objects[parent].depth + 1;
+        Object& object = m_objects[id];
+        int pos = object.origins;
+        while (pos > 0 && m_objects[object.origin[pos - 1].parent].depth + 1 > depth) {
+            pos--;
+        }
+        if (pos == MAX_ORIGINS) return;
+
+        int n = std::min(object.origins, MAX_ORIGINS - 1);
+        for (int i = n; i > pos; i--) {
+            object.origin[i] = object.origin[i - 1];
+            lua_rawgeti(L, m_keys_index, id * MAX_ORIGINS + i - 1);
+            lua_rawseti(L, m_keys_index, id * MAX_ORIGINS + i);
+        }
+        object.origin[pos].parent = parent;
+        object.origin[pos].step = step;
+        object.origins = n + 1;
+        if (pos == 0) {
+            object.depth = depth;
+        }
+        if (!step) {
+            lua_pushvalue(L, key);
+            lua_rawseti(L, m_keys_index, id * MAX_ORIGINS + pos);
+        }
+    }
+
+    void putValue(int index, int parent = 0, int key = 0, int step = 0)
+    {
+        index = lua_absindex(L, index);
+        switch (lua_type(L, index)) {
+        case LUA_TNIL:
+            put(VALUE_NIL);
+            break;
+        case LUA_TBOOLEAN:
+            put(lua_toboolean(L, index) ? VALUE_TRUE : VALUE_FALSE);
+            break;
+        case LUA_TNUMBER:
+#if LUA_VERSION_NUM >= 503
+            if (lua_isinteger(L, index)) {
+                int64_t n = int64_t(lua_tointeger(L, index));
+                put(VALUE_INTEGER);
+                putVarint((uint64_t(n) << 1) ^ uint64_t(n >> 63));
+                break;
+            }
+#endif
+            put(VALUE_NUMBER);
+            putRaw(lua_tonumber(L, index));
+            break;
+        case LUA_TSTRING:
+            putString(index);
+            break;
+        case LUA_TLIGHTUSERDATA:
+            if (!m_portable) {
+                put(VALUE_LIGHTUSERDATA);
+                putRaw(lua_touserdata(L, index));
+            } else if (int hook = findHook(index)) {
+                // the handle of hooked class is saved as new object every time
+                if (m_emit) {
+                    const Hooks::Hook& h = m_hooks->m_hooks[size_t(hook - 1)];
+                    std::string data = h.save(L, index);
+                    put(VALUE_HOOKED);
+                    putBlob(h.name.data(), h.name.size());
+                    putBlob(data.data(), data.size());
+                }
+            } else {
+                put(VALUE_NIL);
+            }
+            break;
+        default:
+            put(VALUE_OBJECT);
+            putVarint(uint64_t(discover(index, parent, key, step)));
+            break;
+        }
+    }
+
+    void putString(int index)
+    {
+        // the strings are only written by the second pass
+        if (!m_emit) return;
+
+        // each string is written once, and referred by id after that
+        lua_pushvalue(L, index);
+        lua_rawget(L, m_strings_index);
+        if (!lua_isnil(L, -1)) {
+            put(VALUE_STRING_REF);
+            putVarint(uint64_t(lua_tointeger(L, -1)));
+            lua_pop(L, 1);
+            return;
+        }
+        lua_pop(L, 1);
+
+        lua_pushvalue(L, index);
+        lua_pushinteger(L, ++m_strings);
+        lua_rawset(L, m_strings_index);
+
+        size_t len;
+        const char* s = lua_tolstring(L, index, &len);
+        put(VALUE_STRING);
+        putBlob(s, len);
+    }
+
+    void putConstant(int index)
+    {
+        if (lua_type(L, index) == LUA_TSTRING) {
+            size_t len;
+            const char* s = lua_tolstring(L, index, &len);
+            put(VALUE_STRING);
+            putBlob(s, len);
+        } else {
+            putValue(index);
+        }
+    }
+
+    void putPaths()
+    {
+        // the object is reachable if any of its paths is from reachable object
+        std::vector<bool> reachable(size_t(m_count) + 1, false);
+        for (bool changed = true; changed; ) {
+            changed = false;
+            for (int id = 1; id <= m_count; id++) {
+                const Object& object = m_objects[id];
+                if (reachable[id]) continue;
+                reachable[id] = id <= m_roots;
+                for (int i = 0; i < object.origins && !reachable[id]; i++) {
+                    reachable[id] = reachable[object.origin[i].parent];
+                }
+                changed = changed || reachable[id];
+            }
+        }
+
+        // the portable snapshot has the paths of every object, so the existing tables can be found,
+        // otherwise only the paths to the anchors are needed
+        std::vector<bool> needed(size_t(m_count) + 1, m_portable);
+        std::vector<int> pending;
+        for (auto& anchor : m_anchors) {
+            if (!reachable[anchor.id]) {
+                throw LuaException(anchor.type == LUA_TFUNCTION
+                    ? "can not capture C function, "
+                        "it is not reachable by path from registry or globals"
+                    : "can not capture userdata with metatable, "
+                        "it is not reachable by path from registry or globals");
+            }
+            pending.push_back(anchor.id);
+        }
+        while (!m_portable && !pending.empty()) {
+            int id = pending.back();
+            pending.pop_back();
+            if (needed[id]) continue;
+            needed[id] = true;
+            for (int i = 0; i < m_objects[id].origins; i++) {
+                pending.push_back(m_objects[id].origin[i].parent);
+            }
+        }
+
+        size_t n = 0;
+        for (int id = m_roots + 1; id <= m_count; id++) {
+            if (needed[id] && reachable[id]) n++;
+        }
+        putVarint(n);
+
+        for (int id = m_roots + 1; id <= m_count; id++) {
+            if (!needed[id] || !reachable[id]) continue;
+
+            const Object& object = m_objects[id];
+            lua_rawgeti(L, m_objs_index, id);
+            int type = lua_type(L, -1);
+            lua_pop(L, 1);
+
+            int origins = 0;
+            for (int i = 0; i < object.origins; i++) {
+                if (reachable[object.origin[i].parent]) origins++;
+            }
+            putVarint(uint64_t(id));
+            putVarint(uint64_t(type));
+            putVarint(uint64_t(origins));
+
+            for (int i = 0; i < object.origins; i++) {
+                const Origin& origin = object.origin[i];
+                if (!reachable[origin.parent]) continue;
+
+                putVarint(uint64_t(origin.parent));
+                if (origin.step > 0) {
+                    put(STEP_UPVALUE);
+                    putVarint(uint64_t(origin.step));
+                } else if (origin.step == ORIGIN_METATABLE) {
+                    put(STEP_METATABLE);
+                } else {
+                    put(STEP_KEY);
+                    lua_rawgeti(L, m_keys_index, id * MAX_ORIGINS + i);
+                    putConstant(-1);
+                    lua_pop(L, 1);
+                }
+            }
+            flush();
+        }
+    }
+
+    bool isMainThread(int index)
+    {
+#if LUA_VERSION_NUM >= 502
+        lua_rawgeti(L, LUA_REGISTRYINDEX, LUA_RIDX_MAINTHREAD);
+        bool main = lua_rawequal(L, index, -1) != 0;
+        lua_pop(L, 1);
+        return main;
+#else
+        lua_State* thread = lua_tothread(L, index);
+        bool main = lua_pushthread(thread) != 0;
+        lua_pop(thread, 1);
+        return main;
+#endif
+    }
+
+    void create(int id)
+    {
+        const Object& object = m_objects[id];
+        put(object.tag);
+
+        lua_rawgeti(L, m_objs_index, id);
+        int obj = lua_gettop(L);
+
+        switch (object.tag) {
+        case OBJECT_TABLE:
+            putVarint(object.narr);
+            putVarint(object.nhash);
+            break;
+        case OBJECT_LUA_FUNCTION:
+        case OBJECT_C_FUNCTION: {
+            lua_Debug ar;
+            lua_pushvalue(L, obj);
+            lua_getinfo(L, ">u", &ar);
+            if (object.tag == OBJECT_C_FUNCTION) {
+                putRaw(lua_tocfunction(L, obj));
+            } else {
+                std::string code;
+                lua_pushvalue(L, obj);
+#if LUA_VERSION_NUM >= 503
+                lua_dump(L, &dump, &code, m_strip ? 1 : 0);
+#else
+                lua_dump(L, &dump, &code);
+#endif
+                lua_pop(L, 1);
+                putBlob(code.data(), code.size());
+            }
+            putVarint(uint64_t(ar.nups));
+            break;
+        }
+        case OBJECT_USERDATA: {
+            size_t size = lua_rawlen(L, obj);
+            putBlob(static_cast<const char*>(lua_touserdata(L, obj)), size);
+            break;
+        }
+        case OBJECT_HOOKED: {
+            const Hooks::Hook& hook = m_hooks->m_hooks[size_t(object.hook - 1)];
+            std::string data = hook.save(L, obj);
+            putBlob(hook.name.data(), hook.name.size());
+            putBlob(data.data(), data.size());
+            break;
+        }
+        default:
+            break;
+        }
+
+        lua_pop(L, 1);
+        flush();
+    }
+
+    void process(int id)
+    {
+        lua_rawgeti(L, m_objs_index, id);
+        int obj = lua_gettop(L);
+
+        switch (lua_type(L, obj)) {
+        case LUA_TTABLE:
+            processTable(id, obj);
+            break;
+        case LUA_TFUNCTION:
+            processFunction(id, obj);
+            break;
+        case LUA_TUSERDATA:
+            processUserdata(id, obj);
+            break;
+        case LUA_TTHREAD:
+            if (!isMainThread(obj)) {
+                throw LuaException("can not capture coroutine");
+            }
+            m_objects[id].tag = OBJECT_MAIN_THREAD;
+            break;
+        default:
+            throw LuaException("can not capture object of unknown type");
+        }
+
+        lua_pop(L, 1);
+        flush();
+    }
+
+    void processTable(int id, int obj)
+    {
+        size_t narr = lua_rawlen(L, obj);
+        size_t count = 0;
+
+        lua_pushnil(L);
+        while (lua_next(L, obj)) {
+            int key = lua_gettop(L) - 1;
+
+            // the integer keys of registry are references held by C++, and the light userdata
+            // can not be saved, skip them
+            if ((id == ROOT_REGISTRY && lua_type(L, key) == LUA_TNUMBER)
+                || (m_portable && lua_islightuserdata(L, key))
+                || (m_portable && lua_islightuserdata(L, key + 1) && !findHook(key + 1)))
+            {
+                lua_pop(L, 1);
+                continue;
+            }
+            putValue(key);
+            putValue(key + 1, id, key);
+            lua_pop(L, 1);
+            count++;
+            flush();
+        }
+        put(VALUE_END);
+
+        if (lua_getmetatable(L, obj)) {
+            putValue(-1, id, 0, ORIGIN_METATABLE);
+            lua_pop(L, 1);
+        } else {
+            put(VALUE_NIL);
+        }
+
+        if (!m_emit) {
+            Object& object = m_objects[id];
+            object.tag = id <= m_roots ? OBJECT_ROOT : OBJECT_TABLE;
+            object.narr = narr;
+            object.nhash = count > narr ? count - narr : 0;
+        }
+    }
+
+    void processFunction(int id, int obj)
+    {
+        bool cfunc = lua_iscfunction(L, obj) != 0;
+        if (cfunc && m_portable) {
+            // the C function is looked up by path in the restored state
+            if (!m_emit) {
+                Anchor anchor = { id, 0, LUA_TFUNCTION };
+                m_anchors.push_back(anchor);
+                m_objects[id].tag = OBJECT_ANCHOR;
+            }
+            return;
+        }
+        m_objects[id].tag = cfunc ? OBJECT_C_FUNCTION : OBJECT_LUA_FUNCTION;
+
+        lua_Debug ar;
+        lua_pushvalue(L, obj);
+        lua_getinfo(L, ">u", &ar);
+        int nups = ar.nups;
+
+        for (int i = 1; i <= nups; i++) {
+#if LUA_VERSION_NUM >= 502
+            // the upvalue shared with earlier closure is joined instead of copied
+            if (!cfunc) {
+                const void* uid = lua_upvalueid(L, obj, i);
+                auto it = m_upvalues.find(uid);
+                if (it != m_upvalues.end()) {
+                    put(VALUE_JOIN);
+                    putVarint(uint64_t(it->second.parent));
+                    putVarint(uint64_t(it->second.step));
+                    continue;
+                }
+                Origin origin = { id, i };
+                m_upvalues.emplace(uid, origin);
+            }
+#endif
+            lua_getupvalue(L, obj, i);
+            putValue(-1, id, 0, i);
+            lua_pop(L, 1);
+        }
+    }
+
+    void processUserdata(int id, int obj)
+    {
+        if (lua_getmetatable(L, obj)) {
+            if (!m_emit) {
+                Object& object = m_objects[id];
+                object.hook = findHook(obj);
+                if (object.hook) {
+                    object.tag = OBJECT_HOOKED;
+                } else {
+                    // the metatable is mapped to the one of anchored userdata, so type check still works
+                    object.tag = OBJECT_ANCHOR;
+                    Anchor anchor = { id, 0, LUA_TUSERDATA };
+                    anchor.meta = discover(lua_gettop(L), id, 0, ORIGIN_METATABLE);
+                    m_anchors.push_back(anchor);
+                }
+            }
+            lua_pop(L, 1);
+        } else {
+            m_objects[id].tag = OBJECT_USERDATA;
+            lua_getuservalue(L, obj);
+            putValue(-1);
+            lua_pop(L, 1);
+        }
+    }
+
+private:
+    lua_State* L;
+    bool m_strip;
+    bool m_portable;
+    const Hooks* m_hooks;
+    Sink m_sink;
+    bool m_emit;
+    int m_seen_index;
+    int m_objs_index;
+    int m_keys_index;
+    int m_strings_index;
+    int m_hooks_index;
+    int m_count;
+    int m_roots;
+    lua_Integer m_strings;
+    std::vector<Object> m_objects;
+    std::vector<Anchor> m_anchors;
+    std::unordered_map<const void*, Origin> m_upvalues;
+    std::string m_buf;
+};
+
+//---------------------------------------------------------------------------
+
+class LuaSnapshot::Reader
+{
+public:
+    Reader(lua_State* state, const char* data, size_t size, const Hooks* hooks)
+        : L(state)
+        , m_p(data)
+        , m_end(data + size)
+        , m_hooks(hooks)
+        , m_portable(false)
+        , m_roots(0)
+        , m_strings(0)
+    {}
+
+    void run()
+    {
+        if (size_t(m_end - m_p) < 8 || memcmp(m_p, "LUAISNAP", 8) != 0) {
+            fail("not a snapshot");
+        }
+        m_p += 8;
+        if (getVarint() != VERSION || getVarint() != LUA_VERSION_NUM
+            || getVarint() != sizeof(void*) || getVarint() != sizeof(lua_Number))
+        {
+            fail("incompatible snapshot");
+        }
+        uint64_t flags = getVarint();
+        if (flags & ~uint64_t(FLAG_PORTABLE)) {
+            fail("incompatible snapshot");
+        }
+        m_portable = (flags & FLAG_PORTABLE) != 0;
+
+        size_t count = getSize();
+        m_roots = getSize();
+        if (m_roots < ROOT_GLOBALS || m_roots > ROOT_STRING_META || m_roots > count) {
+            fail("corrupted snapshot");
+        }
+        m_kinds.resize(count + 1);
+        m_nups.resize(count + 1);
+        m_paths.resize(count + 1);
+
+        lua_checkstack(L, 16);
+        lua_createtable(L, int(count), 0);
+        m_objs_index = lua_gettop(L);
+        lua_newtable(L);
+        m_strings_index = lua_gettop(L);
+        lua_newtable(L);
+        m_resolved_index = lua_gettop(L);
+
+        lua_pushvalue(L, LUA_REGISTRYINDEX);
+        lua_rawseti(L, m_objs_index, ROOT_REGISTRY);
+        lua_pushglobaltable(L);
+        lua_rawseti(L, m_objs_index, ROOT_GLOBALS);
+        if (m_roots >= ROOT_STRING_META) {
+            lua_pushliteral(L, "");
+            if (!lua_getmetatable(L, -1)) {
+                lua_newtable(L);
+                lua_pushvalue(L, -1);
+                lua_setmetatable(L, -3);
+            }
+            lua_rawseti(L, m_objs_index, ROOT_STRING_META);
+            lua_pop(L, 1);
+        }
+        for (size_t id = 1; id <= m_roots; id++) {
+            lua_rawgeti(L, m_objs_index, lua_Integer(id));
+            lua_rawseti(L, m_resolved_index, lua_Integer(id));
+        }
+
+        // resolve the paths and anchors before the state is changed by restore
+        size_t paths = getSize();
+        size_t last = m_roots;
+        for (size_t i = 0; i < paths; i++) {
+            size_t id = getSize();
+            if (id <= last || id > count) {
+                fail("corrupted snapshot");
+            }
+            last = id;
+            m_paths[id] = m_p;
+            skipPaths();
+        }
+        resolvePaths();
+
+        size_t anchors = getSize();
+        for (size_t i = 0; i < anchors; i++) {
+            getAnchor(count);
+        }
+
+        for (size_t id = 1; id <= count; id++) {
+            createObject(id);
+        }
+        for (size_t id = 1; id <= count; id++) {
+            fillObject(id);
+        }
+        if (m_p != m_end) {
+            fail("corrupted snapshot");
+        }
+    }
+
+private:
+    [[noreturn]] static void fail(const char* msg)
+    {
+        throw LuaException(std::string("can not restore snapshot: ") + msg);
+    }
+
+    uint64_t getVarint()
+    {
+        uint64_t v = 0;
+        for (int shift = 0; shift < 64; shift += 7) {
+            if (m_p == m_end) fail("truncated snapshot");
+            unsigned char c = static_cast<unsigned char>(*m_p++);
+            v |= uint64_t(c & 0x7f) << shift;
+            if (!(c & 0x80)) return v;
+        }
+        fail("corrupted snapshot");
+    }
+
+    size_t getSize()
+    {
+        // every counted item takes at least one byte
+        uint64_t v = getVarint();
+        if (v > uint64_t(m_end - m_p)) fail("corrupted snapshot");
+        return size_t(v);
+    }
+
+    int getHint()
+    {
+        // the table sizes are only hints, every field takes at least two bytes
+        uint64_t v = getVarint();
+        return int(std::min<uint64_t>(v, std::min<uint64_t>(uint64_t(m_end - m_p) / 2, 0x7fffffff)));
+    }
+
+    const char* getBytes(size_t n)
+    {
+        if (size_t(m_end - m_p) < n) fail("truncated snapshot");
+        const char* p = m_p;
+        m_p += n;
+        return p;
+    }
+
+    std::string getBlob()
+    {
+        size_t len = getSize();
+        return std::string(getBytes(len), len);
+    }
+
+    template <typename T>
+    T getRaw()
+    {
+        T v;
+        memcpy(&v, getBytes(sizeof(T)), sizeof(T));
+        return v;
+    }
+
+    char getTag()
+    {
+        return *getBytes(1);
+    }
+
+    void pushObject(uint64_t id)
+    {
+        if (id == 0 || id >= m_kinds.size()) {
+            fail("corrupted snapshot");
+        }
+        lua_rawgeti(L, m_objs_index, lua_Integer(id));
+    }
+
+    void pushHooked()
+    {
+        std::string name = getBlob();
+        std::string data = getBlob();
+
+        const Hooks::Hook* hook = nullptr;
+        if (m_hooks) {
+            for (auto& h : m_hooks->m_hooks) {
+                if (h.name == name) {
+                    hook = &h;
+                    break;
+                }
+            }
+        }
+        if (!hook) {
+            throw LuaException("can not restore snapshot: no hook for class " + name);
+        }
+
+        int top = lua_gettop(L);
+        hook->load(L, data);
+        lua_settop(L, top + 1);
+    }
+
+    /**
+     * Push the value, or return false at the end of table fields
+     */
+    bool getValue(bool constant = false)
+    {
+        char tag = getTag();
+        switch (tag) {
+        case VALUE_END:
+            return false;
+        case VALUE_NIL:
+            lua_pushnil(L);
+            break;
+        case VALUE_FALSE:
+            lua_pushboolean(L, 0);
+            break;
+        case VALUE_TRUE:
+            lua_pushboolean(L, 1);
+            break;
+        case VALUE_INTEGER: {
+            uint64_t v = getVarint();
+            lua_pushinteger(L, lua_Integer(int64_t(v >> 1) ^ -int64_t(v & 1)));
+            break;
+        }
+        case VALUE_NUMBER:
+            lua_pushnumber(L, getRaw<lua_Number>());
+            break;
+        case VALUE_STRING: {
+            size_t len = getSize();
+            lua_pushlstring(L, getBytes(len), len);
+            if (!constant) {
+                lua_pushvalue(L, -1);
+                lua_rawseti(L, m_strings_index, ++m_strings);
+            }
+            break;
+        }
+        case VALUE_STRING_REF: {
+            uint64_t sid = getVarint();
+            if (sid == 0 || sid > uint64_t(m_strings)) fail("corrupted snapshot");
+            lua_rawgeti(L, m_strings_index, lua_Integer(sid));
+            break;
+        }
+        case VALUE_LIGHTUSERDATA:
+            // the saved file must not contain pointer
+            if (m_portable) fail("corrupted snapshot");
+            lua_pushlightuserdata(L, getRaw<void*>());
+            break;
+        case VALUE_OBJECT:
+            pushObject(getVarint());
+            break;
+        case VALUE_HOOKED:
+            if (constant) fail("corrupted snapshot");
+            pushHooked();
+            break;
+        default:
+            fail("corrupted snapshot");
+        }
+        return true;
+    }
+
+    void skipPaths()
+    {
+        getVarint();
+        size_t origins = getSize();
+        for (size_t i = 0; i < origins; i++) {
+            size_t parent = getSize();
+            if (parent == 0 || parent >= m_paths.size()) {
+                fail("corrupted snapshot");
+            }
+            lua_pushnil(L);
+            getStep();
+            lua_pop(L, 1);
+        }
+    }
+
+    /**
+     * Resolve the object by the first path that leads to value of the same type
+     */
+    bool resolve(size_t id)
+    {
+        m_p = m_paths[id];
+        int type = int(getVarint());
+        size_t origins = getSize();
+
+        bool found = false;
+        for (size_t i = 0; i < origins; i++) {
+            lua_rawgeti(L, m_resolved_index, lua_Integer(getSize()));
+            getStep();
+            if (!found && lua_type(L, -1) == type) {
+                lua_rawseti(L, m_resolved_index, lua_Integer(id));
+                found = true;
+            } else {
+                lua_pop(L, 1);
+            }
+        }
+        return found;
+    }
+
+    void resolvePaths()
+    {
+        // the path may be from later object, so repeat until nothing more can be resolved
+        const char* p = m_p;
+        std::vector<size_t> pending;
+        for (size_t id = m_roots + 1; id < m_paths.size(); id++) {
+            if (m_paths[id]) pending.push_back(id);
+        }
+
+        for (size_t n = 0; n != pending.size(); ) {
+            n = pending.size();
+            size_t k = 0;
+            for (size_t id : pending) {
+                if (!resolve(id)) pending[k++] = id;
+            }
+            pending.resize(k);
+        }
+        m_p = p;
+    }
+
+    /**
+     * Replace the value on top of stack by the value at the next step of path, or nil if not found
+     */
+    void getStep()
+    {
+        char tag = getTag();
+        if (tag == STEP_UPVALUE) {
+            int n = int(getVarint());
+            if (!lua_isfunction(L, -1) || !lua_getupvalue(L, -1, n)) {
+                lua_pushnil(L);
+            }
+        } else if (tag == STEP_METATABLE) {
+            if (lua_isnil(L, -1) || !lua_getmetatable(L, -1)) {
+                lua_pushnil(L);
+            }
+        } else if (tag == STEP_KEY) {
+            getValue(true);
+            if (lua_istable(L, -2) && !lua_isnil(L, -1)) {
+                lua_rawget(L, -2);
+            } else {
+                lua_pop(L, 1);
+                lua_pushnil(L);
+            }
+        } else {
+            fail("corrupted snapshot");
+        }
+        lua_remove(L, -2);
+    }
+
+    std::string getPath(size_t id)
+    {
+        // the first path is used, and the steps are parsed again from the data
+        const char* p = m_p;
+        std::vector<const char*> chain;
+        while (id > m_roots && m_paths[id] && chain.size() < m_paths.size()) {
+            m_p = m_paths[id];
+            getVarint();
+            if (getVarint() == 0) break;
+            id = size_t(getVarint());
+            chain.push_back(m_p);
+        }
+
+        static const char* const ROOT_NAMES[] = { "?", "registry", "_G", "string metatable" };
+        std::string path = id <= m_roots ? ROOT_NAMES[id] : "?";
+
+        for (auto it = chain.rbegin(); it != chain.rend(); ++it) {
+            m_p = *it;
+            char tag = getTag();
+            if (tag == STEP_UPVALUE) {
+                path += "[upvalue " + std::to_string(getVarint()) + "]";
+            } else if (tag == STEP_METATABLE) {
+                path += "[metatable]";
+            } else {
+                getValue(true);
+                if (lua_type(L, -1) == LUA_TSTRING) {
+                    path += ".";
+                    path += lua_tostring(L, -1);
+                } else if (lua_type(L, -1) == LUA_TNUMBER) {
+                    path += "[";
+                    path += lua_tostring(L, -1);
+                    path += "]";
+                } else {
+                    path += "[?]";
+                }
+                lua_pop(L, 1);
+            }
+        }
+
+        m_p = p;
+        return path;
+    }
+
+    void getAnchor(size_t count)
+    {
+        size_t id = getSize();
+        size_t meta = getSize();
+        int type = int(getVarint());
+        if (id <= m_roots || id > count || meta > count) {
+            fail("corrupted snapshot");
+        }
+
+        lua_rawgeti(L, m_resolved_index, lua_Integer(id));
+        if (type == LUA_TFUNCTION) {
+            if (!lua_iscfunction(L, -1)) {
+                throw LuaException("can not restore snapshot: C function not found at " + getPath(id));
+            }
+        } else if (type == LUA_TUSERDATA) {
+            if (lua_type(L, -1) != LUA_TUSERDATA) {
+                throw LuaException("can not restore snapshot: userdata not found at " + getPath(id));
+            }
+            if (meta && lua_getmetatable(L, -1)) {
+                lua_rawseti(L, m_objs_index, lua_Integer(meta));
+                m_kinds[meta] = OBJECT_ANCHOR;
+            }
+        } else {
+            fail("corrupted snapshot");
+        }
+        lua_rawseti(L, m_objs_index, lua_Integer(id));
+    }
+
+    void createObject(size_t id)
+    {
+        // the metatable of anchored userdata is already mapped, but still filled as table
+        bool mapped = m_kinds[id] == OBJECT_ANCHOR;
+        char tag = getTag();
+        m_kinds[id] = tag;
+
+        switch (tag) {
+        case OBJECT_ROOT:
+            if (id > m_roots) fail("corrupted snapshot");
+            return;
+        case OBJECT_TABLE: {
+            int narr = getHint();
+            int nhash = getHint();
+            if (mapped) return;
+            if (m_portable) {
+                // the table at the same path is updated instead, so the references held by C++ still work
+                lua_rawgeti(L, m_resolved_index, lua_Integer(id));
+                if (lua_istable(L, -1)) break;
+                lua_pop(L, 1);
+            }
+            lua_createtable(L, narr, nhash);
+            break;
+        }
+        case OBJECT_LUA_FUNCTION: {
+            size_t len = getSize();
+            const char* code = getBytes(len);
+            if (luaL_loadbuffer(L, code, len, "=snapshot") != LUA_OK) {
+                throw LuaException(L);
+            }
+            m_nups[id] = int(getVarint());
+            break;
+        }
+        case OBJECT_C_FUNCTION: {
+            if (m_portable) fail("corrupted snapshot");
+            lua_CFunction fn = getRaw<lua_CFunction>();
+            int nups = int(getVarint());
+            for (int i = 0; i < nups; i++) {
+                lua_pushnil(L);
+            }
+            lua_pushcclosure(L, fn, nups);
+            m_nups[id] = nups;
+            break;
+        }
+        case OBJECT_USERDATA: {
+            size_t size = getSize();
+            memcpy(lua_newuserdata(L, size), getBytes(size), size);
+            break;
+        }
+        case OBJECT_HOOKED:
+            pushHooked();
+            break;
+        case OBJECT_ANCHOR:
+            return;
+        case OBJECT_MAIN_THREAD:
+#if LUA_VERSION_NUM >= 502
+            lua_rawgeti(L, LUA_REGISTRYINDEX, LUA_RIDX_MAINTHREAD);
+#else
+            lua_pushthread(L);
+#endif
+            break;
+        default:
+            fail("corrupted snapshot");
+        }
+
+        lua_rawseti(L, m_objs_index, lua_Integer(id));
+    }
+
+    void setMetaTable(int obj)
+    {
+        // the class metatable of binding is its own metatable, and its __gc is the destructor of
+        // bound objects; the table is marked for finalization if its metatable has __gc when set,
+        // so __gc is hidden while setting, or the class table itself would be finalized
+        if (lua_rawequal(L, -1, obj)) {
+            lua_pushliteral(L, "__gc");
+            lua_rawget(L, obj);
+            if (!lua_isnil(L, -1)) {
+                lua_pushliteral(L, "__gc");
+                lua_pushnil(L);
+                lua_rawset(L, obj);
+                lua_pushvalue(L, -2);
+                lua_setmetatable(L, obj);
+                lua_pushliteral(L, "__gc");
+                lua_insert(L, -2);
+                lua_rawset(L, obj);
+                lua_pop(L, 1);
+                return;
+            }
+            lua_pop(L, 1);
+        }
+        lua_setmetatable(L, obj);
+    }
+
+    void fillObject(size_t id)
+    {
+        char tag = m_kinds[id];
+        if (tag == OBJECT_ANCHOR || tag == OBJECT_HOOKED || tag == OBJECT_MAIN_THREAD) {
+            return;
+        }
+
+        lua_rawgeti(L, m_objs_index, lua_Integer(id));
+        int obj = lua_gettop(L);
+
+        if (tag == OBJECT_ROOT || tag == OBJECT_TABLE) {
+            while (getValue()) {
+                if (!getValue() || lua_isnil(L, -2)) fail("corrupted snapshot");
+                lua_rawset(L, obj);
+            }
+            getValue();
+            if (lua_istable(L, -1)) {
+                setMetaTable(obj);
+            } else {
+                lua_pop(L, 1);
+            }
+        } else if (tag == OBJECT_USERDATA) {
+            getValue();
+            if (!lua_isnil(L, -1)) {
+                lua_setuservalue(L, obj);
+            } else {
+                lua_pop(L, 1);
+            }
+        } else {
+            for (int i = 1; i <= m_nups[id]; i++) {
+#if LUA_VERSION_NUM >= 502
+                if (m_p < m_end && *m_p == VALUE_JOIN) {
+                    m_p++;
+                    uint64_t other = getVarint();
+                    int n = int(getVarint());
+                    pushObject(other);
+                    lua_upvaluejoin(L, obj, i, -1, n);
+                    lua_pop(L, 1);
+                    continue;
+                }
+#endif
+                if (!getValue()) fail("corrupted snapshot");
+                if (!lua_setupvalue(L, obj, i)) {
+                    lua_pop(L, 1);
+                }
+            }
+        }
+
+        lua_pop(L, 1);
+    }
+
+private:
+    lua_State* L;
+    const char* m_p;
+    const char* m_end;
+    const Hooks* m_hooks;
+    bool m_portable;
+    size_t m_roots;
+    int m_objs_index;
+    int m_strings_index;
+    int m_resolved_index;
+    lua_Integer m_strings;
+    std::vector<char> m_kinds;
+    std::vector<int> m_nups;
+    std::vector<const char*> m_paths;
+};
+
+//---------------------------------------------------------------------------
+
+LUA_INLINE LuaSnapshot LuaSnapshot::capture(lua_State* L, bool strip)
+{
+    std::string data;
+    int top = lua_gettop(L);
+    try {
+        Writer(L, strip, false, nullptr, [&data] (const char* p, size_t size) {
+            data.append(p, size);
+        }).run();
+        lua_settop(L, top);
+    } catch (...) {
+        lua_settop(L, top);
+        throw;
+    }
+    return LuaSnapshot(std::move(data));
+}
+
+LUA_INLINE void LuaSnapshot::restore(lua_State* L) const
+{
+    read(L, m_data.data(), m_data.size(), nullptr);
+}
+
+LUA_INLINE void LuaSnapshot::save(lua_State* L, const std::string& path, const Hooks& hooks, bool strip)
+{
+    // write to temporary file, so the existing file is kept if anything goes wrong
+    std::string temp = path + ".tmp";
+    FILE* file = fopen(temp.c_str(), "wb");
+    if (!file) {
+        throw LuaException("can not save snapshot to " + path + ": " + strerror(errno));
+    }
+
+    int top = lua_gettop(L);
+    try {
+        Writer(L, strip, true, &hooks, [file, &path] (const char* p, size_t size) {
+            if (fwrite(p, 1, size, file) != size) {
+                throw LuaException("can not save snapshot to " + path + ": " + strerror(errno));
+            }
+        }).run();
+        lua_settop(L, top);
+    } catch (...) {
+        lua_settop(L, top);
+        fclose(file);
+        remove(temp.c_str());
+        throw;
+    }
+
+    bool ok = fclose(file) == 0;
+#ifdef _WIN32
+    ok = ok && (remove(path.c_str()) == 0 || errno == ENOENT);
+#endif
+    if (!ok || rename(temp.c_str(), path.c_str()) != 0) {
+        std::string msg = strerror(errno);
+        remove(temp.c_str());
+        throw LuaException("can not save snapshot to " + path + ": " + msg);
+    }
+}
+
+LUA_INLINE void LuaSnapshot::load(lua_State* L, const std::string& path, const Hooks& hooks)
+{
+#ifdef _WIN32
+    std::ifstream file(path, std::ios::binary);
+    if (!file) {
+        throw LuaException("can not load snapshot from " + path);
+    }
+    std::string data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    read(L, data.data(), data.size(), &hooks);
+#else
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0) {
+        std::string msg = strerror(errno);
+        if (fd >= 0) close(fd);
+        throw LuaException("can not load snapshot from " + path + ": " + msg);
+    }
+
+    // the file is read once from start to end
+    size_t size = size_t(st.st_size);
+    void* data = size ? mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0) : nullptr;
+    std::string msg = strerror(errno);
+    close(fd);
+    if (data == MAP_FAILED) {
+        throw LuaException("can not load snapshot from " + path + ": " + msg);
+    }
+    if (data) {
+        posix_madvise(data, size, POSIX_MADV_SEQUENTIAL);
+    }
+
+    try {
+        read(L, static_cast<const char*>(data), size, &hooks);
+    } catch (...) {
+        if (data) munmap(data, size);
+        throw;
+    }
+    if (data) munmap(data, size);
+#endif
+}
+
+LUA_INLINE void LuaSnapshot::read(lua_State* L, const char* data, size_t size, const Hooks* hooks)
+{
+    int top = lua_gettop(L);
+    try {
+        Reader(L, data, size, hooks).run();
+        lua_settop(L, top);
+    } catch (...) {
+        lua_settop(L, top);
+        throw;
+    }
+}
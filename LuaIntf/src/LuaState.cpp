@@ -85,7 +85,7 @@ LUA_INLINE void Lua::exec(lua_State* L, const char* lua_expr, int num_results)
 
     if (err != LUA_OK) {
         lua_remove(L, -2);
-        throw LuaException(L);
+        LuaException::raise(L, err);
     }
 
     lua_remove(L, -(num_results + 1));
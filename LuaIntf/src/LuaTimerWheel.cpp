@@ -0,0 +1,356 @@
+//
+// https://github.com/SteveKChiu/lua-intf
+//
+// Copyright 2014, Steve K. Chiu <steve.k.chiu@gmail.com>
+//
+// The MIT License (http://www.opensource.org/licenses/mit-license.php)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+//
+
+#ifndef LUATIMERWHEEL_H
+    #include "LuaIntf/LuaTimerWheel.h"
+    using namespace LuaIntf;
+#endif
+
+//---------------------------------------------------------------------------
+
+LUA_INLINE LuaTimerWheel::LuaTimerWheel(lua_State* state, double resolution)
+    : L(state)
+    , m_resolution(resolution)
+    , m_origin(std::chrono::steady_clock::now())
+    , m_now(0)
+    , m_count(0)
+    , m_dispatching(false)
+    , m_dispatched(0)
+{
+    for (auto& head : m_slots) {
+        head = NIL;
+    }
+    lua_newtable(L);
+    m_handlers = luaL_ref(L, LUA_REGISTRYINDEX);
+}
+
+LUA_INLINE LuaTimerWheel::~LuaTimerWheel()
+{
+    luaL_unref(L, LUA_REGISTRYINDEX, m_handlers);
+}
+
+LUA_INLINE void LuaTimerWheel::bind(const char* name)
+{
+    static const luaL_Reg funcs[] = {
+        { "after", &afterFunc },
+        { "every", &everyFunc },
+        { "cancel", &cancelFunc },
+        { nullptr, nullptr }
+    };
+
+    lua_newtable(L);
+    lua_pushlightuserdata(L, this);
+    luaL_setfuncs(L, funcs, 1);
+    Lua::popToGlobal(L, name);
+}
+
+LUA_INLINE LuaTimerWheel::Handle LuaTimerWheel::schedule(double delay, const LuaRef& fn, double interval)
+{
+    fn.pushToStack();
+    Handle handle = add(L, lua_gettop(L), toTicks(delay), interval > 0 ? toTicks(interval) : 0);
+    lua_pop(L, 1);
+    return handle;
+}
+
+LUA_INLINE bool LuaTimerWheel::cancel(Handle handle)
+{
+    uint32_t index = uint32_t(handle);
+    uint32_t generation = uint32_t(handle >> 32);
+    if (index >= m_nodes.size()
+        || m_nodes[index].generation != generation
+        || m_nodes[index].slot == NIL)
+    {
+        return false;
+    }
+
+    if (m_nodes[index].slot != PENDING) {
+        unlink(index);
+    }
+    release(index);
+    return true;
+}
+
+LUA_INLINE void LuaTimerWheel::tick()
+{
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - m_origin;
+    uint64_t t = uint64_t(elapsed.count() / m_resolution);
+    if (t > m_now) {
+        advance(t - m_now);
+    }
+}
+
+LUA_INLINE void LuaTimerWheel::advance(uint64_t ticks)
+{
+    // callbacks are dispatched in batch, nested tick from callback is ignored
+    if (m_dispatching) {
+        return;
+    }
+
+    uint64_t target = m_now + ticks;
+    while (m_now < target) {
+        if (m_count == 0) {
+            m_now = target;
+            break;
+        }
+        step();
+    }
+
+    if (!m_expired.empty()) {
+        dispatch();
+    }
+}
+
+//---------------------------------------------------------------------------
+
+LUA_INLINE void LuaTimerWheel::pushHandle(lua_State* L, Handle handle)
+{
+#if LUA_VERSION_NUM >= 503
+    lua_pushinteger(L, static_cast<lua_Integer>(handle));
+#else
+    lua_pushnumber(L, static_cast<lua_Number>(handle));
+#endif
+}
+
+LUA_INLINE LuaTimerWheel::Handle LuaTimerWheel::checkHandle(lua_State* L, int index)
+{
+#if LUA_VERSION_NUM >= 503
+    return static_cast<Handle>(luaL_checkinteger(L, index));
+#else
+    return static_cast<Handle>(luaL_checknumber(L, index));
+#endif
+}
+
+LUA_INLINE int LuaTimerWheel::afterFunc(lua_State* L)
+{
+    LuaTimerWheel* wheel = static_cast<LuaTimerWheel*>(lua_touserdata(L, lua_upvalueindex(1)));
+    uint64_t delay = wheel->toTicks(luaL_checknumber(L, 1));
+    luaL_checktype(L, 2, LUA_TFUNCTION);
+    pushHandle(L, wheel->add(L, 2, delay, 0));
+    return 1;
+}
+
+LUA_INLINE int LuaTimerWheel::everyFunc(lua_State* L)
+{
+    LuaTimerWheel* wheel = static_cast<LuaTimerWheel*>(lua_touserdata(L, lua_upvalueindex(1)));
+    uint64_t interval = wheel->toTicks(luaL_checknumber(L, 1));
+    luaL_checktype(L, 2, LUA_TFUNCTION);
+    pushHandle(L, wheel->add(L, 2, interval, interval));
+    return 1;
+}
+
+LUA_INLINE int LuaTimerWheel::cancelFunc(lua_State* L)
+{
+    LuaTimerWheel* wheel = static_cast<LuaTimerWheel*>(lua_touserdata(L, lua_upvalueindex(1)));
+    lua_pushboolean(L, wheel->cancel(checkHandle(L, 1)));
+    return 1;
+}
+
+LUA_INLINE int LuaTimerWheel::dispatchFunc(lua_State* L)
+{
+    // stack: wheel handlers
+    LuaTimerWheel* wheel = static_cast<LuaTimerWheel*>(lua_touserdata(L, 1));
+    lua_rawgeti(L, LUA_REGISTRYINDEX, wheel->m_handlers);
+
+    // resume after the failed callback if called again
+    while (wheel->m_dispatched < wheel->m_expired.size()) {
+        Expired e = wheel->m_expired[wheel->m_dispatched++];
+        if (wheel->m_nodes[e.node].generation != e.generation) {
+            continue;
+        }
+
+        // one-shot timer is released before the call, so the node can be reused by the callback
+        lua_rawgeti(L, 2, e.node + 1);
+        if (wheel->m_nodes[e.node].slot == PENDING) {
+            wheel->release(e.node);
+        }
+        pushHandle(L, handleOf(e.node, e.generation));
+        lua_call(L, 1, 0);
+    }
+    return 0;
+}
+
+LUA_INLINE uint64_t LuaTimerWheel::toTicks(double seconds) const
+{
+    double ticks = std::ceil(seconds / m_resolution);
+    if (!(ticks >= 1)) {
+        return 1;
+    } else if (ticks >= double(0xffffffffu)) {
+        return 0xffffffffu;
+    } else {
+        return uint64_t(ticks);
+    }
+}
+
+LUA_INLINE LuaTimerWheel::Handle LuaTimerWheel::add(lua_State* L, int fn_index, uint64_t delay, uint64_t interval)
+{
+    uint32_t index;
+    if (m_free.empty()) {
+        index = uint32_t(m_nodes.size());
+        Node node;
+        node.slot = NIL;
+        node.generation = 1;
+        m_nodes.push_back(node);
+    } else {
+        index = m_free.back();
+        m_free.pop_back();
+    }
+
+    Node& node = m_nodes[index];
+    node.expire = m_now + delay;
+    node.interval = interval;
+    link(index);
+    m_count++;
+
+    lua_rawgeti(L, LUA_REGISTRYINDEX, m_handlers);
+    lua_pushvalue(L, fn_index);
+    lua_rawseti(L, -2, index + 1);
+    lua_pop(L, 1);
+
+    return handleOf(index, node.generation);
+}
+
+LUA_INLINE void LuaTimerWheel::release(uint32_t index)
+{
+    lua_rawgeti(L, LUA_REGISTRYINDEX, m_handlers);
+    lua_pushnil(L);
+    lua_rawseti(L, -2, index + 1);
+    lua_pop(L, 1);
+
+    Node& node = m_nodes[index];
+    node.slot = NIL;
+    node.generation = (node.generation + 1) & GENERATION_MASK;
+    if (node.generation == 0) {
+        node.generation = 1;
+    }
+    m_free.push_back(index);
+    m_count--;
+}
+
+LUA_INLINE void LuaTimerWheel::link(uint32_t index)
+{
+    // the level is chosen by distance, so the slot is reached before wrap around
+    Node& node = m_nodes[index];
+    uint64_t delta = node.expire - m_now;
+    int level = 0;
+    while (level < LEVELS - 1 && delta >= (uint64_t(1) << (SLOT_BITS * (level + 1)))) {
+        level++;
+    }
+
+    uint32_t slot = level * SLOTS + uint32_t((node.expire >> (SLOT_BITS * level)) & SLOT_MASK);
+    uint32_t head = m_slots[slot];
+    node.slot = slot;
+    node.prev = NIL;
+    node.next = head;
+    if (head != NIL) {
+        m_nodes[head].prev = index;
+    }
+    m_slots[slot] = index;
+}
+
+LUA_INLINE void LuaTimerWheel::unlink(uint32_t index)
+{
+    Node& node = m_nodes[index];
+    if (node.prev == NIL) {
+        m_slots[node.slot] = node.next;
+    } else {
+        m_nodes[node.prev].next = node.next;
+    }
+    if (node.next != NIL) {
+        m_nodes[node.next].prev = node.prev;
+    }
+    node.slot = PENDING;
+}
+
+LUA_INLINE void LuaTimerWheel::step()
+{
+    m_now++;
+
+    // cascade the upper level slot when lower level wraps around
+    for (int level = 1; level < LEVELS; level++) {
+        if (m_now & ((uint64_t(1) << (SLOT_BITS * level)) - 1)) {
+            break;
+        }
+
+        uint32_t slot = level * SLOTS + uint32_t((m_now >> (SLOT_BITS * level)) & SLOT_MASK);
+        uint32_t index = m_slots[slot];
+        m_slots[slot] = NIL;
+        while (index != NIL) {
+            uint32_t next = m_nodes[index].next;
+            link(index);
+            index = next;
+        }
+    }
+
+    uint32_t slot = uint32_t(m_now & SLOT_MASK);
+    uint32_t index = m_slots[slot];
+    m_slots[slot] = NIL;
+    while (index != NIL) {
+        Node& node = m_nodes[index];
+        uint32_t next = node.next;
+        Expired e = { index, node.generation };
+        m_expired.push_back(e);
+        if (node.interval) {
+            node.expire = m_now + node.interval;
+            link(index);
+        } else {
+            node.slot = PENDING;
+        }
+        index = next;
+    }
+}
+
+LUA_INLINE void LuaTimerWheel::dispatch()
+{
+    m_dispatching = true;
+    m_dispatched = 0;
+
+    std::string error;
+    while (m_dispatched < m_expired.size()) {
+        lua_pushcfunction(L, &LuaException::traceback);
+        lua_pushcfunction(L, &dispatchFunc);
+        lua_pushlightuserdata(L, this);
+        if (lua_pcall(L, 1, 0, -3) == LUA_OK) {
+            lua_pop(L, 1);
+            continue;
+        }
+
+        const char* msg = lua_tostring(L, -1);
+        std::string s = msg ? msg : "unknown error in timer callback";
+        lua_pop(L, 2);
+        if (m_error_handler) {
+            m_error_handler(s);
+        } else if (error.empty()) {
+            error = s;
+        }
+    }
+
+    m_expired.clear();
+    m_dispatching = false;
+
+    if (!error.empty()) {
+        throw LuaException(error);
+    }
+}
@@ -0,0 +1,221 @@
+//
+// https://github.com/SteveKChiu/lua-intf
+//
+// Copyright 2014, Steve K. Chiu <steve.k.chiu@gmail.com>
+//
+// The MIT License (http://www.opensource.org/licenses/mit-license.php)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+// THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+// DEALINGS IN THE SOFTWARE.
+//
+
+#ifndef LUAINTF_H
+    #include "LuaIntf/LuaIntf.h"
+    using namespace LuaIntf;
+#endif
+
+//---------------------------------------------------------------------------
+
+#if LUA_VERSION_NUM >= 505
+
+/**
+ * The external string release function, the owner is the heap object holding the buffer
+ */
+template <typename OWNER>
+static void* releaseExternalString(void* owner, void*, size_t, size_t)
+{
+    delete static_cast<OWNER*>(owner);
+    return nullptr;
+}
+
+#endif
+
+LUA_INLINE void LuaTypeMapping<std::string>::push(lua_State* L, std::string&& str)
+{
+#if LUA_VERSION_NUM >= 505
+    if (str.size() >= LUAINTF_EXTERNAL_STRING_MIN_SIZE) {
+        std::string* owner = new std::string(std::move(str));
+        lua_pushexternalstring(L, owner->c_str(), owner->size(),
+            &releaseExternalString<std::string>, owner);
+        return;
+    }
+#endif
+    lua_pushlstring(L, str.data(), str.size());
+}
+
+LUA_INLINE void LuaTypeMapping<LuaSharedString>::push(lua_State* L, const LuaSharedString& str)
+{
+    if (!str) {
+        lua_pushnil(L);
+        return;
+    }
+
+#if LUA_VERSION_NUM >= 505
+    if (str.size() >= LUAINTF_EXTERNAL_STRING_MIN_SIZE) {
+        using Buffer = std::shared_ptr<const std::string>;
+        Buffer* owner = new Buffer(str.buffer());
+        lua_pushexternalstring(L, (*owner)->c_str(), (*owner)->size(),
+            &releaseExternalString<Buffer>, owner);
+        return;
+    }
+#endif
+    lua_pushlstring(L, str.data(), str.size());
+}
+
+//---------------------------------------------------------------------------
+
+LUA_INLINE void LuaTypeMapping<LuaStaticString>::push(lua_State* L, const LuaStaticString& str)
+{
+    // the address of this static is the registry key of the cache table
+    static const char CACHE_KEY = 0;
+
+    if (!str.data) {
+        lua_pushnil(L);
+        return;
+    }
+
+    lua_rawgetp(L, LUA_REGISTRYINDEX, &CACHE_KEY);      // <cache>
+    if (lua_isnil(L, -1)) {
+        lua_pop(L, 1);
+        lua_newtable(L);
+        lua_pushvalue(L, -1);
+        lua_rawsetp(L, LUA_REGISTRYINDEX, &CACHE_KEY);
+    }
+
+    lua_rawgetp(L, -1, str.data);                       // <cache> <string>
+    if (lua_isnil(L, -1)) {
+        lua_pop(L, 1);
+        lua_pushstring(L, str.data);
+        lua_pushvalue(L, -1);
+        lua_rawsetp(L, -3, str.data);
+    }
+    lua_remove(L, -2);                                  // <string>
+}
+
+//---------------------------------------------------------------------------
+
+LUA_INLINE LuaEnumNameTable::LuaEnumNameTable(const lua_Integer* values, const char* const* names, size_t count)
+    : m_dense(true)
+{
+    m_entries.resize(count);
+    m_sorted.resize(count);
+    for (size_t i = 0; i < count; i++) {
+        m_entries[i].value = values[i];
+        m_entries[i].name = names[i];
+        m_entries[i].len = std::strlen(names[i]);
+        m_sorted[i] = int(i);
+        m_dense = m_dense && values[i] == values[0] + lua_Integer(i);
+    }
+
+    std::stable_sort(m_sorted.begin(), m_sorted.end(), [this] (int a, int b) {
+        return m_entries[a].value < m_entries[b].value;
+    });
+
+    // the number of slots and buckets are power of 2, so we can mask instead of mod
+    size_t num_slots = 1;
+    while (num_slots < count) num_slots <<= 1;
+    size_t num_buckets = 1;
+    while (num_buckets * 2 < count) num_buckets <<= 1;
+
+    std::vector<std::vector<int>> buckets(num_buckets);
+    for (size_t i = 0; i < count; i++) {
+        const Entry& e = m_entries[i];
+        std::vector<int>& bucket = buckets[hash(e.name, e.len, 0) & (num_buckets - 1)];
+        for (int k : bucket) {
+            if (m_entries[k].len == e.len && std::memcmp(m_entries[k].name, e.name, e.len) == 0) {
+                throw LuaException(std::string("duplicated enum name: ") + e.name);
+            }
+        }
+        bucket.push_back(int(i));
+    }
+
+    std::vector<int> order(num_buckets);
+    for (size_t b = 0; b < num_buckets; b++) {
+        order[b] = int(b);
+    }
+    std::stable_sort(order.begin(), order.end(), [&buckets] (int a, int b) {
+        return buckets[a].size() > buckets[b].size();
+    });
+
+    // find the seed for each bucket, so all the names in bucket are placed in free slots
+    m_seeds.assign(num_buckets, 0);
+    m_slots.assign(num_slots, -1);
+    std::vector<size_t> placed;
+    for (int b : order) {
+        const std::vector<int>& bucket = buckets[b];
+        if (bucket.empty()) break;
+
+        for (uint32_t seed = 1; ; seed++) {
+            placed.clear();
+            for (int k : bucket) {
+                const Entry& e = m_entries[k];
+                size_t slot = hash(e.name, e.len, seed) & (num_slots - 1);
+                if (m_slots[slot] >= 0 || std::find(placed.begin(), placed.end(), slot) != placed.end()) break;
+                placed.push_back(slot);
+            }
+            if (placed.size() == bucket.size()) {
+                for (size_t i = 0; i < placed.size(); i++) {
+                    m_slots[placed[i]] = bucket[i];
+                }
+                m_seeds[b] = seed;
+                break;
+            }
+        }
+    }
+}
+
+LUA_INLINE bool LuaEnumNameTable::find(const char* name, size_t len, lua_Integer& value) const
+{
+    if (m_entries.empty()) return false;
+    uint32_t seed = m_seeds[hash(name, len, 0) & (m_seeds.size() - 1)];
+    if (seed == 0) return false;
+    int k = m_slots[hash(name, len, seed) & (m_slots.size() - 1)];
+    if (k < 0) return false;
+    const Entry& e = m_entries[k];
+    if (e.len != len || std::memcmp(e.name, name, len) != 0) return false;
+    value = e.value;
+    return true;
+}
+
+LUA_INLINE const char* LuaEnumNameTable::name(lua_Integer value) const
+{
+    if (m_entries.empty()) return nullptr;
+    if (m_dense) {
+        lua_Integer i = value - m_entries[0].value;
+        return i >= 0 && size_t(i) < m_entries.size() ? m_entries[size_t(i)].name : nullptr;
+    }
+    auto it = std::lower_bound(m_sorted.begin(), m_sorted.end(), value, [this] (int k, lua_Integer v) {
+        return m_entries[k].value < v;
+    });
+    return it != m_sorted.end() && m_entries[*it].value == value ? m_entries[*it].name : nullptr;
+}
+
+LUA_INLINE uint32_t LuaEnumNameTable::hash(const char* s, size_t len, uint32_t seed)
+{
+    // FNV-1a with seed, then murmur3 finalizer to mix the low bits
+    uint32_t h = 2166136261u ^ (seed * 0x9e3779b9u);
+    for (size_t i = 0; i < len; i++) {
+        h = (h ^ uint8_t(s[i])) * 16777619u;
+    }
+    h ^= h >> 16;
+    h *= 0x85ebca6bu;
+    h ^= h >> 13;
+    h *= 0xc2b2ae35u;
+    h ^= h >> 16;
+    return h;
+}